@@ -12,8 +12,108 @@
 
 #include <JuceHeader.h>
 
+// Hard-knee gain computers for BasicCompressor. gainChangeDb() maps an input level
+// to the gain change the envelope follows, in dB: positive attenuates, negative
+// boosts. slope() turns the ratio into the factor gainChangeDb() scales by, once
+// per block. Each is written with min, max and a compare only, so the sample loop
+// they are inlined into has no branches. flatBelowThreshold marks the ones that
+// give the same gain change for every level under the threshold, so a block that
+// stays there needs no per-sample work once the envelope has settled.
+namespace GainComputers
+{
+// Above the threshold, the level rises 1/ratio dB per dB
+struct DownwardCompression
+{
+    static constexpr bool usesRatio = true;
+    static constexpr bool attacksOnRisingLevel = true;
+    static constexpr bool flatBelowThreshold = true;
+
+    template <typename SampleType>
+    static SampleType slope(SampleType ratio) { return SampleType(1) - SampleType(1) / ratio; }
+
+    template <typename SampleType>
+    static SampleType gainChangeDb(SampleType inputLevelDb, SampleType thresholdDb, SampleType slope)
+    {
+        return juce::jmax(SampleType(0), inputLevelDb - thresholdDb) * slope;
+    }
+};
+
+// Below the threshold, the level is lifted towards it, by at most maximumBoostDb
+struct UpwardCompression
+{
+    static constexpr bool usesRatio = true;
+    static constexpr bool attacksOnRisingLevel = true;
+    static constexpr bool flatBelowThreshold = false;
+    static constexpr float maximumBoostDb = 24.0f;
+
+    template <typename SampleType>
+    static SampleType slope(SampleType ratio) { return SampleType(1) - SampleType(1) / ratio; }
+
+    template <typename SampleType>
+    static SampleType gainChangeDb(SampleType inputLevelDb, SampleType thresholdDb, SampleType slope)
+    {
+        return juce::jmax(SampleType(-maximumBoostDb), juce::jmin(SampleType(0), inputLevelDb - thresholdDb) * slope);
+    }
+};
+
+// Below the threshold, the level falls ratio dB per dB, by at most maximumCutDb
+struct DownwardExpansion
+{
+    static constexpr bool usesRatio = true;
+    static constexpr bool attacksOnRisingLevel = false;
+    static constexpr bool flatBelowThreshold = false;
+    static constexpr float maximumCutDb = 60.0f;
+
+    template <typename SampleType>
+    static SampleType slope(SampleType ratio) { return ratio - SampleType(1); }
+
+    template <typename SampleType>
+    static SampleType gainChangeDb(SampleType inputLevelDb, SampleType thresholdDb, SampleType slope)
+    {
+        return juce::jmin(SampleType(maximumCutDb), juce::jmax(SampleType(0), thresholdDb - inputLevelDb) * slope);
+    }
+};
+
+// Below the threshold, the level is cut by rangeDb; the ratio is not used
+struct Gate
+{
+    static constexpr bool usesRatio = false;
+    static constexpr bool attacksOnRisingLevel = false;
+    static constexpr bool flatBelowThreshold = true;
+    static constexpr float rangeDb = 60.0f;
+
+    template <typename SampleType>
+    static SampleType slope(SampleType) { return SampleType(0); }
+
+    template <typename SampleType>
+    static SampleType gainChangeDb(SampleType inputLevelDb, SampleType thresholdDb, SampleType)
+    {
+        return static_cast<SampleType>(inputLevelDb < thresholdDb) * SampleType(rangeDb);
+    }
+};
+}
+
 class BasicCompressor
 {
+public:
+    // Which of the GainComputers process() runs
+    enum class Mode
+    {
+        downwardCompression,
+        upwardCompression,
+        downwardExpansion,
+        gate
+    };
+
+    // The level process() gives samples quieter than 0.000001
+    static constexpr float silenceLevelDb = -120.0f;
+
+    // Largest setDetectorDecimation() factor
+    static constexpr int maximumDetectorDecimation = 32;
+
+    // The gain change of mode at inputLevelDb, outside the sample loop
+    static float computeGainChangeDb(Mode mode, float inputLevelDb, float thresholdDb, float ratio);
+
 private:
     float m_previousEnvelopeLevel = 0.0f;
     float m_thresholdLevelDb = -10.0f;
@@ -21,20 +121,55 @@ private:
     float m_attackTimeInMs = 2000.0f;
     float m_releaseTimeInMs = 6000.0f;
     float m_newMakeUpGainDb = 0.0f;
+    Mode m_mode = Mode::downwardCompression;
+    int m_detectorDecimation = 1;
 
     float m_alphaAttack;
     float m_alphaRelease;
+    float m_controlAlphaAttack;
+    float m_controlAlphaRelease;
+    
+    // Latest envelope level, published for the editor's response overlay
+    std::atomic<float> m_gainReductionDb { 0.0f };
     
     juce::dsp::ProcessSpec m_compressorSpecifications;
+    
+    // Samples per pass of the level, envelope and gain loops. A multiple of every
+    // power-of-two decimation, so control segments don't straddle chunks.
+    static constexpr int chunkSize = 64;
+    static_assert(chunkSize % maximumDetectorDecimation == 0, "control segments must tile a chunk");
+
+    void updateControlRateCoefficients();
+    
+    template <typename GainComputer, typename SampleType>
+    void processWith(juce::dsp::ProcessContextReplacing<SampleType>& context);
+
+    // Handles a block that can't move a settled envelope, and says whether it did
+    template <typename GainComputer, typename SampleType>
+    bool processSettledBlock(juce::dsp::ProcessContextReplacing<SampleType>& context);
 
 public:
     void prepare(const juce::dsp::ProcessSpec& compressorSpec);
-    void process(juce::dsp::ProcessContextReplacing<float>& context);
+    void reset();
+    template <typename SampleType>
+    void process(juce::dsp::ProcessContextReplacing<SampleType>& context);
     void setAttackTime(float newAttackTime);
     void setReleaseTime(float newReleaseTime);
     void setThresholdLevel(float newThreshold);
     void setCompressionRatio(float newCompressionRatio);
     void setMakeUpGain(float newMakeUpGain);
+    void setMode(Mode newMode);
+    
+    // Runs the detector and gain computer once per newDecimation samples, on the
+    // peak of those samples, and interpolates the gain in between. 1, the default,
+    // runs them on every sample; a band whose content is well below the sample rate
+    // can use 4-32 for a fraction of the cost; 2 saves nothing.
+    void setDetectorDecimation(int newDecimation);
+    float getGainReductionDb() const;
+    
+    // The gain reduction a steady silence settles at, which reset() starts from:
+    // none when compressing downwards, the full boost or cut otherwise
+    float getRestingGainReductionDb() const;
 
 };
 
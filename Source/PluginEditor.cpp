@@ -33,11 +33,22 @@ rightPathProducer(audioProcessor.rightChannelFifo)
         param->addListener(this);
     }
     
-    startTimerHz(60);
+    using namespace PluginParameters;
+    const auto& parameters = GetParameters();
+    
+    lowMidXover = dynamic_cast<juce::AudioParameterFloat*>(&getParameter(audioProcessor.apvts, parameters, ParamNames::Low_Mid_XO_Frequency));
+    midHighXover = dynamic_cast<juce::AudioParameterFloat*>(&getParameter(audioProcessor.apvts, parameters, ParamNames::Mid_High_XO_Frequency));
+    crossoverMode = dynamic_cast<juce::AudioParameterChoice*>(&getParameter(audioProcessor.apvts, parameters, ParamNames::Crossover_Mode));
+    jassert( lowMidXover != nullptr && midHighXover != nullptr && crossoverMode != nullptr );
+    
+    // Fully covered by the cached background layer, so the parent never needs repainting
+    setOpaque(true);
 }
 
 SpectrumAnalyser::~SpectrumAnalyser()
 {
+    refreshTicker->removeClient(this);
+    
     const auto& params = audioProcessor.getParameters();
     for( auto param : params )
     {
@@ -48,10 +59,14 @@ SpectrumAnalyser::~SpectrumAnalyser()
 void SpectrumAnalyser::paint (juce::Graphics& g)
 {
     using namespace juce;
-    // (Our component is opaque, so we must completely fill the background with a solid colour)
-    g.fillAll (Colours::black);
-
-    drawBackgroundGrid(g);
+    
+    // Rebuild the cached layers if they were invalidated or the display scale moved
+    auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if( backgroundLayer.isNull() || foregroundLayer.isNull() || scale != layerScale )
+        renderLayers(scale);
+    
+    // (Our component is opaque, so the background layer completely fills it)
+    g.drawImage(backgroundLayer, getLocalBounds().toFloat());
     
     auto responseArea = getAnalysisArea();
     
@@ -70,6 +85,20 @@ void SpectrumAnalyser::paint (juce::Graphics& g)
         g.strokePath(rightChannelFFTPath, PathStrokeType(1.f));
     }
     
+    const std::array<Colour, 3> bandColours { Colour(236u, 114u, 41u), Colours::white, Colour(0u, 172u, 1u) };
+    for( size_t i = 0; i < responseCurves.size(); ++i )
+    {
+        g.setColour(bandColours[i]);
+        g.strokePath(responseCurves[i], PathStrokeType(2.f));
+    }
+    
+    // Border mask, text labels and outline
+    g.drawImage(foregroundLayer, getLocalBounds().toFloat());
+}
+
+void SpectrumAnalyser::drawBorder(juce::Graphics& g)
+{
+    using namespace juce;
     Path border;
     
     border.setUsingNonZeroWinding(false);
@@ -87,28 +116,65 @@ void SpectrumAnalyser::paint (juce::Graphics& g)
     g.drawRoundedRectangle(getRenderArea().toFloat(), 4.f, 1.f);
 }
 
-std::vector<float> SpectrumAnalyser::getFrequencies()
+void SpectrumAnalyser::invalidateLayers()
 {
-    return std::vector<float>
+    backgroundLayer = {};
+    foregroundLayer = {};
+}
+
+void SpectrumAnalyser::renderLayers(float scale)
+{
+    using namespace juce;
+    layerScale = scale;
+    
+    auto width = jmax(1, roundToInt(getWidth() * scale));
+    auto height = jmax(1, roundToInt(getHeight() * scale));
+    
+    // Black fill and grid sit underneath the analyser paths
+    backgroundLayer = Image(Image::RGB, width, height, true);
+    {
+        Graphics bg(backgroundLayer);
+        bg.addTransform(AffineTransform::scale(scale));
+        bg.fillAll(Colours::black);
+        drawBackgroundGrid(bg);
+    }
+    
+    // Border, labels and outline sit on top, transparent over the render area
+    foregroundLayer = Image(Image::ARGB, width, height, true);
+    {
+        Graphics fg(foregroundLayer);
+        fg.addTransform(AffineTransform::scale(scale));
+        drawBorder(fg);
+    }
+}
+
+const std::vector<float>& SpectrumAnalyser::getFrequencies()
+{
+    static const std::vector<float> frequencies
     {
         20, /*30, 40,*/ 50, 100,
         200, /*300, 400,*/ 500, 1000,
         2000, /*3000, 4000,*/ 5000, 10000,
         20000
     };
+    
+    return frequencies;
 }
 
-std::vector<float> SpectrumAnalyser::getGains()
+const std::vector<float>& SpectrumAnalyser::getGains()
 {
-    return std::vector<float>
+    static const std::vector<float> gains
     {
         -24, -12, 0, 12, 24
     };
+    
+    return gains;
 }
 
 std::vector<float> SpectrumAnalyser::getXs(const std::vector<float> &freqs, float left, float width)
 {
     std::vector<float> xs;
+    xs.reserve(freqs.size());
     for( auto f : freqs )
     {
         auto normX = juce::mapFromLog10(f, 20.f, 20000.f);
@@ -121,7 +187,7 @@ std::vector<float> SpectrumAnalyser::getXs(const std::vector<float> &freqs, floa
 void SpectrumAnalyser::drawBackgroundGrid(juce::Graphics &g)
 {
     using namespace juce;
-    auto freqs = getFrequencies();
+    const auto& freqs = getFrequencies();
     
     auto renderArea = getAnalysisArea();
     auto left = renderArea.getX();
@@ -138,7 +204,7 @@ void SpectrumAnalyser::drawBackgroundGrid(juce::Graphics &g)
         g.drawVerticalLine(x, top, bottom);
     }
     
-    auto gain = getGains();
+    const auto& gain = getGains();
     
     for( auto gDb : gain )
     {
@@ -163,7 +229,7 @@ void SpectrumAnalyser::drawTextLabels(juce::Graphics &g)
     auto bottom = renderArea.getBottom();
     auto width = renderArea.getWidth();
     
-    auto freqs = getFrequencies();
+    const auto& freqs = getFrequencies();
     auto xs = getXs(freqs, left, width);
     
     for( int i = 0; i < freqs.size(); ++i )
@@ -195,7 +261,7 @@ void SpectrumAnalyser::drawTextLabels(juce::Graphics &g)
         g.drawFittedText(str, r, juce::Justification::centred, 1);
     }
     
-    auto gain = getGains();
+    const auto& gain = getGains();
 
     for( auto gDb : gain )
     {
@@ -230,7 +296,39 @@ void SpectrumAnalyser::drawTextLabels(juce::Graphics &g)
 
 void SpectrumAnalyser::resized()
 {
-    using namespace juce;
+    invalidateLayers();
+}
+
+void SpectrumAnalyser::lookAndFeelChanged()
+{
+    invalidateLayers();
+    repaint();
+}
+
+void SpectrumAnalyser::visibilityChanged()
+{
+    updateRefreshSubscription();
+}
+
+void SpectrumAnalyser::parentHierarchyChanged()
+{
+    updateRefreshSubscription();
+}
+
+void SpectrumAnalyser::updateRefreshSubscription()
+{
+    if( isShowing() )
+    {
+        // Wake up at full rate so the first frames after re-opening are not stale
+        refreshInterval = 1;
+        ticksSinceRefresh = 0;
+        idleTicks = 0;
+        refreshTicker->addClient(this);
+    }
+    else
+    {
+        refreshTicker->removeClient(this);
+    }
 }
 
 void SpectrumAnalyser::parameterValueChanged(int parameterIndex, float newValue)
@@ -238,7 +336,7 @@ void SpectrumAnalyser::parameterValueChanged(int parameterIndex, float newValue)
     parametersChanged.set(true);
 }
 
-void PathProducer::process(juce::Rectangle<float> fftBounds, double sampleRate)
+bool PathProducer::process(juce::Rectangle<float> fftBounds, double sampleRate)
 {
     juce::AudioBuffer<float> tempIncomingBuffer;
     while( leftChannelFifo->getNumCompleteBuffersAvailable() > 0 )
@@ -261,13 +359,32 @@ void PathProducer::process(juce::Rectangle<float> fftBounds, double sampleRate)
     
     const auto fftSize = leftChannelFFTDataGenerator.getFFTSize();
     const auto binWidth = sampleRate / double(fftSize);
+    
+    // A new layout always needs a new path, even if the spectrum itself is static
+    auto changed = fftBounds != lastFFTBounds;
+    lastFFTBounds = fftBounds;
 
     while( leftChannelFFTDataGenerator.getNumAvailableFFTDataBlocks() > 0 )
     {
-        std::vector<float> fftData;
         if( leftChannelFFTDataGenerator.getFFTData( fftData) )
         {
-            pathProducer.generatePath(fftData, fftBounds, fftSize, binWidth, -48.f);
+            // Skip path generation for frames that would not visibly move the trace
+            if( ! changed && lastRenderedFFTData.size() == fftData.size() )
+            {
+                const auto numBins = fftSize / 2;
+                for( int i = 0; i < numBins && ! changed; ++i )
+                    changed = std::abs(fftData[i] - lastRenderedFFTData[i]) > changeThresholdDb;
+            }
+            else
+            {
+                changed = true;
+            }
+            
+            if( changed )
+            {
+                lastRenderedFFTData = fftData;
+                pathProducer.generatePath(fftData, fftBounds, fftSize, binWidth, -48.f);
+            }
         }
     }
     
@@ -275,25 +392,120 @@ void PathProducer::process(juce::Rectangle<float> fftBounds, double sampleRate)
     {
         pathProducer.getPath( leftChannelFFTPath );
     }
+    
+    return changed;
+}
+
+void SpectrumAnalyser::refreshTick()
+{
+    // Minimised or otherwise off-screen windows keep their subscription but do no work
+    if( ! isShowing() )
+        return;
+    
+    if( ++ticksSinceRefresh < refreshInterval )
+        return;
+    
+    ticksSinceRefresh = 0;
+    
+    if( updateContent() )
+    {
+        refreshInterval = 1;
+        idleTicks = 0;
+        
+        // Only the analyser paths move between frames; the cached layers are static
+        repaint(getRenderArea());
+    }
+    else if( ++idleTicks >= idleTicksBeforeSlowdown )
+    {
+        refreshInterval = idleRefreshInterval;
+    }
 }
 
-void SpectrumAnalyser::timerCallback()
+bool SpectrumAnalyser::updateContent()
 {
+    auto changed = false;
+    
     if( shouldShowFFTAnalysis )
     {
         auto fftBounds = getAnalysisArea().toFloat();
         auto sampleRate = audioProcessor.getSampleRate();
         
-        leftPathProducer.process(fftBounds, sampleRate);
-        rightPathProducer.process(fftBounds, sampleRate);
+        changed |= leftPathProducer.process(fftBounds, sampleRate);
+        changed |= rightPathProducer.process(fftBounds, sampleRate);
     }
 
-    if( parametersChanged.compareAndSetBool(false, true) )
+    auto crossoverMayHaveChanged = parametersChanged.compareAndSetBool(false, true);
+    changed |= updateResponseCurves(crossoverMayHaveChanged);
+    return changed;
+}
+
+bool SpectrumAnalyser::updateResponseCurves(bool crossoverMayHaveChanged)
+{
+    using namespace juce;
+    auto responseArea = getAnalysisArea();
+    auto sampleRate = audioProcessor.getSampleRate();
+    
+    if( responseArea.getWidth() < 2 || sampleRate <= 0.0 )
+        return false;
+    
+    auto rebuild = crossoverResponse.prepare(responseArea.getWidth(), sampleRate);
+    rebuild |= responseArea != lastResponseArea;
+    lastResponseArea = responseArea;
+    
+    // The curves are only recomputed when the mode or a crossover actually changed
+    if( crossoverMayHaveChanged || rebuild )
     {
+        auto lowMid = lowMidXover->get();
+        auto midHigh = midHighXover->get();
+        auto mode = crossoverMode->getIndex();
         
+        if( rebuild || lowMid != lastLowMidFrequency || midHigh != lastMidHighFrequency || mode != lastCrossoverMode )
+        {
+            lastLowMidFrequency = lowMid;
+            lastMidHighFrequency = midHigh;
+            lastCrossoverMode = mode;
+            // The Crossover Mode choices are listed in the core's CrossoverMode order
+            crossoverResponse.update(static_cast<MultibandCore::CrossoverMode>(mode), lowMid, midHigh);
+            rebuild = true;
+        }
     }
     
-    repaint();
+    std::array<float, 3> gainReductionDb;
+    for( size_t i = 0; i < gainReductionDb.size(); ++i )
+    {
+        gainReductionDb[i] = audioProcessor.getGainReductionDb(i);
+        rebuild |= std::abs(gainReductionDb[i] - lastGainReductionDb[i]) > gainReductionThresholdDb;
+    }
+    
+    if( ! rebuild )
+        return false;
+    
+    lastGainReductionDb = gainReductionDb;
+    
+    auto left = float(responseArea.getX());
+    auto top = float(responseArea.getY());
+    auto bottom = float(responseArea.getBottom());
+    auto numPoints = crossoverResponse.getNumPoints();
+    
+    auto map = [bottom, top](float gainDb)
+    {
+        return jmap(jlimit(-24.f, 24.f, gainDb), -24.f, 24.f, bottom, top);
+    };
+    
+    for( size_t band = 0; band < responseCurves.size(); ++band )
+    {
+        const auto& magnitudesDb = crossoverResponse.getBandMagnitudesDb(band);
+        auto& curve = responseCurves[band];
+        
+        curve.clear();
+        curve.preallocateSpace(3 * numPoints);
+        curve.startNewSubPath(left, map(magnitudesDb[0] - gainReductionDb[band]));
+        
+        for( int i = 1; i < numPoints; ++i )
+            curve.lineTo(left + i, map(magnitudesDb[i] - gainReductionDb[band]));
+    }
+    
+    return true;
 }
 
 juce::Rectangle<int> SpectrumAnalyser::getRenderArea()
@@ -431,6 +643,111 @@ void ControlBar::paint(juce::Graphics& g)
     g.drawRect(localBounds);
 }
 
+SnapshotBar::SnapshotBar(One_MBCompAudioProcessor& processor) :
+audioProcessor(processor)
+{
+    titleLabel.setText("Snapshots", juce::NotificationType::dontSendNotification);
+    addAndMakeVisible(titleLabel);
+    
+    for( int slot = 0; slot < ParameterSnapshots::numSlots; ++slot )
+    {
+        const auto name = juce::String::charToString(static_cast<juce::juce_wchar>('A' + slot));
+        auto& storeButton = storeButtons[static_cast<size_t>(slot)];
+        auto& recallButton = recallButtons[static_cast<size_t>(slot)];
+        
+        storeButton.setButtonText("Store " + name);
+        storeButton.onClick = [this, slot]
+        {
+            audioProcessor.storeSnapshot(slot);
+            updateRecallButtons();
+        };
+        
+        recallButton.setButtonText(name);
+        recallButton.onClick = [this, slot] { audioProcessor.recallSnapshot(slot); };
+        
+        addAndMakeVisible(storeButton);
+        addAndMakeVisible(recallButton);
+    }
+    
+    updateRecallButtons();
+}
+
+SnapshotBar::~SnapshotBar()
+{
+    refreshTicker->removeClient(this);
+}
+
+void SnapshotBar::refreshTick()
+{
+    updateRecallButtons();
+}
+
+void SnapshotBar::updateRecallButtons()
+{
+    for( int slot = 0; slot < ParameterSnapshots::numSlots; ++slot )
+    {
+        auto& recallButton = recallButtons[static_cast<size_t>(slot)];
+        const auto stored = audioProcessor.hasSnapshot(slot);
+        
+        if( recallButton.isEnabled() != stored )
+            recallButton.setEnabled(stored);
+    }
+}
+
+void SnapshotBar::visibilityChanged()
+{
+    updateRefreshSubscription();
+}
+
+void SnapshotBar::parentHierarchyChanged()
+{
+    updateRefreshSubscription();
+}
+
+void SnapshotBar::updateRefreshSubscription()
+{
+    if( isShowing() )
+    {
+        updateRecallButtons();
+        refreshTicker->addClient(this);
+    }
+    else
+    {
+        refreshTicker->removeClient(this);
+    }
+}
+
+void SnapshotBar::resized()
+{
+    auto bounds = getLocalBounds().reduced(5, 4);
+    titleLabel.setBounds(bounds.removeFromLeft(80));
+    
+    // Each slot gets a store button and, next to it, a narrower recall button
+    auto slotWidth = bounds.getWidth() / ParameterSnapshots::numSlots;
+    for( size_t slot = 0; slot < storeButtons.size(); ++slot )
+    {
+        auto slotBounds = bounds.removeFromLeft(slotWidth).reduced(2, 0);
+        recallButtons[slot].setBounds(slotBounds.removeFromRight(slotBounds.getWidth() / 3));
+        storeButtons[slot].setBounds(slotBounds);
+    }
+}
+
+void SnapshotBar::paint(juce::Graphics& g)
+{
+    using namespace juce;
+    auto bounds = getLocalBounds();
+    g.setColour(Colours::grey);
+    g.fillAll();
+    
+    auto localBounds = bounds;
+    
+    bounds.reduce(3,3);
+    g.setColour(Colours::black);
+    g.fillRoundedRectangle(bounds.toFloat(), 3);
+    
+    g.drawRect(localBounds);
+}
+
 //======================referenced and adapted from Schiermeyer (2021a; 2021b)========================================================
 
 template<typename T>
@@ -481,13 +798,39 @@ void LookAndFeel::drawRotarySlider(juce::Graphics &g,
     auto bounds = Rectangle<float>(x, y, width, height);
     
     auto enabled = slider.isEnabled();
-    
-    g.setColour(enabled ? Colour(236u, 114u, 41u) : Colours::darkgrey);
-    g.fillEllipse(bounds);
-    
+
+    // Render the knob body once per size/state and blit it on later repaints
+    auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    auto knobSize = bounds.toNearestInt().withZeroOrigin();
+    if( knobBackground.isNull()
+        || knobSize != knobBackgroundSize
+        || scale != knobBackgroundScale
+        || enabled != knobBackgroundEnabled )
+    {
+        knobBackgroundSize = knobSize;
+        knobBackgroundScale = scale;
+        knobBackgroundEnabled = enabled;
+
+        knobBackground = Image(Image::ARGB,
+                               jmax(1, roundToInt(width * scale)),
+                               jmax(1, roundToInt(height * scale)),
+                               true);
+        Graphics kg(knobBackground);
+        kg.addTransform(AffineTransform::scale(scale));
+
+        auto knobBounds = Rectangle<float>(0, 0, width, height);
+
+        kg.setColour(enabled ? Colour(236u, 114u, 41u) : Colours::darkgrey);
+        kg.fillEllipse(knobBounds);
+
+        kg.setColour(enabled ? Colour(46u, 48u, 45u) : Colours::grey);
+        kg.drawEllipse(knobBounds.reduced(0.5f), 1.f);
+    }
+
+    g.drawImage(knobBackground, bounds);
+
     g.setColour(enabled ? Colour(46u, 48u, 45u) : Colours::grey);
-    g.drawEllipse(bounds, 1.f);
-    
+
     if(auto* rswl = dynamic_cast<RotarySliderWithLabels*>(&slider))
     {
         auto center = bounds.getCentre();
@@ -938,11 +1281,12 @@ One_MBCompAudioProcessorEditor::One_MBCompAudioProcessorEditor (One_MBCompAudioP
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
     addAndMakeVisible(controlBar);
+    addAndMakeVisible(snapshotBar);
     addAndMakeVisible(specAnalyser);
     addAndMakeVisible(globalControls);
     addAndMakeVisible(bandControls);
     
-    setSize (500, 600);
+    setSize (500, 630);
 }
 
 One_MBCompAudioProcessorEditor::~One_MBCompAudioProcessorEditor()
@@ -969,6 +1313,7 @@ void One_MBCompAudioProcessorEditor::resized()
     auto bounds = getLocalBounds();
     
     controlBar.setBounds(bounds.removeFromTop(40));
+    snapshotBar.setBounds(bounds.removeFromTop(30));
     
     bandControls.setBounds(bounds.removeFromBottom(225));
     
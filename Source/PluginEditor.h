@@ -11,6 +11,9 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "crossoverResponse.h"
+#include "sharedResources.h"
+#include "fastMath.h"
 
 struct ControlBar : juce::Component
 {
@@ -36,6 +39,74 @@ private:
 };
 
 
+/**
+ A single process-wide UI tick shared by every editor instance (via
+ juce::SharedResourcePointer). The timer only runs while at least one client
+ is subscribed, so closed or hidden editors cost nothing.
+*/
+struct RefreshTicker : juce::Timer
+{
+    struct Client
+    {
+        virtual ~Client() = default;
+        virtual void refreshTick() = 0;
+    };
+    
+    ~RefreshTicker() override { stopTimer(); }
+    
+    void addClient(Client* client)
+    {
+        clients.add(client);
+        if( ! isTimerRunning() )
+            startTimerHz(refreshRateHz);
+    }
+    
+    void removeClient(Client* client)
+    {
+        clients.remove(client);
+        if( clients.isEmpty() )
+            stopTimer();
+    }
+    
+    void timerCallback() override
+    {
+        clients.call([](Client& c) { c.refreshTick(); });
+    }
+    
+    static constexpr int refreshRateHz = 60;
+private:
+    juce::ListenerList<Client> clients;
+};
+
+/**
+ Stores the current settings into snapshot A-D and recalls them onto the
+ parameters. The snapshots are the ends of the morph (see Morph_Source and
+ Morph_Target). A recall button is enabled while its slot holds a snapshot,
+ which a restored session can change at any time, so the bar checks on the
+ shared tick while it is on screen.
+*/
+struct SnapshotBar : juce::Component, RefreshTicker::Client
+{
+    SnapshotBar(One_MBCompAudioProcessor& processor);
+    ~SnapshotBar() override;
+    
+    void refreshTick() override;
+    
+    void resized() override;
+    void paint(juce::Graphics& g) override;
+    void visibilityChanged() override;
+    void parentHierarchyChanged() override;
+private:
+    One_MBCompAudioProcessor& audioProcessor;
+    
+    juce::Label titleLabel;
+    std::array<juce::TextButton, ParameterSnapshots::numSlots> storeButtons, recallButtons;
+    
+    juce::SharedResourcePointer<RefreshTicker> refreshTicker;
+    void updateRefreshSubscription();
+    void updateRecallButtons();
+};
+
 /*
   ==============================================================================
     **************************************************************************
@@ -68,7 +139,7 @@ struct FFTDataGenerator
         std::copy(readIndex, readIndex + fftSize, fftData.begin());
         
         // first apply a windowing function to our data
-        window->multiplyWithWindowingTable (fftData.data(), fftSize);       // [1]
+        juce::FloatVectorOperations::multiply (fftData.data(), window->data(), fftSize);  // [1]
         
         // then render our FFT data..
         forwardFFT->performFrequencyOnlyForwardTransform (fftData.data());  // [2]
@@ -91,11 +162,8 @@ struct FFTDataGenerator
             fftData[i] = v;
         }
         
-        //convert them to decibels
-        for( int i = 0; i < numBins; ++i )
-        {
-            fftData[i] = juce::Decibels::gainToDecibels(fftData[i], negativeInfinity);
-        }
+        //convert them to decibels, to the 0.1 dB the display can show
+        FastMath::gainToDecibels<FastMath::Accuracy::tenthDb>(fftData.data(), fftData.data(), numBins, negativeInfinity);
         
         fftDataFifo.push(fftData);
     }
@@ -109,8 +177,9 @@ struct FFTDataGenerator
         order = newOrder;
         auto fftSize = getFFTSize();
         
-        forwardFFT = std::make_unique<juce::dsp::FFT>(order);
-        window = std::make_unique<juce::dsp::WindowingFunction<float>>(fftSize, juce::dsp::WindowingFunction<float>::blackmanHarris);
+        // The plan and window are shared by every analyser in the process
+        forwardFFT = &sharedResources->getFFT(order);
+        window = sharedResources->getWindow(static_cast<size_t>(fftSize), juce::dsp::WindowingFunction<float>::blackmanHarris);
         
         fftData.clear();
         fftData.resize(fftSize * 2, 0);
@@ -125,8 +194,9 @@ struct FFTDataGenerator
 private:
     FFTOrder order;
     BlockType fftData;
-    std::unique_ptr<juce::dsp::FFT> forwardFFT;
-    std::unique_ptr<juce::dsp::WindowingFunction<float>> window;
+    juce::SharedResourcePointer<SharedResources> sharedResources;
+    const juce::dsp::FFT* forwardFFT = nullptr;
+    std::shared_ptr<const std::vector<float>> window;
     
     Fifo<BlockType> fftDataFifo;
 };
@@ -208,11 +278,17 @@ struct PathProducer
         leftChannelFFTDataGenerator.changeOrder(FFTOrder::order2048);
         monoBuffer.setSize(1, leftChannelFFTDataGenerator.getFFTSize());
     }
-    void process(juce::Rectangle<float> fftBounds, double sampleRate);
+    // Returns true when the rendered spectrum moved by more than changeThresholdDb
+    bool process(juce::Rectangle<float> fftBounds, double sampleRate);
     juce::Path getPath() { return leftChannelFFTPath; }
+    
+    static constexpr float changeThresholdDb = 0.5f;
 private:
     SingleChannelSampleFifo<One_MBCompAudioProcessor::BlockType>* leftChannelFifo;
     
+    std::vector<float> fftData, lastRenderedFFTData;
+    juce::Rectangle<float> lastFFTBounds;
+    
     juce::AudioBuffer<float> monoBuffer;
     
     FFTDataGenerator<std::vector<float>> leftChannelFFTDataGenerator;
@@ -224,7 +300,7 @@ private:
 
 struct SpectrumAnalyser: juce::Component,
 juce::AudioProcessorParameter::Listener,
-juce::Timer
+RefreshTicker::Client
 {
     SpectrumAnalyser(One_MBCompAudioProcessor&);
     ~SpectrumAnalyser();
@@ -233,10 +309,17 @@ juce::Timer
 
     void parameterGestureChanged (int parameterIndex, bool gestureIsStarting) override { }
     
-    void timerCallback() override;
+    void refreshTick() override;
+    
+    // Takes in the latest analyser data and updates the response overlay; true if
+    // anything moved. The tick calls it while on screen, the paint benchmark headless.
+    bool updateContent();
     
     void paint(juce::Graphics& g) override;
     void resized() override;
+    void lookAndFeelChanged() override;
+    void visibilityChanged() override;
+    void parentHierarchyChanged() override;
     
     void toggleAnalysisEnablement(bool enabled)
     {
@@ -249,11 +332,41 @@ private:
 
     juce::Atomic<bool> parametersChanged { false };
     
+    // Crossover response overlay, weighted by each band's current gain reduction
+    CrossoverResponse crossoverResponse;
+    std::array<juce::Path, 3> responseCurves;
+    std::array<float, 3> lastGainReductionDb { };
+    float lastLowMidFrequency = 0.f, lastMidHighFrequency = 0.f;
+    int lastCrossoverMode = -1;
+    juce::Rectangle<int> lastResponseArea;
+    juce::AudioParameterFloat* lowMidXover = nullptr;
+    juce::AudioParameterFloat* midHighXover = nullptr;
+    juce::AudioParameterChoice* crossoverMode = nullptr;
+    static constexpr float gainReductionThresholdDb = 0.1f;
+    bool updateResponseCurves(bool crossoverMayHaveChanged);
+    
+    // Only subscribed to the shared tick while actually on screen
+    juce::SharedResourcePointer<RefreshTicker> refreshTicker;
+    void updateRefreshSubscription();
+    
+    // Ticks are decimated while the spectrum is static, and go back to every tick on change
+    static constexpr int idleTicksBeforeSlowdown = 30;
+    static constexpr int idleRefreshInterval = 6;
+    int refreshInterval = 1, ticksSinceRefresh = 0, idleTicks = 0;
+    
     void drawBackgroundGrid(juce::Graphics& g);
     void drawTextLabels(juce::Graphics& g);
+    void drawBorder(juce::Graphics& g);
     
-    std::vector<float> getFrequencies();
-    std::vector<float> getGains();
+    // Static layers are rendered once into images and only rebuilt when the
+    // bounds, the display scale or the look-and-feel change.
+    juce::Image backgroundLayer, foregroundLayer;
+    float layerScale = 0.f;
+    void invalidateLayers();
+    void renderLayers(float scale);
+    
+    static const std::vector<float>& getFrequencies();
+    static const std::vector<float>& getGains();
     std::vector<float> getXs(const std::vector<float>& freqs, float left, float width);
 
     juce::Rectangle<int> getRenderArea();
@@ -285,6 +398,12 @@ struct LookAndFeel : juce::LookAndFeel_V4
                            juce::ToggleButton & toggleButton,
                            bool shouldDrawButtonAsHighlighted,
                            bool shouldDrawButtonAsDown) override;
+private:
+    // Cached knob body (filled and outlined ellipse), keyed on size and enabled state.
+    juce::Image knobBackground;
+    juce::Rectangle<int> knobBackgroundSize;
+    float knobBackgroundScale = 0.f;
+    bool knobBackgroundEnabled = true;
 };
 
 struct RotarySliderWithLabels : juce::Slider
@@ -467,6 +586,7 @@ private:
     One_MBCompAudioProcessor& audioProcessor;
     
     ControlBar controlBar { audioProcessor.apvts };
+    SnapshotBar snapshotBar { audioProcessor };
     
     GlobalControls globalControls { audioProcessor.apvts };
     CompressorBandControls bandControls { audioProcessor.apvts };
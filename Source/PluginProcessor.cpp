@@ -11,8 +11,6 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
-#include "BasicCompressor.h"
-#include "butterworthFilter.h"
 
 //==============================================================================
 One_MBCompAudioProcessor::One_MBCompAudioProcessor()
@@ -24,73 +22,43 @@ One_MBCompAudioProcessor::One_MBCompAudioProcessor()
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                       ),
-LP1(getSampleRate()), AP2(getSampleRate()), HP1(getSampleRate()), LP2(getSampleRate()), HP2(getSampleRate())
+                       )
 #endif
 {
     using namespace PluginParameters;
-    const auto& parameters = GetParameters();
     
-    auto floatHelper = [&apvts = this->apvts, &parameters](auto& parameter, const auto& ParamNames)
-    {
-        parameter = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(parameters.at(ParamNames)));
-        jassert( parameter != nullptr );
-    };
-    
-    floatHelper(low_BandCompressor.attackTime,      ParamNames::Attack_LB);
-    floatHelper(low_BandCompressor.releaseTime,     ParamNames::Release_LB);
-    floatHelper(low_BandCompressor.thresholdLevel,  ParamNames::Threshold_LB);
-    
-    floatHelper(mid_BandCompressor.attackTime,      ParamNames::Attack_MB);
-    floatHelper(mid_BandCompressor.releaseTime,     ParamNames::Release_MB);
-    floatHelper(mid_BandCompressor.thresholdLevel,  ParamNames::Threshold_MB);
-    
-    floatHelper(high_BandCompressor.attackTime,     ParamNames::Attack_HB);
-    floatHelper(high_BandCompressor.releaseTime,    ParamNames::Release_HB);
-    floatHelper(high_BandCompressor.thresholdLevel, ParamNames::Threshold_HB);
-
-    auto choiceHelper = [&apvts = this->apvts, &parameters](auto& parameter, const auto& ParamNames)
-    {
-        parameter = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter(parameters.at(ParamNames)));
-        jassert( parameter != nullptr );
-    };
+    // The APVTS added the parameters in descriptor-table order, so each one is found
+    // by position: no ID strings, map lookups or searches through the tree
+    const auto& processorParameters = getParameters();
+    jassert( processorParameters.size() == NumParameters );
     
-    choiceHelper(low_BandCompressor.ratio,  ParamNames::Ratio_LB);
-    choiceHelper(mid_BandCompressor.ratio,  ParamNames::Ratio_MB);
-    choiceHelper(high_BandCompressor.ratio, ParamNames::Ratio_HB);
-   
-    
-    auto boolHelper = [&apvts = this->apvts, &parameters](auto& parameter, const auto& ParamNames)
+    parametersByName.resize(parameterDescriptors.size(), nullptr);
+    for( size_t i = 0; i < parameterDescriptors.size(); ++i )
     {
-        parameter = dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(parameters.at(ParamNames)));
-        jassert( parameter != nullptr );
-    };
-    
-    boolHelper(low_BandCompressor.bypassed, ParamNames::Bypass_LB);
-    boolHelper(mid_BandCompressor.bypassed, ParamNames::Bypass_MB);
-    boolHelper(high_BandCompressor.bypassed, ParamNames::Bypass_HB);
+        auto* parameter = static_cast<juce::RangedAudioParameter*>(processorParameters[static_cast<int>(i)]);
+        jassert( parameter->paramID == parameterDescriptors[i].id );
+        parametersByName[static_cast<size_t>(parameterDescriptors[i].name)] = parameter;
+    }
     
-    boolHelper(low_BandCompressor.mute, ParamNames::Mute_LB);
-    boolHelper(mid_BandCompressor.mute, ParamNames::Mute_MB);
-    boolHelper(high_BandCompressor.mute, ParamNames::Mute_HB);
+    lowMidFreqXover = getTypedParameter<juce::AudioParameterFloat>(parametersByName, Low_Mid_XO_Frequency);
+    midHighFreqXover = getTypedParameter<juce::AudioParameterFloat>(parametersByName, Mid_High_XO_Frequency);
     
-    boolHelper(low_BandCompressor.solo, ParamNames::Solo_LB);
-    boolHelper(mid_BandCompressor.solo, ParamNames::Solo_MB);
-    boolHelper(high_BandCompressor.solo, ParamNames::Solo_HB);
+    inputGainParameter = getTypedParameter<juce::AudioParameterFloat>(parametersByName, Gain_Input);
+    outputGainParameter = getTypedParameter<juce::AudioParameterFloat>(parametersByName, Gain_Output);
     
-    floatHelper(lowMidFreqXover, ParamNames::Low_Mid_XO_Frequency);
-    floatHelper(midHighFreqXover, ParamNames::Mid_High_XO_Frequency);
+    crossoverMode = getTypedParameter<juce::AudioParameterChoice>(parametersByName, Crossover_Mode);
+    bypassParameter = getTypedParameter<juce::AudioParameterBool>(parametersByName, Global_Bypass);
     
-    floatHelper(inputGainParameter, ParamNames::Gain_Input);
-    floatHelper(outputGainParameter, ParamNames::Gain_Output);
+    snapshots.prepare(parametersByName);
     
-    LP1.setType(FilterType::lowpass);
-    HP1.setType(FilterType::highpass);
-
-    AP2.setType(FilterType::allpass);
-
-    LP2.setType(FilterType::lowpass);
-    HP2.setType(FilterType::highpass);
+    effectiveValues.resize(parametersByName.size(), 0.f);
+    continuousParameters.resize(parametersByName.size(), false);
+    for( const auto& descriptor : parameterDescriptors )
+    {
+        continuousParameters[static_cast<size_t>(descriptor.name)] = descriptor.type == ParamType::Float;
+    }
+    updateEffectiveValues(true);
+    core.setSettings(makeCoreSettings());
 }
 
 One_MBCompAudioProcessor::~One_MBCompAudioProcessor()
@@ -132,7 +100,8 @@ bool One_MBCompAudioProcessor::isMidiEffect() const
 
 double One_MBCompAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // The lowest possible crossover rings longest
+    return core.getTailLengthSeconds(static_cast<double>(lowMidFreqXover->range.start));
 }
 
 int One_MBCompAudioProcessor::getNumPrograms()
@@ -165,32 +134,54 @@ void One_MBCompAudioProcessor::prepareToPlay (double sampleRate, int samplesPerB
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
     
+    // Everything downstream of processBands only ever sees sub-blocks
     juce::dsp::ProcessSpec spec;
-    spec.maximumBlockSize = samplesPerBlock;
+    spec.maximumBlockSize = static_cast<juce::uint32>(subBlockSize);
     spec.numChannels = getTotalNumOutputChannels();
     spec.sampleRate = sampleRate;
     
-    for( auto& comp : compressors )
-    {
-        comp.prepareComp(spec);
-    }
+    // One smoothing step per sub-block
+    effectiveValueSmoothing = static_cast<float>(1.0 - std::exp(-static_cast<double>(subBlockSize) / (effectiveValueSmoothingSeconds * sampleRate)));
+    updateEffectiveValues(true);
+    
+    // The core starts at the current settings rather than ramping in. If Linear Phase
+    // is selected its kernels are designed here, off the audio thread; otherwise the
+    // engine is only built in the background once the mode is chosen.
+    const auto useDouble = isUsingDoublePrecision();
+    core.setSettings(makeCoreSettings());
+    core.prepare(sampleRate, static_cast<int>(subBlockSize), static_cast<int>(spec.numChannels), useDouble);
+    const auto linearPhaseLatency = core.getLatencySamples(MultibandCore::CrossoverMode::linearPhase);
+    
+    activeCrossoverMode = static_cast<int>(getEffectiveValue(PluginParameters::Crossover_Mode));
+    setLatencySamples(getCrossoverLatencySamples(activeCrossoverMode));
     
-    LP1.prepare(spec);
-    HP1.prepare(spec);
-    AP2.prepare(spec);
-    LP2.prepare(spec);
-    HP2.prepare(spec);
+    // Long enough for any engine's output to stop after its input does
+    silenceHoldSamples = juce::roundToInt(getTailLengthSeconds() * sampleRate) + linearPhaseLatency;
+    silentSamples = 0;
+    sleeping = false;
     
     inputGain.prepare(spec);
-    outputGain.prepare(spec);
+    doubleInputGain.prepare(spec);
     
     inputGain.setRampDurationSeconds(0.05); // ms
-    outputGain.setRampDurationSeconds(0.05);
-        
-    for( auto& buffer : filterBuffers )
-    {
-        buffer.setSize(spec.numChannels, samplesPerBlock);
-    }
+    doubleInputGain.setRampDurationSeconds(0.05);
+    outputGain.reset(sampleRate, 0.05);
+    doubleOutputGain.reset(sampleRate, 0.05);
+    
+    // The bypass path delays by up to the linear-phase latency, and only the buffers
+    // for the precision the host chose are allocated
+    const auto maximumBypassDelay = linearPhaseLatency;
+    bypassBuffer.setSize(spec.numChannels, useDouble ? 0 : static_cast<int>(subBlockSize));
+    doubleBypassBuffer.setSize(spec.numChannels, useDouble ? static_cast<int>(subBlockSize) : 0);
+    bypassDelay.setMaximumDelayInSamples(useDouble ? 0 : maximumBypassDelay);
+    doubleBypassDelay.setMaximumDelayInSamples(useDouble ? maximumBypassDelay : 0);
+    bypassDelay.prepare(spec);
+    doubleBypassDelay.prepare(spec);
+    
+    bypassMixStep = static_cast<float>(1.0 / (bypassCrossfadeSeconds * sampleRate));
+    bypassMix = isBypassRequested() ? 1.f : 0.f;
+    bandsBypassed = bypassMix >= 1.f;
+    bypassPrimeSamples = 0;
     
     leftChannelFifo.prepare(samplesPerBlock);
     rightChannelFifo.prepare(samplesPerBlock);
@@ -200,6 +191,135 @@ void One_MBCompAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    core.release();
+}
+
+void One_MBCompAudioProcessor::updateEffectiveValues(bool jumpToTargets)
+{
+    using namespace PluginParameters;
+    
+    snapshots.pullUpdates();
+    
+    // The morph controls themselves and the host bypass are always live
+    auto liveValue = [this](size_t index)
+    {
+        auto* parameter = parametersByName[index];
+        return parameter->convertFrom0to1(parameter->getValue());
+    };
+    
+    const float* sourceValues = nullptr;
+    const float* targetValues = nullptr;
+    
+    if( liveValue(Morph_Enabled) >= 0.5f )
+    {
+        sourceValues = snapshots.getValues(static_cast<int>(liveValue(Morph_Source)));
+        targetValues = snapshots.getValues(static_cast<int>(liveValue(Morph_Target)));
+    }
+    
+    // Morphing needs both ends stored; until then the parameters stay in charge
+    const auto morphing = sourceValues != nullptr && targetValues != nullptr;
+    const auto amount = liveValue(Morph_Amount);
+    
+    for( size_t index = 0; index < effectiveValues.size(); ++index )
+    {
+        auto target = 0.f;
+        
+        if( morphing && ! isMorphControl(index) )
+        {
+            // Continuous values interpolate; choices and switches flip half way
+            target = continuousParameters[index] ? sourceValues[index] + amount * (targetValues[index] - sourceValues[index])
+                                                 : (amount < 0.5f ? sourceValues[index] : targetValues[index]);
+        }
+        else
+        {
+            target = liveValue(index);
+        }
+        
+        if( jumpToTargets || ! continuousParameters[index] )
+        {
+            effectiveValues[index] = target;
+        }
+        else
+        {
+            effectiveValues[index] += effectiveValueSmoothing * (target - effectiveValues[index]);
+        }
+    }
+}
+
+bool One_MBCompAudioProcessor::isMorphControl(size_t index)
+{
+    using namespace PluginParameters;
+    
+    return index == static_cast<size_t>(Morph_Enabled) || index == static_cast<size_t>(Morph_Source)
+        || index == static_cast<size_t>(Morph_Target) || index == static_cast<size_t>(Morph_Amount)
+        || index == static_cast<size_t>(Global_Bypass);
+}
+
+void One_MBCompAudioProcessor::recallSnapshot(int slot)
+{
+    const auto* values = snapshots.getStoredValues(slot);
+    if( values == nullptr )
+        return;
+    
+    for( size_t index = 0; index < parametersByName.size(); ++index )
+    {
+        if( isMorphControl(index) )
+            continue;
+        
+        auto* parameter = parametersByName[index];
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(values[index]));
+    }
+}
+
+int One_MBCompAudioProcessor::getCrossoverLatencySamples(int mode) const
+{
+    // The Crossover_Mode choices are listed in the core's CrossoverMode order
+    return core.getLatencySamples(static_cast<MultibandCore::CrossoverMode>(mode));
+}
+
+MultibandCore::Settings One_MBCompAudioProcessor::makeCoreSettings() const
+{
+    using namespace PluginParameters;
+    
+    MultibandCore::Settings settings;
+    settings.crossoverMode = static_cast<MultibandCore::CrossoverMode>(static_cast<int>(getEffectiveValue(Crossover_Mode)));
+    settings.lowMidFrequency = getEffectiveValue(Low_Mid_XO_Frequency);
+    settings.midHighFrequency = getEffectiveValue(Mid_High_XO_Frequency);
+    
+    // The high band reaches Nyquist, so it always runs its detector on every sample
+    const auto controlRate = getEffectiveValue(Detector_Rate) >= 0.5f;
+    const std::array<float, 3> bandTopFrequencies { settings.lowMidFrequency, settings.midHighFrequency, 20000.f };
+    
+    for( size_t band = 0; band < settings.bands.size(); ++band )
+    {
+        auto& bandSettings = settings.bands[band];
+        bandSettings.attackMs = getEffectiveValue(Attack_LB, band);
+        bandSettings.releaseMs = getEffectiveValue(Release_LB, band);
+        bandSettings.thresholdDb = getEffectiveValue(Threshold_LB, band);
+        bandSettings.ratio = ratioValues[static_cast<int>(getEffectiveValue(Ratio_LB, band))];
+        // The Mode choices are listed in the core's DynamicsMode order
+        bandSettings.mode = static_cast<MultibandCore::DynamicsMode>(static_cast<int>(getEffectiveValue(Mode_LB, band)));
+        bandSettings.detectorDecimation = controlRate ? getDetectorDecimation(getSampleRate(), bandTopFrequencies[band]) : 1;
+        bandSettings.bypassed = getEffectiveValue(Bypass_LB, band) >= 0.5f;
+        bandSettings.muted = getEffectiveValue(Mute_LB, band) >= 0.5f;
+        bandSettings.soloed = getEffectiveValue(Solo_LB, band) >= 0.5f;
+    }
+    
+    return settings;
+}
+
+int One_MBCompAudioProcessor::getDetectorDecimation(double sampleRate, float topFrequency)
+{
+    const auto samplesPerStep = sampleRate / (8.0 * static_cast<double>(topFrequency));
+    
+    auto decimation = 1;
+    while( decimation * 2 <= MultibandCore::maximumDetectorDecimation && decimation * 2 <= samplesPerStep )
+    {
+        decimation *= 2;
+    }
+    
+    // Segments shorter than 4 samples cost more than they save
+    return decimation >= 4 ? decimation : 1;
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -228,7 +348,27 @@ bool One_MBCompAudioProcessor::isBusesLayoutSupported (const BusesLayout& layout
 }
 #endif
 
+bool One_MBCompAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
 void One_MBCompAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processBands(buffer, bypassBuffer, bypassDelay, inputGain, outputGain);
+}
+
+void One_MBCompAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processBands(buffer, doubleBypassBuffer, doubleBypassDelay, doubleInputGain, doubleOutputGain);
+}
+
+template<typename SampleType>
+void One_MBCompAudioProcessor::processBands(juce::AudioBuffer<SampleType>& buffer,
+                                            juce::AudioBuffer<SampleType>& bypassBuffer,
+                                            BypassDelay<SampleType>& bypassDelay,
+                                            juce::dsp::Gain<SampleType>& inGain,
+                                            juce::SmoothedValue<SampleType>& outGain)
 {
     // juce::ScopedNoDenormals disables denormalised numbers, which can be a source of
     // performance issues in audio processing.
@@ -242,113 +382,244 @@ void One_MBCompAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, j
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
     
-    // Loop through all compressors and update their parameter settings
-    for( auto& compressor : compressors )
+    leftChannelFifo.update(buffer);
+    rightChannelFifo.update(buffer);
+    
+    // Work through the host block in fixed sub-blocks, so parameters update every
+    // subBlockSize samples and the band buffers never need to grow, whatever the
+    // host sends (including blocks larger than announced in prepareToPlay)
+    auto block = juce::dsp::AudioBlock<SampleType>(buffer);
+    const auto numSamples = block.getNumSamples();
+    
+    auto peak = 0.f;
+    auto sumOfSquares = 0.f;
+    
+    for( size_t start = 0; start < numSamples; start += subBlockSize )
     {
-        compressor.updateCompressorParamSettings();
+        auto subBlock = block.getSubBlock(start, juce::jmin(subBlockSize, numSamples - start));
+        const auto levels = processSubBlock(subBlock, bypassBuffer, bypassDelay, inGain, outGain);
+        
+        peak = juce::jmax(peak, levels.peak);
+        sumOfSquares += levels.meanSquare * static_cast<float>(subBlock.getNumSamples());
     }
     
-    // Set the input and output gain values in decibels
-    inputGain.setGainDecibels( inputGainParameter->get() );
-    outputGain.setGainDecibels( outputGainParameter->get() );
+    outputPeak.store(peak, std::memory_order_relaxed);
+    outputRms.store(numSamples > 0 ? std::sqrt(sumOfSquares / static_cast<float>(numSamples)) : 0.f, std::memory_order_relaxed);
+}
+
+template<typename SampleType>
+MultibandCore::OutputLevels One_MBCompAudioProcessor::processSubBlock(juce::dsp::AudioBlock<SampleType>& block,
+                                                                      juce::AudioBuffer<SampleType>& bypassBuffer,
+                                                                      BypassDelay<SampleType>& bypassDelay,
+                                                                      juce::dsp::Gain<SampleType>& inGain,
+                                                                      juce::SmoothedValue<SampleType>& outGain)
+{
+    using namespace PluginParameters;
     
-    leftChannelFifo.update(buffer);
-    rightChannelFifo.update(buffer);
+    // Everything below reads the effective values rather than the parameters
+    updateEffectiveValues(false);
+    
+    // Switching engines: tell the host about the new latency; the core builds or
+    // frees the linear-phase engine and starts its history clean itself
+    const auto mode = static_cast<int>(getEffectiveValue(Crossover_Mode));
+    if( mode != activeCrossoverMode )
+    {
+        activeCrossoverMode = mode;
+        setLatencySamples(getCrossoverLatencySamples(mode));
+    }
+    
+    core.setSettings(makeCoreSettings());
+    
+    // Set the input and output gain values in decibels; the host bypass takes them to unity
+    const auto hostBypassed = getEffectiveValue(Global_Bypass) >= 0.5f;
+    inGain.setGainDecibels( hostBypassed ? 0.f : getEffectiveValue(Gain_Input) );
+    outGain.setTargetValue( juce::Decibels::decibelsToGain(static_cast<SampleType>(hostBypassed ? 0.f : getEffectiveValue(Gain_Output))) );
     
-    // Apply the gain to the buffer
-    applyGain(buffer, inputGain);
+    // Any input wakes the bands up straight away; silence only counts towards sleeping
+    const auto numSamples = block.getNumSamples();
+    if( getPeak(block) * inGain.getGainLinear() > silenceThreshold )
+    {
+        silentSamples = 0;
+        sleeping = false;
+    }
+    else
+    {
+        silentSamples = juce::jmin(silentSamples + static_cast<int>(numSamples), silenceHoldSamples);
+    }
     
-    // Assign the contents of buffer to all elements in the filterBuffers vector
-    for( auto& filter_buffer : filterBuffers )
+    if( sleeping )
     {
-        filter_buffer = buffer;
+        // Nothing to ramp from when the bands wake up
+        inGain.reset();
+        outGain.setCurrentAndTargetValue(outGain.getTargetValue());
+        block.clear();
+        return {};
     }
     
-    // Get the crossover frequencies for the filters
-    auto filter_lowMidCutoff = lowMidFreqXover->get();
-    auto filter_midHighCutoff = midHighFreqXover->get();
-    
-    // Set the cutoff frequencies for the filters
-    LP1.setCrossoverFrequency(filter_lowMidCutoff);
-    HP1.setCrossoverFrequency(filter_lowMidCutoff);
-    AP2.setCrossoverFrequency(filter_midHighCutoff);
-    LP2.setCrossoverFrequency(filter_midHighCutoff);
-    HP2.setCrossoverFrequency(filter_midHighCutoff);
-
-    // Create AudioBlocks from the filterBuffers
-    auto filter_bufferBlock0 = juce::dsp::AudioBlock<float>(filterBuffers[0]);
-    auto filter_bufferBlock1 = juce::dsp::AudioBlock<float>(filterBuffers[1]);
-    auto filter_bufferBlock2 = juce::dsp::AudioBlock<float>(filterBuffers[2]);
-    
-    // Create ProcessContexts from the AudioBlocks
-    auto filter_bufferContext0 = juce::dsp::ProcessContextReplacing<float>(filter_bufferBlock0);
-    auto filter_bufferContext1 = juce::dsp::ProcessContextReplacing<float>(filter_bufferBlock1);
-    auto filter_bufferContext2 = juce::dsp::ProcessContextReplacing<float>(filter_bufferBlock2);
-    
-    // Process the filters in a certain order (flow)
-    LP1.process(filter_bufferContext0);
-    AP2.process(filter_bufferContext0);
-    HP1.process(filter_bufferContext1);
-    filterBuffers[2] = filterBuffers[1];
-    LP2.process(filter_bufferContext1);
-    HP2.process(filter_bufferContext2);
-    
-    // Loop through all compressors and apply them to the corresponding filter buffer
-    for( size_t i = 0; i < filterBuffers.size(); ++i )
-    {
-        compressors[i].process(filterBuffers[i]);
+    // Apply the gain to the block
+    applyGain(block, inGain);
+    
+    std::array<SampleType, subBlockSize> outputGains;
+    for( size_t i = 0; i < numSamples; ++i )
+    {
+        outputGains[i] = outGain.getNextValue();
     }
-        
-    // Clear the buffer
-    buffer.clear();
     
-    // A function that adds a source buffer to the input buffer
-    auto addFilterBand = [numberChannels = buffer.getNumChannels(), numberSamples = buffer.getNumSamples()]( auto& inputBuffer, const auto& source )
+    MultibandCore::OutputLevels levels;
+    
+    const auto numChannels = juce::jmin(block.getNumChannels(), static_cast<size_t>(bypassBuffer.getNumChannels()));
+    const auto latency = getCrossoverLatencySamples(mode);
+    const auto bypassRequested = isBypassRequested();
+    
+    if( bypassRequested && bypassMix >= 1.f )
     {
-        for( auto i = 0; i < numberChannels; ++i )
+        // Fully bypassed: the bands don't run at all, only the latency-matching delay
+        if( ! bandsBypassed )
         {
-            inputBuffer.addFrom(i, 0, source, i, 0, numberSamples);
+            bandsBypassed = true;
+            core.reset();
         }
-    };
-    
-    // Check if any compressors are soloed
-    auto bandsAreSoloed = false;
-    for( auto& comp : compressors )
+        
+        auto channelsBlock = block.getSubsetChannelBlock(0, numChannels);
+        delayForBypass(channelsBlock, bypassDelay, latency);
+        levels = applyOutputGains(block, outputGains.data());
+    }
+    else
     {
-        if( comp.solo->get() )
+        // Coming back from bypass the bands start clean, and the crossfade waits
+        // for their first output to get through the crossover latency
+        if( bandsBypassed )
         {
-            bandsAreSoloed = true;
-            break;
+            bandsBypassed = false;
+            bypassPrimeSamples = latency;
+        }
+        
+        // The delay keeps running whenever there is latency, so it is already full
+        // when a crossfade starts
+        auto bypassBlock = juce::dsp::AudioBlock<SampleType>(bypassBuffer).getSubsetChannelBlock(0, numChannels).getSubBlock(0, numSamples);
+        const auto crossfading = bypassRequested || bypassMix > 0.f;
+        
+        if( crossfading || latency > 0 )
+        {
+            bypassBlock.copyFrom(block);
+            delayForBypass(bypassBlock, bypassDelay, latency);
+        }
+        
+        // Unless the bypass path has to be mixed in first, the output gain and
+        // metering happen in the core's band sum
+        if( crossfading )
+        {
+            processCore(block, static_cast<const SampleType*>(nullptr));
+            crossfadeBypass(block, bypassBlock, bypassRequested);
+            levels = applyOutputGains(block, outputGains.data());
+        }
+        else
+        {
+            levels = processCore(block, outputGains.data());
         }
     }
     
-    // If any compressors are soloed, add only those filter bands to the buffer
-    // Otherwise, add all unmuted filter bands to the buffer
-    if( bandsAreSoloed )
+    // Sleep once the tails have rung out and the compressors have fully released
+    if( silentSamples >= silenceHoldSamples && levels.peak <= silenceThreshold )
     {
-        for( size_t i = 0; i < compressors.size(); ++i )
+        auto released = true;
+        for( size_t band = 0; band < 3; ++band )
         {
-            auto& comp = compressors[i];
-            if( comp.solo->get() )
-            {
-                addFilterBand(buffer, filterBuffers[i]);
-            }
+            const auto restingGainReductionDb = core.getRestingGainReductionDb(static_cast<int>(band));
+            released = released && std::abs(getGainReductionDb(band) - restingGainReductionDb) <= releasedGainReductionDb;
+        }
+        
+        if( released )
+        {
+            sleeping = true;
+            core.reset();
         }
     }
-    else
+    
+    return levels;
+}
+
+template<typename SampleType>
+MultibandCore::OutputLevels One_MBCompAudioProcessor::processCore(juce::dsp::AudioBlock<SampleType>& block, const SampleType* outputGains)
+{
+    const auto numChannels = juce::jmin(block.getNumChannels(), maximumChannels);
+    
+    std::array<SampleType*, maximumChannels> channels {};
+    for( size_t channel = 0; channel < numChannels; ++channel )
+    {
+        channels[channel] = block.getChannelPointer(channel);
+    }
+    
+    return core.process(channels.data(), static_cast<int>(numChannels), static_cast<int>(block.getNumSamples()), outputGains);
+}
+
+template<typename SampleType>
+void One_MBCompAudioProcessor::delayForBypass(juce::dsp::AudioBlock<SampleType>& block, BypassDelay<SampleType>& bypassDelay, int latency)
+{
+    if( latency > 0 )
+    {
+        bypassDelay.setDelay(static_cast<SampleType>(latency));
+        auto context = juce::dsp::ProcessContextReplacing<SampleType>(block);
+        bypassDelay.process(context);
+    }
+}
+
+template<typename SampleType>
+void One_MBCompAudioProcessor::crossfadeBypass(juce::dsp::AudioBlock<SampleType>& block,
+                                               const juce::dsp::AudioBlock<SampleType>& bypassBlock,
+                                               bool bypassRequested)
+{
+    const auto numSamples = bypassBlock.getNumSamples();
+    
+    // While the bands prime, the bypass path keeps playing at full level
+    const auto holdSamples = bypassRequested ? 0 : juce::jmin(bypassPrimeSamples, static_cast<int>(numSamples));
+    const auto step = bypassRequested ? bypassMixStep : -bypassMixStep;
+    auto mix = bypassMix;
+    
+    for( size_t channel = 0; channel < bypassBlock.getNumChannels(); ++channel )
     {
-        for( size_t i = 0; i < compressors.size(); ++i )
+        auto* output = block.getChannelPointer(channel);
+        const auto* bypassed = bypassBlock.getChannelPointer(channel);
+        mix = bypassMix;
+        
+        for( size_t i = 0; i < numSamples; ++i )
         {
-            auto& comp = compressors[i];
-            if( ! comp.mute->get() )
+            if( static_cast<int>(i) >= holdSamples )
             {
-                addFilterBand(buffer, filterBuffers[i]);
+                mix = juce::jlimit(0.f, 1.f, mix + step);
             }
+            
+            output[i] += static_cast<SampleType>(mix) * (bypassed[i] - output[i]);
         }
     }
     
-    // Apply the output gain to the buffer
-    applyGain(buffer, outputGain);
+    bypassMix = mix;
+    bypassPrimeSamples -= holdSamples;
+}
+
+bool One_MBCompAudioProcessor::isBypassRequested() const
+{
+    using namespace PluginParameters;
+    
+    if( getEffectiveValue(Global_Bypass) >= 0.5f )
+        return true;
+    
+    // Every band passing straight through sums back to the (delayed) input,
+    // unless a mute or solo takes a band out of the sum
+    for( size_t band = 0; band < 3; ++band )
+    {
+        if( getEffectiveValue(Bypass_LB, band) < 0.5f
+         || getEffectiveValue(Mute_LB, band) >= 0.5f
+         || getEffectiveValue(Solo_LB, band) >= 0.5f )
+            return false;
+    }
+    
+    return true;
+}
+
+juce::AudioProcessorParameter* One_MBCompAudioProcessor::getBypassParameter() const
+{
+    return bypassParameter;
 }
 
 //==============================================================================
@@ -369,18 +640,169 @@ void One_MBCompAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
     // You should use this method to store your parameters in the memory block.
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
+    //
+    // Compact binary layout, little-endian:
+    //   uint32 stateMagic, uint16 stateVersion, uint16 count,
+    //   then count x { uint16 ParamNames index, float32 plain value },
+    //   then (version 2) uint16 mask of the stored snapshot slots, bit 0 = A,
+    //   and for each stored slot count x float32 plain value, in the entries' order
     juce::MemoryOutputStream memoryOutputStream(destData, true);
-    apvts.state.writeToStream(memoryOutputStream);
+    memoryOutputStream.writeInt(static_cast<int>(stateMagic));
+    memoryOutputStream.writeShort(static_cast<short>(stateVersion));
+    memoryOutputStream.writeShort(static_cast<short>(parametersByName.size()));
+    
+    for( size_t index = 0; index < parametersByName.size(); ++index )
+    {
+        auto* parameter = parametersByName[index];
+        memoryOutputStream.writeShort(static_cast<short>(index));
+        memoryOutputStream.writeFloat(parameter->convertFrom0to1(parameter->getValue()));
+    }
+    
+    int storedSlots = 0;
+    for( int slot = 0; slot < ParameterSnapshots::numSlots; ++slot )
+    {
+        if( hasSnapshot(slot) )
+            storedSlots |= 1 << slot;
+    }
+    memoryOutputStream.writeShort(static_cast<short>(storedSlots));
+    
+    for( int slot = 0; slot < ParameterSnapshots::numSlots; ++slot )
+    {
+        if( const auto* values = snapshots.getStoredValues(slot) )
+        {
+            for( size_t index = 0; index < parametersByName.size(); ++index )
+                memoryOutputStream.writeFloat(values[index]);
+        }
+    }
+}
+
+bool One_MBCompAudioProcessor::readBinaryState(const void* data, int sizeInBytes)
+{
+    if( sizeInBytes < static_cast<int>(stateHeaderSize) )
+        return false;
+    
+    const auto* bytes = static_cast<const char*>(data);
+    if( juce::ByteOrder::littleEndianInt(bytes) != stateMagic )
+        return false;
+    
+    const auto version = static_cast<int>(juce::ByteOrder::littleEndianShort(bytes + 4));
+    const auto count = static_cast<size_t>(juce::ByteOrder::littleEndianShort(bytes + 6));
+    
+    // A newer build may have laid out or keyed the data in ways this one can't know
+    // about, so its blobs aren't read as binary state at all
+    if( version > stateVersion )
+        return false;
+    
+    // Version 2 follows the entries with the snapshot slots. The whole blob is checked
+    // before anything is restored, so a short one changes nothing.
+    const auto size = static_cast<size_t>(sizeInBytes);
+    const auto entriesEnd = stateHeaderSize + count * stateEntrySize;
+    const auto hasSnapshots = version >= 2;
+    
+    int storedSlots = 0;
+    if( hasSnapshots && size >= entriesEnd + stateSlotMaskSize )
+        storedSlots = juce::ByteOrder::littleEndianShort(bytes + entriesEnd);
+    
+    const auto numStoredSlots = static_cast<size_t>(juce::countNumberOfBits(static_cast<juce::uint32>(storedSlots)));
+    const auto snapshotsSize = hasSnapshots ? stateSlotMaskSize + numStoredSlots * count * sizeof(float) : 0;
+    
+    if( version < 1 || size < entriesEnd + snapshotsSize )
+    {
+        jassertfalse;
+        return false;
+    }
+    
+    auto entryIndex = [bytes](size_t entry)
+    {
+        return static_cast<size_t>(juce::ByteOrder::littleEndianShort(bytes + stateHeaderSize + entry * stateEntrySize));
+    };
+    
+    auto readFloat = [](const char* floatBytes)
+    {
+        auto bits = juce::ByteOrder::littleEndianInt(floatBytes);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    };
+    
+    // Parameters the blob doesn't mention (added after it was written) go back to their
+    // defaults rather than keeping whatever this instance had before. Unknown indices
+    // from newer versions are skipped.
+    std::vector<bool> restored(parametersByName.size(), false);
+    
+    for( size_t entry = 0; entry < count; ++entry )
+    {
+        const auto index = entryIndex(entry);
+        if( index >= parametersByName.size() )
+            continue;
+        
+        auto* parameter = parametersByName[index];
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(readFloat(bytes + stateHeaderSize + entry * stateEntrySize + 2)));
+        restored[index] = true;
+    }
+    
+    for( size_t index = 0; index < parametersByName.size(); ++index )
+    {
+        if( ! restored[index] )
+        {
+            auto* parameter = parametersByName[index];
+            parameter->setValueNotifyingHost(parameter->getDefaultValue());
+        }
+    }
+    
+    // Slots the blob doesn't hold are emptied, as they are in a new instance. In a
+    // stored slot, parameters the blob doesn't mention take their defaults.
+    std::vector<float> slotValues(parametersByName.size());
+    const auto* slotBytes = bytes + entriesEnd + (hasSnapshots ? stateSlotMaskSize : 0);
+    
+    for( int slot = 0; slot < ParameterSnapshots::numSlots; ++slot )
+    {
+        if( (storedSlots & (1 << slot)) == 0 )
+        {
+            snapshots.set(slot, nullptr);
+            continue;
+        }
+        
+        for( size_t index = 0; index < parametersByName.size(); ++index )
+        {
+            auto* parameter = parametersByName[index];
+            slotValues[index] = parameter->convertFrom0to1(parameter->getDefaultValue());
+        }
+        
+        for( size_t entry = 0; entry < count; ++entry )
+        {
+            const auto index = entryIndex(entry);
+            if( index < parametersByName.size() )
+                slotValues[index] = readFloat(slotBytes + entry * sizeof(float));
+        }
+        
+        snapshots.set(slot, slotValues.data());
+        slotBytes += count * sizeof(float);
+    }
+    
+    return true;
 }
 
 void One_MBCompAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
+    //
+    // Binary blobs go straight into the parameters; anything else is a ValueTree
+    // blob from before the binary format and takes the original path. A binary blob
+    // this build can't read doesn't parse as the parameters' tree either, so it
+    // leaves them as they are.
+    if( readBinaryState(data, sizeInBytes) )
+        return;
+    
     auto savedTree = juce::ValueTree::readFromData(data, sizeInBytes);
-    if( savedTree.isValid() )
+    if( savedTree.hasType(apvts.state.getType()) )
     {
         apvts.replaceState(savedTree);
+        
+        // Sessions saved as a ValueTree predate the snapshots
+        for( int slot = 0; slot < ParameterSnapshots::numSlots; ++slot )
+            snapshots.set(slot, nullptr);
     }
 }
 
@@ -392,137 +814,34 @@ juce::AudioProcessorValueTreeState::ParameterLayout One_MBCompAudioProcessor::cr
     // Import namespaces for JUCE and the parameters used in this plugin.
     using namespace juce;
     using namespace PluginParameters;
-    const auto& parameters = GetParameters(); // Get the parameters defined for the plugin.
-    
-    // ===== Gain parameters
-    // Define the range for the Gain parameters, -24 to 24 with steps of 0.5.
-    auto gainRangeValues = NormalisableRange<float>(-24.f, 24.f, 0.5f, 1.f);
-    
-    // Add Gain Input and Output parameters to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Gain_Input),
-                                                              parameters.at(ParamNames::Gain_Input),
-                                                              gainRangeValues,
-                                                              0));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Gain_Output),
-                                                              parameters.at(ParamNames::Gain_Output),
-                                                              gainRangeValues,
-                                                              0));
-    
-    // ===== Threshold parameters
-    // Add threshold parameters to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Threshold_LB),
-                                                              parameters.at(ParamNames::Threshold_LB),
-                                                              NormalisableRange<float>(-60, 12, 1, 1),
-                                                              0));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Threshold_MB),
-                                                              parameters.at(ParamNames::Threshold_MB),
-                                                              NormalisableRange<float>(-60, 12, 1, 1),
-                                                              0));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Threshold_HB),
-                                                              parameters.at(ParamNames::Threshold_HB),
-                                                              NormalisableRange<float>(-60, 12, 1, 1),
-                                                              0));
-   
-    // Define the range for the Attack and Release parameters, 5 to 500 with steps of 1.
-    auto attkRelRange = NormalisableRange<float>(5, 500, 1, 1);
-    
-    // ===== Attack parameters
-    // Add attack parameters to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Attack_LB),
-                                                              parameters.at(ParamNames::Attack_LB),
-                                                              attkRelRange,
-                                                              50));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Attack_MB),
-                                                              parameters.at(ParamNames::Attack_MB),
-                                                              attkRelRange,
-                                                              50));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Attack_HB),
-                                                              parameters.at(ParamNames::Attack_HB),
-                                                              attkRelRange,
-                                                              50));
-    // ===== Release parameters
-    // Add release parameters to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Release_LB),
-                                                              parameters.at(ParamNames::Release_LB),
-                                                              attkRelRange,
-                                                              250));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Release_MB),
-                                                              parameters.at(ParamNames::Release_MB),
-                                                              attkRelRange,
-                                                              250));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Release_HB),
-                                                              parameters.at(ParamNames::Release_HB),
-                                                              attkRelRange,
-                                                              250));
-    
-    // Define the choices for the Ratio parameter as a vector of doubles.
-    auto ratioChoices = std::vector<double>{ 1, 1.5, 2, 2.5, 3, 3.5, 4, 4.5, 5, 8, 10, 15, 20, 50 };
-    
-    // Convert the ratio choices to a StringArray so they can be used with an AudioParameterChoice.
-    juce::StringArray strArr;
-    for( auto rChoice : ratioChoices )
-    {
-        strArr.add( juce::String(rChoice, 1) );
-    }
     
-    // ===== Ratio parameters
-    // Add ratio parameters to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterChoice>(parameters.at(ParamNames::Ratio_LB),
-                                                               parameters.at(ParamNames::Ratio_LB), strArr, 3));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterChoice>(parameters.at(ParamNames::Ratio_MB),
-                                                               parameters.at(ParamNames::Ratio_MB), strArr, 3));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterChoice>(parameters.at(ParamNames::Ratio_HB),
-                                                               parameters.at(ParamNames::Ratio_HB), strArr, 3));
-    // ===== Bypass parameters
-    // Add bypass parameters to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Bypass_LB),
-                                                             parameters.at(ParamNames::Bypass_LB), false));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Bypass_MB),
-                                                             parameters.at(ParamNames::Bypass_MB), false));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Bypass_HB),
-                                                             parameters.at(ParamNames::Bypass_HB), false));
-    
-    // ===== Mute parameters
-    // Add mute parameters to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Mute_LB),
-                                                             parameters.at(ParamNames::Mute_LB), false));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Mute_MB),
-                                                             parameters.at(ParamNames::Mute_MB), false));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Mute_HB),
-                                                             parameters.at(ParamNames::Mute_HB), false));
-    
-    // ===== Solo parameters
-    // Add solo parameters to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Solo_LB),
-                                                             parameters.at(ParamNames::Solo_LB), false));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Solo_MB),
-                                                             parameters.at(ParamNames::Solo_MB), false));
-    
-    PluginGUIlayout.add(std::make_unique<AudioParameterBool>(parameters.at(ParamNames::Solo_HB),
-                                                             parameters.at(ParamNames::Solo_HB), false));
-    
-    // Add Frequency parameters for Low-Mid Crossover and Mid-High Crossover to the layout.
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Low_Mid_XO_Frequency),
-                                                             parameters.at(ParamNames::Low_Mid_XO_Frequency),
-                                                              NormalisableRange<float>(20, 999, 1, 1), 400));
+    // One parameter per descriptor, in table order (see parameterDescriptors)
+    for( const auto& descriptor : parameterDescriptors )
+    {
+        switch( descriptor.type )
+        {
+            case ParamType::Float:
+                PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(descriptor.id,
+                                                                          descriptor.id,
+                                                                          NormalisableRange<float>(descriptor.minimum, descriptor.maximum, descriptor.interval, 1.f),
+                                                                          descriptor.defaultValue));
+                break;
+                
+            case ParamType::Choice:
+                PluginGUIlayout.add(std::make_unique<AudioParameterChoice>(descriptor.id,
+                                                                           descriptor.id,
+                                                                           StringArray(descriptor.choices, descriptor.numChoices),
+                                                                           static_cast<int>(descriptor.defaultValue)));
+                break;
+                
+            case ParamType::Bool:
+                PluginGUIlayout.add(std::make_unique<AudioParameterBool>(descriptor.id,
+                                                                         descriptor.id,
+                                                                         descriptor.defaultValue >= 0.5f));
+                break;
+        }
+    }
     
-    PluginGUIlayout.add(std::make_unique<AudioParameterFloat>(parameters.at(ParamNames::Mid_High_XO_Frequency),
-                                                             parameters.at(ParamNames::Mid_High_XO_Frequency),
-                                                              NormalisableRange<float>(1000, 20000, 1, 1), 2000));
     // Return the completed layout.
     return PluginGUIlayout;
 }
@@ -13,8 +13,8 @@
 
 #include <array>
 #include <JuceHeader.h>
-#include "BasicCompressor.h"
-#include "butterworthFilter.h"
+#include "multibandCore.h"
+#include "parameterSnapshots.h"
 
 /*
   ==============================================================================
@@ -104,7 +104,8 @@ struct SingleChannelSampleFifo
         prepared.set(false);
     }
     
-    void update(const BlockType& buffer)
+    template<typename BufferType>
+    void update(const BufferType& buffer)
     {
         jassert(prepared.get());
         jassert(buffer.getNumChannels() > channelToUse );
@@ -112,7 +113,7 @@ struct SingleChannelSampleFifo
         
         for( int i = 0; i < buffer.getNumSamples(); ++i )
         {
-            pushNextSampleIntoFifo(channelPtr[i]);
+            pushNextSampleIntoFifo(static_cast<float>(channelPtr[i]));
         }
     }
 
@@ -206,88 +207,167 @@ enum ParamNames
     
     Gain_Input,
     Gain_Output,
+    
+    Crossover_Mode,
+    
+    Morph_Enabled,
+    Morph_Source,
+    Morph_Target,
+    Morph_Amount,
+    
+    Global_Bypass,
+    
+    Mode_LB,
+    Mode_MB,
+    Mode_HB,
+    
+    Detector_Rate,
+    
+    // New parameters go above this line; the indices are stored in saved states
+    NumParameters
 };
 
-inline const std::map<ParamNames, juce::String>& GetParameters()
+enum class ParamType
 {
-    static std::map<ParamNames, juce::String> parameters =
-    {
-        { Low_Mid_XO_Frequency, "Low-Mid Crossover Frequency" },
-        { Mid_High_XO_Frequency, "Mid-High Crossover Frequency" },
-        
-        { Threshold_LB, "Low-Band Threshold" },
-        { Threshold_MB, "Mid-Band Threshold" },
-        { Threshold_HB, "High-Band Threshold" },
-        
-        { Attack_LB, "Low-Band Attack" },
-        { Attack_MB, "Mid-Band Attack" },
-        { Attack_HB, "High-Band Attack" },
-        
-        { Release_LB, "Low-Band Release" },
-        { Release_MB, "Mid-Band Release" },
-        { Release_HB, "High-Band Release" },
-        
-        { Ratio_LB, "Low-Band Ratio" },
-        { Ratio_MB, "Mid-Band Ratio" },
-        { Ratio_HB, "High-Band Ratio" },
-        
-        { Bypass_LB, "Low-Band Bypass" },
-        { Bypass_MB, "Mid-Band Bypass" },
-        { Bypass_HB, "High-Band Bypass" },
-        
-        { Mute_LB, "Low-Band Mute" },
-        { Mute_MB, "Mid-Band Mute" },
-        { Mute_HB, "High-Band Mute" },
-        
-        { Solo_LB, "Low-Band Solo" },
-        { Solo_MB, "Mid-Band Solo" },
-        { Solo_HB, "High-Band Solo" },
-        
-        { Gain_Input, "Gain Input" },
-        { Gain_Output, "Gain Output" },
-    };
-    
-    return parameters;
+    Float,
+    Choice,
+    Bool
+};
+
+// Everything needed to create one parameter. The ID doubles as the display name.
+struct ParamDescriptor
+{
+    ParamNames name;
+    const char* id;
+    ParamType type;
+    float minimum, maximum, interval;   // Float only
+    float defaultValue;                 // plain value, choice index, or 0/1
+    const char* const* choices;         // Choice only
+    int numChoices;
+};
+
+constexpr ParamDescriptor floatParam(ParamNames name, const char* id, float minimum, float maximum, float interval, float defaultValue)
+{
+    return { name, id, ParamType::Float, minimum, maximum, interval, defaultValue, nullptr, 0 };
 }
+
+template<size_t numChoices>
+constexpr ParamDescriptor choiceParam(ParamNames name, const char* id, const char* const (&choices)[numChoices], int defaultIndex)
+{
+    return { name, id, ParamType::Choice, 0.f, float(numChoices - 1), 1.f, float(defaultIndex), choices, int(numChoices) };
 }
 
-struct CompressorBand
+constexpr ParamDescriptor boolParam(ParamNames name, const char* id, bool defaultValue)
 {
-private:
-    BasicCompressor compressor;
+    return { name, id, ParamType::Bool, 0.f, 1.f, 1.f, defaultValue ? 1.f : 0.f, nullptr, 0 };
+}
+
+inline constexpr const char* ratioChoices[] = { "1.0", "1.5", "2.0", "2.5", "3.0", "3.5", "4.0", "4.5", "5.0", "8.0", "10.0", "15.0", "20.0", "50.0" };
+inline constexpr float ratioValues[] = { 1.f, 1.5f, 2.f, 2.5f, 3.f, 3.5f, 4.f, 4.5f, 5.f, 8.f, 10.f, 15.f, 20.f, 50.f };
+static_assert( std::size(ratioChoices) == std::size(ratioValues), "every ratio choice needs its value" );
+inline constexpr const char* crossoverModeChoices[] = { "Biquad", "TPT", "Linear Phase" };
+inline constexpr const char* dynamicsModeChoices[] = { "Compress", "Upward Compress", "Expand", "Gate" };
+inline constexpr const char* detectorRateChoices[] = { "Every Sample", "Control Rate" };
+inline constexpr const char* snapshotChoices[] = { "A", "B", "C", "D" };
+
+// Every parameter, in the order the host sees them. createParameterLayout() builds
+// the parameters from this table, and the processor finds them again by position.
+inline constexpr std::array<ParamDescriptor, NumParameters> parameterDescriptors
+{{
+    floatParam(Gain_Input,              "Gain Input",                   -24.f, 24.f, 0.5f, 0.f),
+    floatParam(Gain_Output,             "Gain Output",                  -24.f, 24.f, 0.5f, 0.f),
     
-public:
-    juce::AudioParameterFloat* attackTime = nullptr;
-    juce::AudioParameterFloat* releaseTime = nullptr;
-    juce::AudioParameterFloat* thresholdLevel = nullptr;
-    juce::AudioParameterChoice* ratio = nullptr;
-    juce::AudioParameterBool* bypassed = nullptr;
-    juce::AudioParameterBool* mute = nullptr;
-    juce::AudioParameterBool* solo = nullptr;
-    
-    void prepareComp( const juce::dsp::ProcessSpec& spec )
-    {
-        compressor.prepare(spec);
-    }
+    floatParam(Threshold_LB,            "Low-Band Threshold",           -60.f, 12.f, 1.f, 0.f),
+    floatParam(Threshold_MB,            "Mid-Band Threshold",           -60.f, 12.f, 1.f, 0.f),
+    floatParam(Threshold_HB,            "High-Band Threshold",          -60.f, 12.f, 1.f, 0.f),
     
-    void updateCompressorParamSettings()
-    {
-        compressor.setAttackTime( attackTime->get() );
-        compressor.setReleaseTime( releaseTime->get() );
-        compressor.setThresholdLevel( thresholdLevel->get() );
-        compressor.setCompressionRatio( ratio->getCurrentChoiceName().getFloatValue() );
-    }
+    floatParam(Attack_LB,               "Low-Band Attack",              5.f, 500.f, 1.f, 50.f),
+    floatParam(Attack_MB,               "Mid-Band Attack",              5.f, 500.f, 1.f, 50.f),
+    floatParam(Attack_HB,               "High-Band Attack",             5.f, 500.f, 1.f, 50.f),
+    
+    floatParam(Release_LB,              "Low-Band Release",             5.f, 500.f, 1.f, 250.f),
+    floatParam(Release_MB,              "Mid-Band Release",             5.f, 500.f, 1.f, 250.f),
+    floatParam(Release_HB,              "High-Band Release",            5.f, 500.f, 1.f, 250.f),
+    
+    choiceParam(Ratio_LB,               "Low-Band Ratio",               ratioChoices, 3),
+    choiceParam(Ratio_MB,               "Mid-Band Ratio",               ratioChoices, 3),
+    choiceParam(Ratio_HB,               "High-Band Ratio",              ratioChoices, 3),
+    
+    boolParam(Bypass_LB,                "Low-Band Bypass",              false),
+    boolParam(Bypass_MB,                "Mid-Band Bypass",              false),
+    boolParam(Bypass_HB,                "High-Band Bypass",             false),
+    
+    boolParam(Mute_LB,                  "Low-Band Mute",                false),
+    boolParam(Mute_MB,                  "Mid-Band Mute",                false),
+    boolParam(Mute_HB,                  "High-Band Mute",               false),
+    
+    boolParam(Solo_LB,                  "Low-Band Solo",                false),
+    boolParam(Solo_MB,                  "Mid-Band Solo",                false),
+    boolParam(Solo_HB,                  "High-Band Solo",               false),
+    
+    floatParam(Low_Mid_XO_Frequency,    "Low-Mid Crossover Frequency",  20.f, 999.f, 1.f, 400.f),
+    floatParam(Mid_High_XO_Frequency,   "Mid-High Crossover Frequency", 1000.f, 20000.f, 1.f, 2000.f),
+    
+    choiceParam(Crossover_Mode,         "Crossover Mode",               crossoverModeChoices, 0),
     
-    void process(juce::AudioBuffer<float>& buffer)
+    boolParam(Morph_Enabled,            "Morph Enabled",                false),
+    choiceParam(Morph_Source,           "Morph Source",                 snapshotChoices, 0),
+    choiceParam(Morph_Target,           "Morph Target",                 snapshotChoices, 1),
+    floatParam(Morph_Amount,            "Morph Amount",                 0.f, 1.f, 0.001f, 0.f),
+    
+    boolParam(Global_Bypass,            "Bypass",                       false),
+    
+    choiceParam(Mode_LB,                "Low-Band Mode",                dynamicsModeChoices, 0),
+    choiceParam(Mode_MB,                "Mid-Band Mode",                dynamicsModeChoices, 0),
+    choiceParam(Mode_HB,                "High-Band Mode",               dynamicsModeChoices, 0),
+    
+    choiceParam(Detector_Rate,          "Detector Rate",                detectorRateChoices, 0),
+}};
+
+constexpr bool describesEveryParameterOnce()
+{
+    for( int name = 0; name < NumParameters; ++name )
     {
-        auto sampleBlock = juce::dsp::AudioBlock<float>(buffer);
-        auto context = juce::dsp::ProcessContextReplacing<float>(sampleBlock);
+        int count = 0;
+        for( const auto& descriptor : parameterDescriptors )
+        {
+            count += descriptor.name == name ? 1 : 0;
+        }
         
-        context.isBypassed = bypassed->get();
-            
-        compressor.process(context);
+        if( count != 1 )
+            return false;
     }
-};
+    return true;
+}
+
+static_assert( describesEveryParameterOnce(), "parameterDescriptors must list every ParamNames entry exactly once" );
+
+// Typed access into a table of parameters indexed by ParamNames. offset selects the
+// band for the _LB/_MB/_HB groups, which are consecutive.
+template<typename ParameterType>
+ParameterType* getTypedParameter(const std::vector<juce::RangedAudioParameter*>& parameters, ParamNames name, size_t offset = 0)
+{
+    auto* parameter = parameters[static_cast<size_t>(name) + offset];
+    jassert( dynamic_cast<ParameterType*>(parameter) != nullptr );
+    return static_cast<ParameterType*>(parameter);
+}
+
+// Parameter IDs by name, built from the descriptor table
+inline const std::map<ParamNames, juce::String>& GetParameters()
+{
+    static const std::map<ParamNames, juce::String> parameters = []
+    {
+        std::map<ParamNames, juce::String> names;
+        for( const auto& descriptor : parameterDescriptors )
+        {
+            names.emplace(descriptor.name, descriptor.id);
+        }
+        return names;
+    }();
+    
+    return parameters;
+}
+}
 
 //==============================================================================
 /**
@@ -308,6 +388,8 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -320,6 +402,9 @@ public:
     bool producesMidi() const override;
     bool isMidiEffect() const override;
     double getTailLengthSeconds() const override;
+    
+    // Lets the host bypass through the plugin's own click-free, latency-matched path
+    juce::AudioProcessorParameter* getBypassParameter() const override;
 
     //==============================================================================
     int getNumPrograms() override;
@@ -341,34 +426,196 @@ public:
     using BlockType = juce::AudioBuffer<float>;
     SingleChannelSampleFifo<BlockType> leftChannelFifo{Channel::Left};
     SingleChannelSampleFifo<BlockType> rightChannelFifo{Channel::Right};
+    
+    // Gain reduction of a band (0 = low, 1 = mid, 2 = high) at the end of the last block
+    float getGainReductionDb(size_t band) const { return core.getGainReductionDb(static_cast<int>(band)); }
+    
+    // Linear peak and RMS of the output over the last block, for meters
+    float getOutputPeak() const { return outputPeak.load(std::memory_order_relaxed); }
+    float getOutputRms() const { return outputRms.load(std::memory_order_relaxed); }
+    
+    // Captures the current settings into snapshot slot 0-3 (A-D), the endpoints of
+    // the Morph Source/Target parameters. Message thread only.
+    void storeSnapshot(int slot) { snapshots.store(slot); }
+    
+    // Sets the parameters to a stored snapshot, all but the morph controls and the
+    // host bypass; an empty slot leaves them alone. Message thread only.
+    void recallSnapshot(int slot);
+    
+    bool hasSnapshot(int slot) const { return snapshots.getStoredValues(slot) != nullptr; }
 
 private:
-    std::array<CompressorBand, 3> compressors;
-    CompressorBand& low_BandCompressor = compressors[0];
-    CompressorBand& mid_BandCompressor = compressors[1];
-    CompressorBand& high_BandCompressor = compressors[2];
-    
-//    LinkwitzRiley LPF, HPF;
-    using Filters = LinkwitzRFilter;
-    //      FC0     FC1
-    Filters LP1,    AP2,
-            HP1,    LP2,
-                    HP2;
+    // The crossovers, compressors and band sum. Parameters, snapshots, gains, bypass
+    // and silence handling are plugin concerns and stay in the processor.
+    MultibandCore core;
     
     juce::AudioParameterFloat* lowMidFreqXover { nullptr };
     juce::AudioParameterFloat* midHighFreqXover { nullptr };
     
-    std::array<juce::AudioBuffer<float>, 3> filterBuffers;
+    juce::AudioParameterChoice* crossoverMode { nullptr };
+    int activeCrossoverMode { 0 };
+    
+    // Reported latency for a Crossover_Mode choice; only the linear-phase engine adds any
+    int getCrossoverLatencySamples(int mode) const;
+    
+    // The core's settings, from the current effective values
+    MultibandCore::Settings makeCoreSettings() const;
+    
+    // Control-rate decimation for a band whose content stops at topFrequency: the
+    // largest power of two that still gives the detector 8 steps per cycle there,
+    // or 1 where that is too few samples to be worth it
+    static int getDetectorDecimation(double sampleRate, float topFrequency);
+    
+    // Binary state format, see getStateInformation. Parameters are keyed by their
+    // PluginParameters::ParamNames index, so new parameters must be appended there.
+    static constexpr juce::uint32 stateMagic = 0x43424d4f; // "OMBC"
+    static constexpr int stateVersion = 2;
+    static constexpr size_t stateHeaderSize = 8;
+    static constexpr size_t stateEntrySize = 6;
+    static constexpr size_t stateSlotMaskSize = 2;
+    
+    // Every parameter, indexed by PluginParameters::ParamNames
+    std::vector<juce::RangedAudioParameter*> parametersByName;
+    
+    // Returns false if the data isn't in the binary format
+    bool readBinaryState(const void* data, int sizeInBytes);
+    
+    // The values the DSP runs with, by ParamNames index, refreshed once per sub-block.
+    // With the morph enabled they come from the source and target snapshots instead
+    // of the parameters. Continuous values glide with one shared one-pole, so snapshot
+    // switches and morph moves don't click.
+    ParameterSnapshots snapshots;
+    std::vector<float> effectiveValues;
+    std::vector<bool> continuousParameters;
+    float effectiveValueSmoothing { 1.f };
+    static constexpr double effectiveValueSmoothingSeconds = 0.02;
+    
+    void updateEffectiveValues(bool jumpToTargets);
+    
+    // The morph controls themselves and the host bypass, which snapshots never drive
+    static bool isMorphControl(size_t index);
+    
+    float getEffectiveValue(PluginParameters::ParamNames name, size_t band = 0) const
+    {
+        return effectiveValues[static_cast<size_t>(name) + band];
+    }
+    
+    // Internal processing block size. Parameters are read once per sub-block and the
+    // core is prepared for exactly one sub-block, independent of the host's block size.
+    static constexpr size_t subBlockSize = 64;
+    
+    // Mono or stereo, see isBusesLayoutSupported
+    static constexpr size_t maximumChannels = 2;
+    
+    // Bypass fast path. With the host bypass on, or every band bypassed and nothing
+    // muted or soloed, the crossover and compressors are replaced by a delay matching
+    // the crossover latency. bypassMix crossfades from the band sum (0) to the delayed
+    // input (1); on the way back it holds at 1 for bypassPrimeSamples, until the
+    // restarted bands have output through the crossover latency.
+    template<typename SampleType>
+    using BypassDelay = juce::dsp::DelayLine<SampleType, juce::dsp::DelayLineInterpolationTypes::None>;
+    
+    juce::AudioParameterBool* bypassParameter { nullptr };
+    juce::AudioBuffer<float> bypassBuffer;
+    juce::AudioBuffer<double> doubleBypassBuffer;
+    BypassDelay<float> bypassDelay;
+    BypassDelay<double> doubleBypassDelay;
+    
+    float bypassMix { 0.f };
+    float bypassMixStep { 1.f };
+    int bypassPrimeSamples { 0 };
+    bool bandsBypassed { false };
+    static constexpr double bypassCrossfadeSeconds = 0.01;
     
-    juce::dsp::Gain<float> inputGain, outputGain;
+    bool isBypassRequested() const;
+    
+    template<typename SampleType>
+    void delayForBypass(juce::dsp::AudioBlock<SampleType>& block, BypassDelay<SampleType>& bypassDelay, int latency);
+    
+    // Blends block towards bypassBlock (or back), advancing bypassMix
+    template<typename SampleType>
+    void crossfadeBypass(juce::dsp::AudioBlock<SampleType>& block,
+                         const juce::dsp::AudioBlock<SampleType>& bypassBlock,
+                         bool bypassRequested);
+    
+    // The output gain is a bare ramp: its per-sample values are handed to the core,
+    // which applies them while summing the bands
+    juce::dsp::Gain<float> inputGain;
+    juce::dsp::Gain<double> doubleInputGain;
+    juce::SmoothedValue<float> outputGain;
+    juce::SmoothedValue<double> doubleOutputGain;
     juce::AudioParameterFloat* inputGainParameter { nullptr };
     juce::AudioParameterFloat* outputGainParameter { nullptr };
     
-    template<typename T, typename U>
-    void applyGain(T& buffer, U& gain)
+    std::atomic<float> outputPeak { 0.f }, outputRms { 0.f };
+    
+    // Shared body of both processBlock overloads
+    template<typename SampleType>
+    void processBands(juce::AudioBuffer<SampleType>& buffer,
+                      juce::AudioBuffer<SampleType>& bypassBuffer,
+                      BypassDelay<SampleType>& bypassDelay,
+                      juce::dsp::Gain<SampleType>& inGain,
+                      juce::SmoothedValue<SampleType>& outGain);
+    
+    // Gains, bands or bypass, and silence handling for one sub-block of at most
+    // subBlockSize samples; returns the levels of its output
+    template<typename SampleType>
+    MultibandCore::OutputLevels processSubBlock(juce::dsp::AudioBlock<SampleType>& block,
+                                                juce::AudioBuffer<SampleType>& bypassBuffer,
+                                                BypassDelay<SampleType>& bypassDelay,
+                                                juce::dsp::Gain<SampleType>& inGain,
+                                                juce::SmoothedValue<SampleType>& outGain);
+    
+    // Splits, compresses and sums the block's channels in the core, applying
+    // outputGains (one per sample, or none) as the bands are summed
+    template<typename SampleType>
+    MultibandCore::OutputLevels processCore(juce::dsp::AudioBlock<SampleType>& block, const SampleType* outputGains);
+    
+    // Silence detection. A sub-block whose input peak stays at or below silenceThreshold
+    // counts as silent; once the input has been silent for silenceHoldSamples, the output
+    // has fallen to the same level and every envelope has settled to within
+    // releasedGainReductionDb of its resting level, all band state is cleared and sub-blocks are zeroed without running the DSP until
+    // the input comes back.
+    static constexpr float silenceThreshold = 1.0e-6f; // -120 dB
+    static constexpr float releasedGainReductionDb = 0.01f;
+    
+    bool sleeping { false };
+    int silentSamples { 0 };
+    int silenceHoldSamples { 0 };
+    
+    template<typename SampleType>
+    static SampleType getPeak(const juce::dsp::AudioBlock<SampleType>& block)
+    {
+        const auto range = block.findMinAndMax();
+        return juce::jmax(-range.getStart(), range.getEnd());
+    }
+    
+    // The output gain and metering for blocks that don't come straight from the core
+    template<typename SampleType>
+    static MultibandCore::OutputLevels applyOutputGains(juce::dsp::AudioBlock<SampleType>& block, const SampleType* gains)
+    {
+        SampleType peak = 0, sumOfSquares = 0;
+        
+        for( size_t channel = 0; channel < block.getNumChannels(); ++channel )
+        {
+            auto* samples = block.getChannelPointer(channel);
+            
+            for( size_t i = 0; i < block.getNumSamples(); ++i )
+            {
+                samples[i] *= gains[i];
+                peak = juce::jmax(peak, std::abs(samples[i]));
+                sumOfSquares += samples[i] * samples[i];
+            }
+        }
+        
+        const auto numValues = juce::jmax(static_cast<size_t>(1), block.getNumChannels() * block.getNumSamples());
+        return { static_cast<float>(peak), static_cast<float>(sumOfSquares / static_cast<SampleType>(numValues)) };
+    }
+    
+    template<typename SampleType, typename U>
+    void applyGain(juce::dsp::AudioBlock<SampleType>& block, U& gain)
     {
-        auto block = juce::dsp::AudioBlock<float>(buffer);
-        auto context = juce::dsp::ProcessContextReplacing<float>(block);
+        auto context = juce::dsp::ProcessContextReplacing<SampleType>(block);
         gain.process(context);
     }
     
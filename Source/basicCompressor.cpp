@@ -9,6 +9,7 @@
 
 #include <JuceHeader.h>
 #include "BasicCompressor.h"
+#include "fastMath.h"
 
 // This method prepares the compressor with provided specifications
 void BasicCompressor::prepare( const juce::dsp::ProcessSpec& compressorSpec )
@@ -21,6 +22,15 @@ void BasicCompressor::prepare( const juce::dsp::ProcessSpec& compressorSpec )
     
     // Compute the alpha value for release phase using provided specifications
     m_alphaRelease = std::exp(-1.0f / (m_releaseTimeInMs * m_compressorSpecifications.sampleRate / 1000.0f));
+    
+    updateControlRateCoefficients();
+}
+
+// This method settles the envelope at its level for silence, as if nothing had been heard yet
+void BasicCompressor::reset()
+{
+    m_previousEnvelopeLevel = getRestingGainReductionDb();
+    m_gainReductionDb.store(m_previousEnvelopeLevel, std::memory_order_relaxed);
 }
 
 // This method sets the threshold level of the compressor
@@ -42,6 +52,7 @@ void BasicCompressor::setAttackTime(float newAttackTimeInMs)
 
     // Compute the new alpha value for attack phase after attack time is updated
     m_alphaAttack = std::exp(-1.0f / (m_attackTimeInMs * m_compressorSpecifications.sampleRate / 1000.0f));
+    updateControlRateCoefficients();
 }
 
 // This method sets the release time of the compressor
@@ -51,6 +62,7 @@ void BasicCompressor::setReleaseTime(float newReleaseTimeInMs)
 
     // Compute the new alpha value for release phase after release time is updated
     m_alphaRelease = std::exp(-1.0f / (m_releaseTimeInMs * m_compressorSpecifications.sampleRate / 1000.0f));
+    updateControlRateCoefficients();
 }
 
 // This method sets the make-up gain of the compressor
@@ -59,8 +71,93 @@ void BasicCompressor::setMakeUpGain(float newMakeUpGain)
     m_newMakeUpGainDb = newMakeUpGain;
 }
 
-// Main compressor processing method
-void BasicCompressor::process(juce::dsp::ProcessContextReplacing<float>& context)
+// This method sets how many samples share one detector and envelope step
+void BasicCompressor::setDetectorDecimation(int newDecimation)
+{
+    m_detectorDecimation = juce::jlimit(1, maximumDetectorDecimation, newDecimation);
+    updateControlRateCoefficients();
+}
+
+// This method raises the per-sample coefficients to one control segment's worth of samples
+void BasicCompressor::updateControlRateCoefficients()
+{
+    m_controlAlphaAttack = std::pow(m_alphaAttack, static_cast<float>(m_detectorDecimation));
+    m_controlAlphaRelease = std::pow(m_alphaRelease, static_cast<float>(m_detectorDecimation));
+}
+
+// This method sets which gain computer the compressor runs
+void BasicCompressor::setMode(Mode newMode)
+{
+    m_mode = newMode;
+}
+
+// This method returns the gain reduction at the end of the last processed block
+float BasicCompressor::getGainReductionDb() const
+{
+    return m_gainReductionDb.load(std::memory_order_relaxed);
+}
+
+// This method returns the envelope level that silence settles at in the current mode
+float BasicCompressor::getRestingGainReductionDb() const
+{
+    return computeGainChangeDb(m_mode, silenceLevelDb, m_thresholdLevelDb, m_compressionRatio);
+}
+
+// This method evaluates a gain computer picked at run time, for use outside the sample loop
+float BasicCompressor::computeGainChangeDb(Mode mode, float inputLevelDb, float thresholdDb, float ratio)
+{
+    auto compute = [&](auto gainComputer)
+    {
+        using GainComputer = decltype(gainComputer);
+        return GainComputer::gainChangeDb(inputLevelDb, thresholdDb, GainComputer::slope(ratio));
+    };
+    
+    switch (mode)
+    {
+        case Mode::upwardCompression:   return compute(GainComputers::UpwardCompression());
+        case Mode::downwardExpansion:   return compute(GainComputers::DownwardExpansion());
+        case Mode::gate:                return compute(GainComputers::Gate());
+        case Mode::downwardCompression: break;
+    }
+    
+    return compute(GainComputers::DownwardCompression());
+}
+
+// Main compressor processing method, instantiated for float and double blocks.
+// The mode is dispatched once per block, so each sample loop is specialised.
+template <typename SampleType>
+void BasicCompressor::process(juce::dsp::ProcessContextReplacing<SampleType>& context)
+{
+    // If context is bypassed, copy input block to output block without processing
+    if(context.isBypassed)
+    {
+        context.getOutputBlock().copyFrom(context.getInputBlock());
+        m_gainReductionDb.store(0.0f, std::memory_order_relaxed);
+        return;
+    }
+    
+    // A settled envelope and a block that can't move it need no per-sample work.
+    // That is checked out here: inside processWith, GCC stops vectorising the
+    // level loop.
+    auto processAs = [this, &context](auto gainComputer)
+    {
+        using GainComputer = decltype(gainComputer);
+        
+        if (! processSettledBlock<GainComputer>(context))
+            processWith<GainComputer>(context);
+    };
+    
+    switch (m_mode)
+    {
+        case Mode::downwardCompression: processAs(GainComputers::DownwardCompression()); break;
+        case Mode::upwardCompression:   processAs(GainComputers::UpwardCompression()); break;
+        case Mode::downwardExpansion:   processAs(GainComputers::DownwardExpansion()); break;
+        case Mode::gate:                processAs(GainComputers::Gate()); break;
+    }
+}
+
+template <typename GainComputer, typename SampleType>
+void BasicCompressor::processWith(juce::dsp::ProcessContextReplacing<SampleType>& context)
 {
     // Get input and output blocks from the context
     auto& inputAudioBlock = context.getInputBlock();
@@ -69,61 +166,180 @@ void BasicCompressor::process(juce::dsp::ProcessContextReplacing<float>& context
     // Get the number of samples and channels from the output block
     const int numberOfSamples { static_cast<int>(outputAudioBlock.getNumSamples()) };
     const int numberOfChannels { static_cast<int>(outputAudioBlock.getNumChannels()) };
-
-    // If context is bypassed, copy input block to output block without processing
-    if(context.isBypassed)
+    
+    // The gain computer runs in the block's sample type
+    const SampleType thresholdLevelDb = m_thresholdLevelDb;
+    const SampleType slope = GainComputer::slope(static_cast<SampleType>(m_compressionRatio));
+    const SampleType makeUpGainDb = m_newMakeUpGainDb;
+    const SampleType alphaAttack = m_alphaAttack;
+    const SampleType alphaRelease = m_alphaRelease;
+    SampleType previousEnvelopeLevel = m_previousEnvelopeLevel;
+    
+    // A ratio of 1 changes nothing: once the envelope has released, only the make-up
+    // gain is left, applied to the block in place
+    if (GainComputer::usesRatio && m_compressionRatio == 1.0f && std::abs(previousEnvelopeLevel) < SampleType(0.0001))
     {
-        outputAudioBlock.copyFrom(inputAudioBlock);
+        if (makeUpGainDb != SampleType(0))
+            outputAudioBlock.multiplyBy(juce::Decibels::decibelsToGain(makeUpGainDb));
+        
+        m_previousEnvelopeLevel = 0.0f;
+        m_gainReductionDb.store(0.0f, std::memory_order_relaxed);
+        return;
     }
-    else
+    
+    // Only the envelope depends on the previous sample, so the level and gain
+    // conversions run as separate passes over chunks of the block, which vectorise
+    std::array<SampleType, chunkSize> gainsInDecibels;
+    
+    // At control rate each segment gets one level and one gain
+    const int decimation = m_detectorDecimation;
+    const SampleType controlAlphaAttack = m_controlAlphaAttack;
+    const SampleType controlAlphaRelease = m_controlAlphaRelease;
+    std::array<SampleType, chunkSize / 2> controlGains;
+    
+    // Iterate over each channel
+    for (int currentChannel = 0; currentChannel < numberOfChannels; ++currentChannel)
     {
-        // If not bypassed, iterate over each channel
-        for (int currentChannel = 0; currentChannel < numberOfChannels; ++currentChannel)
+        // Get the data for current input and output channels
+        const SampleType* inputChannelData = inputAudioBlock.getChannelPointer(currentChannel);
+        SampleType* outputChannelData = outputAudioBlock.getChannelPointer(currentChannel);
+        SampleType controlGain = FastMath::decibelsToGain(makeUpGainDb - previousEnvelopeLevel);
+        
+        for (int chunkStart = 0; chunkStart < numberOfSamples; chunkStart += chunkSize)
         {
-            // Get the data for current input and output channels
-            const float* inputChannelData = inputAudioBlock.getChannelPointer(currentChannel);
-            float* outputChannelData = outputAudioBlock.getChannelPointer(currentChannel);
+            const int chunkLength = juce::jmin(chunkSize, numberOfSamples - chunkStart);
+            const SampleType* input = inputChannelData + chunkStart;
+            SampleType* output = outputChannelData + chunkStart;
             
-            // Iterate over each sample in the channel
-            for (int currentSampleIndex = 0; currentSampleIndex < numberOfSamples; ++currentSampleIndex)
+            if (decimation > 1)
             {
-                // Get the current sample
-                float currentSample = inputChannelData[currentSampleIndex];
+                // Control rate: the detector steps once per segment of decimation samples,
+                // on the segment's peak so nothing between control points is missed, and
+                // the gain ramps linearly from one control point to the next. Only a
+                // block that isn't a multiple of decimation ends on a short segment.
+                const int numberOfSegments = (chunkLength + decimation - 1) / decimation;
                 
-                // Compute the input level in decibels
-                float inputLevelInDecibels;
-                if (std::abs(currentSample) < 0.000001f)
-                    inputLevelInDecibels = -120.0f;
-                else
-                    inputLevelInDecibels = 20.0f * std::log10(std::abs(currentSample));
+                for (int segment = 0; segment < numberOfSegments; ++segment)
+                {
+                    const int segmentStart = segment * decimation;
+                    controlGains[segment] = FastMath::absolutePeak(input + segmentStart, juce::jmin(decimation, chunkLength - segmentStart));
+                }
                 
-                // Compute the output level in decibels
-                float outputLevelInDecibels;
-                if (inputLevelInDecibels >= m_thresholdLevelDb)
-                    outputLevelInDecibels = m_thresholdLevelDb + (inputLevelInDecibels - m_thresholdLevelDb) / m_compressionRatio;
-                else
-                    outputLevelInDecibels = inputLevelInDecibels;
+                for (int segment = 0; segment < numberOfSegments; ++segment)
+                {
+                    const SampleType inputLevelInDecibels = FastMath::gainToDecibels(controlGains[segment], SampleType(silenceLevelDb));
+                    controlGains[segment] = GainComputer::gainChangeDb(inputLevelInDecibels, thresholdLevelDb, slope);
+                }
                 
-                // Compute the difference between input and output levels
-                float levelDifference = inputLevelInDecibels - outputLevelInDecibels;
+                for (int segment = 0; segment < numberOfSegments; ++segment)
+                {
+                    const int segmentLength = juce::jmin(decimation, chunkLength - segment * decimation);
+                    const SampleType levelDifference = controlGains[segment];
+                    const bool attacking = GainComputer::attacksOnRisingLevel ? levelDifference > previousEnvelopeLevel
+                                                                              : levelDifference < previousEnvelopeLevel;
+                    const SampleType alpha = segmentLength == decimation ? (attacking ? controlAlphaAttack : controlAlphaRelease)
+                                                                         : std::pow(attacking ? alphaAttack : alphaRelease, SampleType(segmentLength));
+                    previousEnvelopeLevel = alpha * previousEnvelopeLevel + (SampleType(1) - alpha) * levelDifference;
+                    controlGains[segment] = makeUpGainDb - previousEnvelopeLevel;
+                }
                 
-                // Apply attack or release envelope to the level difference
-                float envelopeLevel;
-                if (levelDifference > m_previousEnvelopeLevel)
-                    envelopeLevel = m_alphaAttack * m_previousEnvelopeLevel + (1.0f - m_alphaAttack) * levelDifference;
-                else
-                    envelopeLevel = m_alphaRelease * m_previousEnvelopeLevel + (1.0f - m_alphaRelease) * levelDifference;
+                for (int segment = 0; segment < numberOfSegments; ++segment)
+                    controlGains[segment] = FastMath::decibelsToGain(controlGains[segment]);
                 
-                // Compute the gain to be applied on the sample
-                float gainForSample = std::pow(10.0f, (m_newMakeUpGainDb - envelopeLevel) / 20.0f);
-                m_previousEnvelopeLevel = envelopeLevel;
+                for (int segment = 0; segment < numberOfSegments; ++segment)
+                {
+                    const int segmentStart = segment * decimation;
+                    const int segmentLength = juce::jmin(decimation, chunkLength - segmentStart);
+                    const SampleType gainStep = (controlGains[segment] - controlGain) / SampleType(segmentLength);
+                    
+                    for (int i = 0; i < segmentLength; ++i)
+                        output[segmentStart + i] = input[segmentStart + i] * (controlGain + gainStep * SampleType(i + 1));
+                    
+                    controlGain = controlGains[segment];
+                }
                 
-                // Apply gain to the sample and write it to the output
-                outputChannelData[currentSampleIndex] = currentSample * gainForSample;
+                continue;
             }
+            
+            // Compute the input level in decibels, with silence at -120 dB, and the gain
+            // change the level calls for
+            for (int i = 0; i < chunkLength; ++i)
+            {
+                const SampleType inputLevelInDecibels = FastMath::gainToDecibels(std::abs(input[i]), SampleType(silenceLevelDb));
+                gainsInDecibels[i] = GainComputer::gainChangeDb(inputLevelInDecibels, thresholdLevelDb, slope);
+            }
+            
+            // Attack as the level rises, release as it falls, selected without a branch
+            for (int i = 0; i < chunkLength; ++i)
+            {
+                const SampleType levelDifference = gainsInDecibels[i];
+                const bool attacking = GainComputer::attacksOnRisingLevel ? levelDifference > previousEnvelopeLevel
+                                                                          : levelDifference < previousEnvelopeLevel;
+                const SampleType alpha = attacking ? alphaAttack : alphaRelease;
+                previousEnvelopeLevel = alpha * previousEnvelopeLevel + (SampleType(1) - alpha) * levelDifference;
+                gainsInDecibels[i] = makeUpGainDb - previousEnvelopeLevel;
+            }
+            
+            // Apply the gain to each sample and write it to the output
+            for (int i = 0; i < chunkLength; ++i)
+                output[i] = input[i] * FastMath::decibelsToGain(gainsInDecibels[i]);
         }
     }
+    
+    m_previousEnvelopeLevel = static_cast<float>(previousEnvelopeLevel);
+    m_gainReductionDb.store(m_previousEnvelopeLevel, std::memory_order_relaxed);
 }
 
+template <typename GainComputer, typename SampleType>
+bool BasicCompressor::processSettledBlock(juce::dsp::ProcessContextReplacing<SampleType>& context)
+{
+    // Only a flat gain change gives every sample of the block the same gain
+    if constexpr (! GainComputer::flatBelowThreshold)
+        return false;
+    
+    auto& inputAudioBlock = context.getInputBlock();
+    auto& outputAudioBlock = context.getOutputBlock();
+    const int numberOfSamples { static_cast<int>(outputAudioBlock.getNumSamples()) };
+    const int numberOfChannels { static_cast<int>(outputAudioBlock.getNumChannels()) };
+    
+    const SampleType thresholdLevelDb = m_thresholdLevelDb;
+    const SampleType slope = GainComputer::slope(static_cast<SampleType>(m_compressionRatio));
+    const SampleType previousEnvelopeLevel = m_previousEnvelopeLevel;
+    const SampleType restingLevel = GainComputer::gainChangeDb(SampleType(silenceLevelDb), thresholdLevelDb, slope);
+    
+    const bool attacking = GainComputer::attacksOnRisingLevel ? restingLevel > previousEnvelopeLevel
+                                                              : restingLevel < previousEnvelopeLevel;
+    const SampleType alpha = attacking ? SampleType(m_alphaAttack) : SampleType(m_alphaRelease);
+    
+    // Settled is within 0.0001 dB of rest, or where rounding stops the envelope
+    // short of it: a long release can stall a few thousandths of a dB away
+    const bool stalled = alpha * previousEnvelopeLevel + (SampleType(1) - alpha) * restingLevel == previousEnvelopeLevel;
+    
+    if (! stalled && std::abs(previousEnvelopeLevel - restingLevel) >= SampleType(0.0001))
+        return false;
+    
+    // The block's peak, as a vector scan
+    SampleType peak = 0;
+    for (int currentChannel = 0; currentChannel < numberOfChannels; ++currentChannel)
+        peak = juce::jmax(peak, FastMath::absolutePeak(inputAudioBlock.getChannelPointer(currentChannel), numberOfSamples));
+    
+    const SampleType peakLevelInDecibels = FastMath::gainToDecibels(peak, SampleType(silenceLevelDb));
+    
+    if (GainComputer::gainChangeDb(peakLevelInDecibels, thresholdLevelDb, slope) != restingLevel)
+        return false;
+    
+    const SampleType gain = FastMath::decibelsToGain(SampleType(m_newMakeUpGainDb) - previousEnvelopeLevel);
+    if (gain != SampleType(1))
+        outputAudioBlock.multiplyBy(gain);
+    
+    // Every sample pulls the envelope the same way, so its last sliver of decay is
+    // advanced in one step; the channels run one after another through it
+    if (! stalled)
+        m_previousEnvelopeLevel = static_cast<float>(restingLevel + (previousEnvelopeLevel - restingLevel) * std::pow(alpha, SampleType(numberOfSamples * numberOfChannels)));
+    
+    m_gainReductionDb.store(m_previousEnvelopeLevel, std::memory_order_relaxed);
+    return true;
+}
 
-
+template void BasicCompressor::process<float>(juce::dsp::ProcessContextReplacing<float>&);
+template void BasicCompressor::process<double>(juce::dsp::ProcessContextReplacing<double>&);
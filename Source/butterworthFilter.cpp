@@ -16,22 +16,25 @@
 
 // Constructor definition
 ButterFilter::ButterFilter(double sampleRate, FilterType type) :    filterType(type),
-                                                                    sampleRate(sampleRate),
-                                                                    previousSamples1(2, 0),
-                                                                    previousSamples2(2, 0)
-{}
+                                                                    sampleRate(sampleRate)
+{
+    floatKernel.prepare(2);
+    doubleKernel.prepare(2);
+}
 
 void ButterFilter::prepare(const juce::dsp::ProcessSpec& spec)
 {
     sampleRate = spec.sampleRate;
     
-    // Resize the vectors to handle the number of channels provided
-    previousSamples1.resize(spec.numChannels, 0);
-    previousSamples2.resize(spec.numChannels, 0);
-    
-    // Reset the vectors to 0
-    std::fill(previousSamples1.begin(), previousSamples1.end(), 0.0);
-    std::fill(previousSamples2.begin(), previousSamples2.end(), 0.0);
+    // Size the state for the number of channels provided and reset it to 0
+    floatKernel.prepare(spec.numChannels);
+    doubleKernel.prepare(spec.numChannels);
+}
+
+void ButterFilter::reset()
+{
+    floatKernel.reset();
+    doubleKernel.reset();
 }
 
 void ButterFilter::setFilterParameters(double cutOffFrequency, double qualityFactor, FilterType filterType)
@@ -82,28 +85,93 @@ void ButterFilter::setFilterParameters(double cutOffFrequency, double qualityFac
         {
             throw std::invalid_argument("Invalid filter type.");
         }
+
+    // Pick the kernel precision float blocks run at for this cutoff; the state follows
+    // when the other kernel next runs
+    useDoublePrecision = cutOffFrequency < doublePrecisionCutoffRatio * sampleRate;
+
+    floatKernel.setCoefficients(coefficientA0, coefficientA1, coefficientA2, coefficientB1, coefficientB2);
+    doubleKernel.setCoefficients(coefficientA0, coefficientA1, coefficientA2, coefficientB1, coefficientB2);
 }
 
 double ButterFilter::processFilter(double inputSample, int channelNumber)
 {
     // Validate channel index
-    if (channelNumber < 0 || channelNumber >= previousSamples1.size())
+    if (channelNumber < 0 || channelNumber >= doubleKernel.previousSamples1.size())
     {
         throw std::out_of_range("Invalid channel index.");
     }
 
-    // Filter the input sample
-    double outputSample = coefficientA0 * inputSample + coefficientA1 * previousSamples1[channelNumber] + coefficientA2 * previousSamples2[channelNumber] - coefficientB1 * previousSamples1[channelNumber] - coefficientB2 * previousSamples2[channelNumber];
+    // Filter the input sample in double, whatever the cutoff
+    moveStateTo(true);
+    return doubleKernel.processSample(inputSample, static_cast<size_t>(channelNumber));
+}
+
+void ButterFilter::moveStateTo(bool doubleKernelRuns)
+{
+    if (doubleKernelRuns == stateInDoubleKernel)
+        return;
+
+    if (doubleKernelRuns)
+        doubleKernel.copyStateFrom(floatKernel);
+    else
+        floatKernel.copyStateFrom(doubleKernel);
+
+    stateInDoubleKernel = doubleKernelRuns;
+}
+
+ButterFilter::Recursion ButterFilter::getRecursion(int numPasses) const
+{
+    jassert(numPasses == 1 || numPasses == 2);
+    
+    const auto c1 = coefficientA1 - coefficientB1;
+    const auto c2 = coefficientA2 - coefficientB2;
     
-    // Update previous samples
-    previousSamples2[channelNumber] = previousSamples1[channelNumber];
-    previousSamples1[channelNumber] = inputSample;
-    previousSamples1[channelNumber] = outputSample;
+    if (numPasses == 1)
+        return { coefficientA0, c1, c2 };
+    
+    // The first pass gives u = A0 x + c1 y1 + c2 u1 and the second y = (A0 + c1) u + c2 y1,
+    // with y1 the last output and u1 the last first-pass result. Eliminating u:
+    // y = A0 d x + (2 c2 + c1 d) y1 - c2^2 y2, with d = A0 + c1
+    const auto d = coefficientA0 + c1;
+    return { coefficientA0 * d, 2 * c2 + c1 * d, -c2 * c2 };
+}
+
+double ButterFilter::getMagnitudeSquared(double cosW, double sinW, double cos2W, double sin2W, int numPasses) const
+{
+    // H(e^jw) = gain / (1 - feedback1 e^-jw - feedback2 e^-2jw)
+    const auto recursion = getRecursion(numPasses);
+    double denominatorReal = 1 - recursion.feedback1 * cosW - recursion.feedback2 * cos2W;
+    double denominatorImag = recursion.feedback1 * sinW + recursion.feedback2 * sin2W;
 
-    // Return filtered sample
-    return outputSample;
+    return recursion.gain * recursion.gain / (denominatorReal * denominatorReal + denominatorImag * denominatorImag);
 }
 
+int ButterFilter::getDecaySamples(double levelDb, int numPasses) const
+{
+    const auto recursion = getRecursion(numPasses);
+    const auto level = std::pow(10.0, levelDb / 20.0);
+    
+    // Once the last two outputs are both that far below the peak, the state they make
+    // up only decays from there on. The limit is a few minutes at any sample rate.
+    constexpr int maximumSamples = 1 << 24;
+    
+    double output = recursion.gain, previousOutput = 0.0;
+    auto peak = std::abs(output);
+    
+    for (int sample = 1; sample < maximumSamples; ++sample)
+    {
+        const auto nextOutput = recursion.feedback1 * output + recursion.feedback2 * previousOutput;
+        previousOutput = output;
+        output = nextOutput;
+        peak = juce::jmax(peak, std::abs(output));
+        
+        if (std::abs(output) + std::abs(previousOutput) <= level * peak)
+            return sample;
+    }
+    
+    return maximumSamples;
+}
 
 void ButterFilter::updateSampleRate(double newSampleRate)
 {
@@ -112,24 +180,35 @@ void ButterFilter::updateSampleRate(double newSampleRate)
     setFilterParameters(cutOffFrequency, qualityFactor, filterType);
 }
 
-void ButterFilter::process(const juce::dsp::ProcessContextReplacing<float>& context)
+template <typename SampleType>
+void ButterFilter::process(const juce::dsp::ProcessContextReplacing<SampleType>& context, int numPasses)
 {
-    auto& inputBlock = context.getInputBlock();
-    auto& outputBlock = context.getOutputBlock();
-    const int numChannels = inputBlock.getNumChannels();
-    const int numSamples = inputBlock.getNumSamples();
-
-    // You'd need to loop over all channels and samples
-    for (int channel = 0; channel < numChannels; ++channel)
+    if constexpr (std::is_same_v<SampleType, float>)
     {
-        for (int i = 0; i < numSamples; ++i)
+        if (! useDoublePrecision)
         {
-            // Process the samples and fill the outputBlock
-            outputBlock.getChannelPointer(channel)[i] = processFilter(inputBlock.getChannelPointer(channel)[i], channel);
+            moveStateTo(false);
+
+            if (useTimeParallel)
+                floatKernel.processTimeParallel(context, numPasses);
+            else
+                floatKernel.process(context, numPasses);
+            
+            return;
         }
     }
+
+    moveStateTo(true);
+
+    if (useTimeParallel)
+        doubleKernel.processTimeParallel(context, numPasses);
+    else
+        doubleKernel.process(context, numPasses);
 }
 
+template void ButterFilter::process<float>(const juce::dsp::ProcessContextReplacing<float>&, int);
+template void ButterFilter::process<double>(const juce::dsp::ProcessContextReplacing<double>&, int);
+
 // ======================================================================
 // Constructor definition
 LinkwitzRFilter::LinkwitzRFilter(double sampleRate) :   lowPassFilter(sampleRate,
@@ -146,6 +225,16 @@ void LinkwitzRFilter::prepare(const juce::dsp::ProcessSpec& spec)
     lowPassFilter.prepare(spec);
     highPassFilter.prepare(spec);
     allPassFilter.prepare(spec);
+    
+    // The sample rate may have changed, so the next crossover frequency must redesign
+    currentCrossoverFrequency = -1.0;
+}
+
+void LinkwitzRFilter::reset()
+{
+    lowPassFilter.reset();
+    highPassFilter.reset();
+    allPassFilter.reset();
 }
 
 void LinkwitzRFilter::setType(FilterType newType)
@@ -153,6 +242,12 @@ void LinkwitzRFilter::setType(FilterType newType)
     filterType = newType;
 }
 
+void LinkwitzRFilter::setTimeParallel(bool shouldUseTimeParallel)
+{
+    for (auto* filter : { &lowPassFilter, &highPassFilter, &allPassFilter })
+        filter->setTimeParallel(shouldUseTimeParallel);
+}
+
 void LinkwitzRFilter::setCrossoverFrequency(double crossoverFrequency)
 {
 //    // Validate crossover frequency
@@ -160,6 +255,11 @@ void LinkwitzRFilter::setCrossoverFrequency(double crossoverFrequency)
 //        throw std::invalid_argument("Invalid crossover frequency.");
 //    }
 
+    if (crossoverFrequency == currentCrossoverFrequency)
+        return;
+    
+    currentCrossoverFrequency = crossoverFrequency;
+
     // Set crossover frequency for low pass and high pass filter
     lowPassFilter.setFilterParameters(crossoverFrequency, 0.707, FilterType::lowpass);
     highPassFilter.setFilterParameters(crossoverFrequency, 0.707, FilterType::highpass);
@@ -186,22 +286,23 @@ double LinkwitzRFilter::processFilter(double inputSample, int channelNumber)
     return 0.0; // Default return value
 }
 
-void LinkwitzRFilter::process(const juce::dsp::ProcessContextReplacing<float>& context)
+template <typename SampleType>
+void LinkwitzRFilter::process(const juce::dsp::ProcessContextReplacing<SampleType>& context)
 {
-    auto& inputBlock = context.getInputBlock();
-    auto& outputBlock = context.getOutputBlock();
-    const int numChannels = inputBlock.getNumChannels();
-    const int numSamples = inputBlock.getNumSamples();
-
-    // You'd need to loop over all channels and samples
-    for (int channel = 0; channel < numChannels; ++channel)
+    // Each sample runs through the selected filter twice, as in processFilter()
+    if (filterType == FilterType::lowpass)
     {
-        for (int i = 0; i < numSamples; ++i)
-        {
-            // Process the samples and fill the outputBlock
-            outputBlock.getChannelPointer(channel)[i] = processFilter(inputBlock.getChannelPointer(channel)[i], channel);
-        }
+        lowPassFilter.process(context, 2);
+    }
+    else if (filterType == FilterType::highpass)
+    {
+        highPassFilter.process(context, 2);
+    }
+    else // allpass
+    {
+        allPassFilter.process(context, 2);
     }
 }
 
-
+template void LinkwitzRFilter::process<float>(const juce::dsp::ProcessContextReplacing<float>&);
+template void LinkwitzRFilter::process<double>(const juce::dsp::ProcessContextReplacing<double>&);
@@ -10,6 +10,7 @@
 #ifndef butterworthFilter_h
 #define butterworthFilter_h
 #include <JuceHeader.h>
+#include <array>
 #include <cmath>
 #include <vector>
 #include <stdexcept>
@@ -21,13 +22,239 @@ enum class FilterType
     allpass
 };
 
+// =====================BiquadKernel========================
+
+// Coefficients and per-channel state of one biquad section, held in the
+// sample type the section actually runs in.
+template <typename SampleType>
+struct BiquadKernel
+{
+    SampleType coefficientA0 = 0, coefficientA1 = 0, coefficientA2 = 0, coefficientB1 = 0, coefficientB2 = 0;
+    
+    // Vectors to store previous samples
+    std::vector<SampleType> previousSamples1, previousSamples2;
+    
+    void prepare(size_t numChannels)
+    {
+        previousSamples1.assign(numChannels, 0);
+        previousSamples2.assign(numChannels, 0);
+    }
+    
+    void reset()
+    {
+        std::fill(previousSamples1.begin(), previousSamples1.end(), SampleType(0));
+        std::fill(previousSamples2.begin(), previousSamples2.end(), SampleType(0));
+    }
+    
+    void setCoefficients(double a0, double a1, double a2, double b1, double b2)
+    {
+        coefficientA0 = static_cast<SampleType>(a0);
+        coefficientA1 = static_cast<SampleType>(a1);
+        coefficientA2 = static_cast<SampleType>(a2);
+        coefficientB1 = static_cast<SampleType>(b1);
+        coefficientB2 = static_cast<SampleType>(b2);
+        
+        chunkResponses.numPasses = 0;
+    }
+    
+    // Carries the filter state across when a section changes precision
+    template <typename OtherType>
+    void copyStateFrom(const BiquadKernel<OtherType>& other)
+    {
+        previousSamples1.assign(other.previousSamples1.begin(), other.previousSamples1.end());
+        previousSamples2.assign(other.previousSamples2.begin(), other.previousSamples2.end());
+    }
+    
+    SampleType processSample(SampleType inputSample, size_t channelNumber) noexcept
+    {
+        auto& previousSample1 = previousSamples1[channelNumber];
+        auto& previousSample2 = previousSamples2[channelNumber];
+        
+        // Filter the input sample
+        SampleType outputSample = coefficientA0 * inputSample + coefficientA1 * previousSample1 + coefficientA2 * previousSample2 - coefficientB1 * previousSample1 - coefficientB2 * previousSample2;
+        
+        // Update previous samples
+        previousSample2 = previousSample1;
+        previousSample1 = outputSample;
+        
+        return outputSample;
+    }
+    
+    // Runs every channel of the context through the section numPasses times per sample,
+    // converting to and from the kernel's sample type only at the block edges
+    template <typename BlockSampleType>
+    void process(const juce::dsp::ProcessContextReplacing<BlockSampleType>& context, int numPasses) noexcept
+    {
+        auto& inputBlock = context.getInputBlock();
+        auto& outputBlock = context.getOutputBlock();
+        const auto numChannels = juce::jmin(inputBlock.getNumChannels(), previousSamples1.size());
+        const auto numSamples = inputBlock.getNumSamples();
+        
+        for (size_t channel = 0; channel < numChannels; ++channel)
+        {
+            const auto* input = inputBlock.getChannelPointer(channel);
+            auto* output = outputBlock.getChannelPointer(channel);
+            
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                auto sample = static_cast<SampleType>(input[i]);
+                
+                for (int pass = 0; pass < numPasses; ++pass)
+                    sample = processSample(sample, channel);
+                
+                output[i] = static_cast<BlockSampleType>(sample);
+            }
+        }
+    }
+    
+    // Samples per step of processTimeParallel: one SSE or NEON register of floats.
+    // Longer chunks do less serial work but spill the matrix out of registers; 8
+    // and 16 measured slower than 4 on SSE.
+    static constexpr size_t timeParallelChunkSize = 4;
+    
+    // The same filter as process(), but vectorised along time rather than run one
+    // sample after another. Each chunk's outputs are a fixed linear function of its
+    // inputs and the state it starts from, so a chunk is a small matrix product,
+    // independent of the state, plus the state's response. Only that last part is
+    // serial, once per chunk instead of numPasses times per sample. The result
+    // matches process() to rounding, not bit for bit.
+    //
+    // Within a block the state is carried as the last output and its slope, the
+    // difference from the one before. Low crossovers have their poles close to 1,
+    // where the two previous outputs almost cancel; their slope is small and exact
+    // to start with, which keeps the state's response as accurate as process().
+    template <typename BlockSampleType>
+    void processTimeParallel(const juce::dsp::ProcessContextReplacing<BlockSampleType>& context, int numPasses) noexcept
+    {
+        constexpr auto chunkSize = timeParallelChunkSize;
+        
+        if (chunkResponses.numPasses != numPasses)
+            updateChunkResponses(numPasses);
+        
+        auto& inputBlock = context.getInputBlock();
+        auto& outputBlock = context.getOutputBlock();
+        const auto numChannels = juce::jmin(inputBlock.getNumChannels(), previousSamples1.size());
+        const auto numSamples = inputBlock.getNumSamples();
+        const auto numWholeChunks = numSamples / chunkSize;
+        const auto& responses = chunkResponses;
+        
+        std::array<SampleType, chunkSize> inputs, outputs;
+        
+        for (size_t channel = 0; channel < numChannels; ++channel)
+        {
+            const auto* input = inputBlock.getChannelPointer(channel);
+            auto* output = outputBlock.getChannelPointer(channel);
+            auto level = previousSamples1[channel];
+            auto slope = previousSamples1[channel] - previousSamples2[channel];
+            
+            for (size_t chunk = 0; chunk < numWholeChunks; ++chunk)
+            {
+                const auto start = chunk * chunkSize;
+                
+                for (size_t i = 0; i < chunkSize; ++i)
+                    inputs[i] = static_cast<SampleType>(input[start + i]);
+                
+                // The response to the state the chunk starts from, then to the
+                // inputs, column by column
+                for (size_t i = 0; i < chunkSize; ++i)
+                    outputs[i] = responses.fromLevel[i] * level + responses.fromSlope[i] * slope;
+                
+                auto nextSlope = responses.slopeFromLevel * level + responses.slopeFromSlope * slope;
+                
+                for (size_t j = 0; j < chunkSize; ++j)
+                {
+                    for (size_t i = 0; i < chunkSize; ++i)
+                        outputs[i] += inputs[j] * responses.fromInput[j][i];
+                    
+                    nextSlope += inputs[j] * responses.slopeFromInput[j];
+                }
+                
+                level = outputs[chunkSize - 1];
+                slope = nextSlope;
+                
+                for (size_t i = 0; i < chunkSize; ++i)
+                    output[start + i] = static_cast<BlockSampleType>(outputs[i]);
+            }
+            
+            previousSamples1[channel] = level;
+            previousSamples2[channel] = level - slope;
+            
+            // The last few samples one at a time
+            for (size_t i = numWholeChunks * chunkSize; i < numSamples; ++i)
+            {
+                auto sample = static_cast<SampleType>(input[i]);
+                
+                for (int pass = 0; pass < numPasses; ++pass)
+                    sample = processSample(sample, channel);
+                
+                output[i] = static_cast<BlockSampleType>(sample);
+            }
+        }
+    }
+    
+private:
+    // One chunk of numPasses passes per sample, as a linear map: the outputs and
+    // the slope at the end, from each input and from the starting level and slope.
+    // The level at the end is just the last output.
+    struct ChunkResponses
+    {
+        int numPasses = 0; // 0 until worked out for the current coefficients
+        
+        std::array<std::array<SampleType, timeParallelChunkSize>, timeParallelChunkSize> fromInput {};
+        std::array<SampleType, timeParallelChunkSize> fromLevel {}, fromSlope {};
+        std::array<SampleType, timeParallelChunkSize> slopeFromInput {};
+        SampleType slopeFromLevel = 0, slopeFromSlope = 0;
+    };
+    
+    ChunkResponses chunkResponses;
+    
+    // Runs the kernel's own difference equation in double on unit inputs and unit
+    // states; the powers of the state matrix fall out of that directly
+    void updateChunkResponses(int numPasses) noexcept
+    {
+        constexpr auto chunkSize = timeParallelChunkSize;
+        
+        auto run = [this, numPasses](size_t impulseIndex, double state1, double state2, auto&& storeOutput) -> double
+        {
+            for (size_t i = 0; i < chunkSize; ++i)
+            {
+                auto sample = i == impulseIndex ? 1.0 : 0.0;
+                
+                for (int pass = 0; pass < numPasses; ++pass)
+                {
+                    sample = double(coefficientA0) * sample + double(coefficientA1) * state1 + double(coefficientA2) * state2
+                           - double(coefficientB1) * state1 - double(coefficientB2) * state2;
+                    state2 = state1;
+                    state1 = sample;
+                }
+                
+                storeOutput(i, static_cast<SampleType>(sample));
+            }
+            
+            return state1 - state2;
+        };
+        
+        constexpr auto noImpulse = chunkSize;
+        auto& responses = chunkResponses;
+        
+        for (size_t j = 0; j < chunkSize; ++j)
+            responses.slopeFromInput[j] = static_cast<SampleType>(run(j, 0.0, 0.0, [&](size_t i, SampleType y) { responses.fromInput[j][i] = y; }));
+        
+        // A level of 1 is both previous outputs at 1; a slope of 1 is the one
+        // before the last at -1
+        responses.slopeFromLevel = static_cast<SampleType>(run(noImpulse, 1.0, 1.0, [&](size_t i, SampleType y) { responses.fromLevel[i] = y; }));
+        responses.slopeFromSlope = static_cast<SampleType>(run(noImpulse, 0.0, -1.0, [&](size_t i, SampleType y) { responses.fromSlope[i] = y; }));
+        responses.numPasses = numPasses;
+    }
+};
+
 // =====================Butterworth========================
 
 class ButterFilter
 {
     FilterType filterType;
     
-    // Coefficients for Butterworth filter
+    // Coefficients for Butterworth filter, as designed
     double coefficientA0, coefficientA1, coefficientA2, coefficientB1, coefficientB2;
     
     // Filter parameters
@@ -35,25 +262,77 @@ class ButterFilter
     
     double sampleRate;
     
-    // Vectors to store previous samples
-    std::vector<double> previousSamples1, previousSamples2;
+    // Float runs by default; sections tuned far below the sample rate switch to
+    // double, where float coefficients and state no longer hold the poles accurately
+    BiquadKernel<float> floatKernel;
+    BiquadKernel<double> doubleKernel;
+    bool useDoublePrecision = false;
+    bool useTimeParallel = false;
+    
+    // The kernel that ran last holds the filter state; the other takes it over before it runs
+    bool stateInDoubleKernel = false;
+    void moveStateTo(bool doubleKernelRuns);
 
 public:
+    // Cutoffs below this fraction of the sample rate run in double precision
+    // (e.g. below 48 Hz at 48 kHz, or below 384 Hz at 384 kHz)
+    static constexpr double doublePrecisionCutoffRatio = 1.0 / 1000.0;
+    
     // Constructor
     ButterFilter(double sampleRate, FilterType type);
     
     void prepare(const juce::dsp::ProcessSpec& spec);
+    
+    // Clears the filter state, keeping the coefficients
+    void reset();
 
     // Set filter parameters
     void setFilterParameters(double cutOffFrequency, double qualityFactor, FilterType filterType);
     
-    // Process input sample through filter
+    // Process input sample through filter, always in double precision
     double processFilter(double inputSample, int channelNumber);
     
+    // The kernel's difference equation y = A0 x + (A1 - B1) y1 + (A2 - B2) y2, run
+    // numPasses (1 or 2) times per sample through its one state, as the single
+    // recursion y = gain x + feedback1 y1 + feedback2 y2 it amounts to. Two passes
+    // through the shared state are not the section squared: the second pass feeds
+    // back the first pass's output, and the result is again all-pole and second order.
+    struct Recursion
+    {
+        double gain, feedback1, feedback2;
+    };
+    
+    Recursion getRecursion(int numPasses) const;
+    
+    // Squared magnitude at w, given cos/sin of w and 2w, of the section as process()
+    // runs it with numPasses passes per sample
+    double getMagnitudeSquared(double cosW, double sinW, double cos2W, double sin2W, int numPasses = 1) const;
+    
+    // Samples the impulse response of the section, run with numPasses passes per sample,
+    // takes to fall levelDb below its peak for good. Worked out by running the recursion,
+    // whose poles sit much closer to 1 than an ideal Butterworth section's at low cutoffs.
+    int getDecaySamples(double levelDb, int numPasses) const;
+    
+    // True when the current cutoff needs the double precision kernel
+    bool isUsingDoublePrecision() const { return useDoublePrecision; }
+    
+    // Blocks run through BiquadKernel::processTimeParallel rather than sample by
+    // sample; off by default, which keeps double blocks identical to processFilter()
+    void setTimeParallel(bool shouldUseTimeParallel) { useTimeParallel = shouldUseTimeParallel; }
+    
+    // The designed coefficients as { A0, A1, A2, B1, B2 }, for engines that run the section themselves
+    std::array<double, 5> getCoefficients() const
+    {
+        return { coefficientA0, coefficientA1, coefficientA2, coefficientB1, coefficientB2 };
+    }
+    
     // Update method to handle changes in sample rate
     void updateSampleRate(double newSampleRate);
     
-    void process(const juce::dsp::ProcessContextReplacing<float>& context);
+    // Float blocks use the float kernel unless this section needs double;
+    // double blocks always run in double
+    template <typename SampleType>
+    void process(const juce::dsp::ProcessContextReplacing<SampleType>& context, int numPasses = 1);
 };
 
 // =====================LinkwitzRiley========================
@@ -62,6 +341,9 @@ class LinkwitzRFilter
 {
     FilterType filterType;
     
+    // Last designed crossover, so per-sub-block updates only redesign on change
+    double currentCrossoverFrequency = -1.0;
+    
 public:
     // Low pass and high pass Butterworth filters
     ButterFilter lowPassFilter, highPassFilter, allPassFilter;
@@ -70,6 +352,9 @@ public:
     LinkwitzRFilter(double sampleRate);
     
     void prepare(const juce::dsp::ProcessSpec& spec);
+    
+    // Clears the state of the inner filters
+    void reset();
 
     // Set crossover frequency
     void setCrossoverFrequency(double crossoverFrequency);
@@ -80,7 +365,11 @@ public:
     // Method to set the filter type
     void setType(FilterType newType);
     
-    void process(const juce::dsp::ProcessContextReplacing<float>& context);
+    // See ButterFilter::setTimeParallel
+    void setTimeParallel(bool shouldUseTimeParallel);
+    
+    template <typename SampleType>
+    void process(const juce::dsp::ProcessContextReplacing<SampleType>& context);
 };
 
 
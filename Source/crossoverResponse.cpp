@@ -0,0 +1,172 @@
+//
+//  crossoverResponse.cpp
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <cmath>
+#include <JuceHeader.h>
+
+#include "crossoverResponse.h"
+#include "fastMath.h"
+#include "linearPhaseCrossover.h"
+#include "tptCrossover.h"
+
+namespace
+{
+// Only drawn, so 0.1 dB is plenty
+using FastMath::Accuracy;
+
+float magnitudeToDecibels(double magnitude)
+{
+    return FastMath::gainToDecibels<Accuracy::tenthDb>(static_cast<float>(magnitude), -100.f);
+}
+
+// 10 log10 of a squared magnitude, without the square root
+float magnitudeSquaredToDecibels(double magnitudeSquared)
+{
+    return 0.5f * FastMath::gainToDecibels<Accuracy::tenthDb>(static_cast<float>(magnitudeSquared), -200.f);
+}
+}
+
+bool CrossoverResponse::prepare(int numPoints, double sampleRate)
+{
+    if (numPoints == getNumPoints() && sampleRate == gridSampleRate)
+        return false;
+    
+    gridSampleRate = sampleRate;
+    
+    // One point per pixel column, spaced logarithmically like the analyser grid
+    auto key = "crossoverResponseGrid/" + juce::String(numPoints) + "/" + juce::String(sampleRate);
+    trigTable = sharedResources->getTable<std::vector<Trig>>(key, [numPoints, sampleRate]
+    {
+        std::vector<Trig> table(static_cast<size_t>(numPoints));
+        for (int i = 0; i < numPoints; ++i)
+        {
+            auto frequency = juce::mapToLog10(double(i) / double(numPoints - 1), minFrequency, maxFrequency);
+            auto w = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+            table[static_cast<size_t>(i)] = { frequency, std::cos(w), std::sin(w), std::cos(2.0 * w), std::sin(2.0 * w) };
+        }
+        return table;
+    });
+    
+    for (auto& magnitudes : bandMagnitudesDb)
+        magnitudes.assign(trigTable->size(), 0.f);
+    
+    juce::dsp::ProcessSpec spec;
+    spec.sampleRate = sampleRate;
+    spec.maximumBlockSize = 1;
+    spec.numChannels = 1;
+    
+    for (auto* filter : { &LP1, &AP2, &HP1, &LP2, &HP2 })
+        filter->prepare(spec);
+    
+    return true;
+}
+
+void CrossoverResponse::update(MultibandCore::CrossoverMode mode, double lowMidFrequency, double midHighFrequency)
+{
+    if (trigTable == nullptr)
+        return;
+    
+    switch (mode)
+    {
+        case MultibandCore::CrossoverMode::biquad:
+            updateBiquad(lowMidFrequency, midHighFrequency);
+            break;
+            
+        case MultibandCore::CrossoverMode::topologyPreserving:
+            updateTopologyPreserving(lowMidFrequency, midHighFrequency);
+            break;
+            
+        case MultibandCore::CrossoverMode::linearPhase:
+            updateLinearPhase(lowMidFrequency, midHighFrequency);
+            break;
+    }
+}
+
+void CrossoverResponse::updateBiquad(double lowMidFrequency, double midHighFrequency)
+{
+    LP1.setCrossoverFrequency(lowMidFrequency);
+    HP1.setCrossoverFrequency(lowMidFrequency);
+    AP2.setCrossoverFrequency(midHighFrequency);
+    LP2.setCrossoverFrequency(midHighFrequency);
+    HP2.setCrossoverFrequency(midHighFrequency);
+    
+    for (size_t i = 0; i < trigTable->size(); ++i)
+    {
+        const auto& t = (*trigTable)[i];
+        
+        // Each Linkwitz-Riley stage runs its section twice per sample
+        auto magnitudeSquared = [&t](const ButterFilter& filter)
+        {
+            return filter.getMagnitudeSquared(t.cosW, t.sinW, t.cos2W, t.sin2W, 2);
+        };
+        
+        auto lp1 = magnitudeSquared(LP1.lowPassFilter);
+        auto hp1 = magnitudeSquared(HP1.highPassFilter);
+        auto ap2 = magnitudeSquared(AP2.allPassFilter);
+        auto lp2 = magnitudeSquared(LP2.lowPassFilter);
+        auto hp2 = magnitudeSquared(HP2.highPassFilter);
+        
+        bandMagnitudesDb[0][i] = magnitudeSquaredToDecibels(lp1 * ap2);
+        bandMagnitudesDb[1][i] = magnitudeSquaredToDecibels(hp1 * lp2);
+        bandMagnitudesDb[2][i] = magnitudeSquaredToDecibels(hp1 * hp2);
+    }
+}
+
+void CrossoverResponse::updateTopologyPreserving(double lowMidFrequency, double midHighFrequency)
+{
+    for (size_t i = 0; i < trigTable->size(); ++i)
+    {
+        const auto frequency = (*trigTable)[i].frequency;
+        
+        // The low band's allpass is flat
+        auto lowMid = TPTCrossover::getLowPassMagnitude(frequency, lowMidFrequency, gridSampleRate);
+        auto midHigh = TPTCrossover::getLowPassMagnitude(frequency, midHighFrequency, gridSampleRate);
+        
+        bandMagnitudesDb[0][i] = magnitudeToDecibels(lowMid);
+        bandMagnitudesDb[1][i] = magnitudeToDecibels((1.0 - lowMid) * midHigh);
+        bandMagnitudesDb[2][i] = magnitudeToDecibels((1.0 - lowMid) * (1.0 - midHigh));
+    }
+}
+
+void CrossoverResponse::updateLinearPhase(double lowMidFrequency, double midHighFrequency)
+{
+    // The window smooths the designed magnitudes noticeably around a low crossover, so
+    // each band is the spectrum of its actual kernel, zero-padded to twice its length
+    // and interpolated between bins
+    const auto kernelLength = LinearPhaseCrossover::getKernelLength(gridSampleRate);
+    const auto kernelOrder = juce::roundToInt(std::log2(kernelLength));
+    const auto& kernelFFT = sharedResources->getFFT(kernelOrder);
+    const auto& spectrumFFT = sharedResources->getFFT(kernelOrder + 1);
+    const auto numBins = kernelLength + 1;
+    
+    kernel.resize(static_cast<size_t>(2 * kernelLength));
+    kernelSpectrum.resize(static_cast<size_t>(4 * kernelLength));
+    
+    for (size_t band = 0; band < bandMagnitudesDb.size(); ++band)
+    {
+        LinearPhaseCrossover::designBandKernel(band, gridSampleRate, lowMidFrequency, midHighFrequency, kernelFFT, kernel);
+        
+        std::fill(kernelSpectrum.begin(), kernelSpectrum.end(), 0.f);
+        std::copy_n(kernel.begin(), kernelLength, kernelSpectrum.begin());
+        spectrumFFT.performRealOnlyForwardTransform(kernelSpectrum.data(), true);
+        
+        auto binMagnitude = [this](int bin)
+        {
+            return std::hypot(kernelSpectrum[static_cast<size_t>(2 * bin)], kernelSpectrum[static_cast<size_t>(2 * bin + 1)]);
+        };
+        
+        for (size_t i = 0; i < trigTable->size(); ++i)
+        {
+            const auto position = (*trigTable)[i].frequency * 2 * kernelLength / gridSampleRate;
+            const auto bin = juce::jlimit(0, numBins - 2, static_cast<int>(position));
+            const auto fraction = position - bin;
+            
+            bandMagnitudesDb[band][i] = magnitudeToDecibels(binMagnitude(bin) + fraction * (binMagnitude(bin + 1) - binMagnitude(bin)));
+        }
+    }
+}
@@ -0,0 +1,70 @@
+//
+//  crossoverResponse.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef crossoverResponse_h
+#define crossoverResponse_h
+#include <JuceHeader.h>
+#include <array>
+#include <memory>
+#include <vector>
+#include "butterworthFilter.h"
+#include "multibandCore.h"
+#include "sharedResources.h"
+
+// =====================CrossoverResponse========================
+
+// Magnitude response of the three bands of a MultibandCore crossover, for the
+// editor's overlay. Each mode is drawn from what it actually runs: the biquad
+// bands from the sections' real recursion (see ButterFilter::getRecursion), the
+// TPT bands from the bilinear Linkwitz-Riley response and the linear-phase bands
+// from the spectra of their windowed kernels. The log-frequency grid and
+// its sin/cos tables are only rebuilt when the width or sample rate change, and
+// the band curves only when the mode or a crossover frequency changes.
+class CrossoverResponse
+{
+public:
+    // Rebuilds the grid and returns true if numPoints or sampleRate differ from the last call
+    bool prepare(int numPoints, double sampleRate);
+    
+    void update(MultibandCore::CrossoverMode mode, double lowMidFrequency, double midHighFrequency);
+    
+    const std::vector<float>& getBandMagnitudesDb(size_t band) const { return bandMagnitudesDb[band]; }
+    int getNumPoints() const { return trigTable != nullptr ? static_cast<int>(trigTable->size()) : 0; }
+    
+    // Frequency of a grid point, from minFrequency to maxFrequency
+    double getFrequency(int point) const { return (*trigTable)[static_cast<size_t>(point)].frequency; }
+    
+    static constexpr double minFrequency = 20.0;
+    static constexpr double maxFrequency = 20000.0;
+
+private:
+    struct Trig
+    {
+        double frequency, cosW, sinW, cos2W, sin2W;
+    };
+    
+    // Shared with every other editor showing the same grid
+    juce::SharedResourcePointer<SharedResources> sharedResources;
+    std::shared_ptr<const std::vector<Trig>> trigTable;
+    std::array<std::vector<float>, 3> bandMagnitudesDb;
+    double gridSampleRate = 0.0;
+    
+    //      FC0     FC1
+    LinkwitzRFilter LP1 { 44100 },  AP2 { 44100 },
+                    HP1 { 44100 },  LP2 { 44100 },
+                                    HP2 { 44100 };
+    
+    void updateBiquad(double lowMidFrequency, double midHighFrequency);
+    void updateTopologyPreserving(double lowMidFrequency, double midHighFrequency);
+    void updateLinearPhase(double lowMidFrequency, double midHighFrequency);
+    
+    // The linear-phase kernel, then its zero-padded spectrum
+    std::vector<float> kernel, kernelSpectrum;
+};
+
+#endif /* crossoverResponse_h */
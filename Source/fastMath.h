@@ -0,0 +1,190 @@
+//
+//  fastMath.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef fastMath_h
+#define fastMath_h
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <JuceHeader.h>
+
+// =====================FastMath========================
+
+// log2, exp2 and decibel conversions for the sample and bin loops, in three tiers:
+//
+//  exact        within 0.00002 dB, float rounding level; for the audio path
+//  hundredthDb  within 0.01 dB through a gain/decibel round trip
+//  tenthDb      within 0.1 dB, for anything that is only drawn
+//
+// Every function is branch-free and works on the float's bits directly, so the
+// block versions compile to vector loops. Doubles always take the standard
+// library path: the double blocks keep the prototypes' arithmetic exactly.
+namespace FastMath
+{
+enum class Accuracy
+{
+    exact,
+    hundredthDb,
+    tenthDb
+};
+
+namespace detail
+{
+inline std::int32_t toBits(float value) noexcept
+{
+    std::int32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float fromBits(std::int32_t bits) noexcept
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+}
+
+// log2 of a positive, normal x
+template <Accuracy accuracy = Accuracy::exact>
+inline float log2(float x) noexcept
+{
+    const auto bits = detail::toBits(x);
+
+    if constexpr (accuracy == Accuracy::exact)
+    {
+        // x = m * 2^e with m in [sqrt(1/2), sqrt(2)), then log2(m) as an odd series
+        // in t = (m - 1) / (m + 1)
+        const auto offsetBits = bits - 0x3f3504f3;
+        const auto exponent = offsetBits >> 23;
+        const auto m = detail::fromBits(bits - (exponent << 23));
+        const auto t = (m - 1.0f) / (m + 1.0f);
+        const auto t2 = t * t;
+
+        return static_cast<float>(exponent)
+             + t * (2.885390080e+00f + t2 * (9.617988464e-01f + t2 * (5.767145222e-01f + t2 * 4.317322184e-01f)));
+    }
+    else
+    {
+        // x = m * 2^e with m in [1, 2), then a polynomial that is exact at 1 and 2,
+        // so the result stays continuous across octaves
+        const auto exponent = (bits >> 23) - 127;
+        const auto m = detail::fromBits((bits & 0x007fffff) | 0x3f800000);
+
+        const auto curve = accuracy == Accuracy::hundredthDb ? -5.820834772e-01f + m * 1.592189335e-01f
+                                                             : -3.465534967e-01f;
+
+        return static_cast<float>(exponent) + (m - 1.0f) * (1.0f + (m - 2.0f) * curve);
+    }
+}
+
+// 2^x, with the power of two clamped to the normal float range
+template <Accuracy accuracy = Accuracy::exact>
+inline float exp2(float x) noexcept
+{
+    // Adding 1.5 * 2^23 leaves round(x) in the low mantissa bits, which splits x into
+    // a whole and a fraction without a conversion. Clamping the whole as an integer
+    // rather than x as a float keeps the loop vectorisable; the fraction stays in
+    // range either way, so far out-of-range inputs just give 2^-126 or 2^127.
+    constexpr auto roundingOffset = 12582912.0f;
+    constexpr auto roundingOffsetBits = 0x4b400000u;
+
+    // The tiers' polynomials are fitted to f in [0, 1], the exact one to [-1/2, 1/2]
+    const auto rounded = (accuracy == Accuracy::exact ? x : x - 0.5f) + roundingOffset;
+    const auto f = x - (rounded - roundingOffset);
+    const auto whole = static_cast<std::int32_t>(static_cast<std::uint32_t>(detail::toBits(rounded)) - roundingOffsetBits);
+    const auto scale = detail::fromBits((juce::jlimit(-126, 127, whole) + 127) << 23);
+
+    if constexpr (accuracy == Accuracy::exact)
+    {
+        return scale * (1.0f + f * (6.931472057e-01f + f * (2.402264689e-01f + f * (5.550328820e-02f
+                     + f * (9.618488994e-03f + f * (1.339991439e-03f + f * 1.534575861e-04f))))));
+    }
+    else
+    {
+        // Exact at 0 and 1, so the result stays continuous across octaves
+        const auto curve = accuracy == Accuracy::hundredthDb ? 3.045756221e-01f + f * 7.826795463e-02f
+                                                             : 3.397660291e-01f;
+
+        return scale * (1.0f + f + f * (f - 1.0f) * curve);
+    }
+}
+
+// 20 log10(gain), and minusInfinityDb for gains at or below it, like juce::Decibels
+template <Accuracy accuracy = Accuracy::exact>
+inline float gainToDecibels(float gain, float minusInfinityDb = -100.0f) noexcept
+{
+    constexpr auto decibelsPerOctave = 6.020599913f; // 20 log10(2)
+    constexpr std::int32_t smallestGainBits = 0x0da24260; // 1.0e-30f
+
+    // Floored as bits, which keeps the loop free of branches: negative floats are
+    // negative integers, and positive ones order the same way as their bits
+    const auto bits = juce::jmax(detail::toBits(gain), smallestGainBits);
+    const auto level = decibelsPerOctave * log2<accuracy>(detail::fromBits(bits));
+
+    return juce::jmax(minusInfinityDb, level);
+}
+
+template <Accuracy accuracy = Accuracy::exact>
+inline double gainToDecibels(double gain, double minusInfinityDb = -100.0)
+{
+    return gain > 0.0 ? juce::jmax(minusInfinityDb, 20.0 * std::log10(gain)) : minusInfinityDb;
+}
+
+// 10^(decibels / 20), without a floor
+template <Accuracy accuracy = Accuracy::exact>
+inline float decibelsToGain(float decibels) noexcept
+{
+    constexpr auto octavesPerDecibel = 1.660964047e-01f; // log2(10) / 20
+    return exp2<accuracy>(decibels * octavesPerDecibel);
+}
+
+template <Accuracy accuracy = Accuracy::exact>
+inline double decibelsToGain(double decibels)
+{
+    return std::pow(10.0, decibels / 20.0);
+}
+
+// Block versions, in place when source == destination
+template <Accuracy accuracy = Accuracy::exact>
+inline void gainToDecibels(const float* source, float* destination, int numValues, float minusInfinityDb = -100.0f) noexcept
+{
+    for (int i = 0; i < numValues; ++i)
+        destination[i] = gainToDecibels<accuracy>(source[i], minusInfinityDb);
+}
+
+template <Accuracy accuracy = Accuracy::exact>
+inline void decibelsToGain(const float* source, float* destination, int numValues) noexcept
+{
+    for (int i = 0; i < numValues; ++i)
+        destination[i] = decibelsToGain<accuracy>(source[i]);
+}
+
+// The largest magnitude in a block. Float magnitudes are compared as their bits
+// with the sign cleared, which order the same way and, unlike a float max, reduce
+// in a vector loop.
+inline float absolutePeak(const float* source, int numValues) noexcept
+{
+    std::int32_t peakBits = 0;
+    for (int i = 0; i < numValues; ++i)
+        peakBits = juce::jmax(peakBits, detail::toBits(source[i]) & 0x7fffffff);
+
+    return detail::fromBits(peakBits);
+}
+
+inline double absolutePeak(const double* source, int numValues) noexcept
+{
+    double peak = 0.0;
+    for (int i = 0; i < numValues; ++i)
+        peak = juce::jmax(peak, std::abs(source[i]));
+
+    return peak;
+}
+}
+
+#endif /* fastMath_h */
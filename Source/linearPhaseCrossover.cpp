@@ -0,0 +1,488 @@
+//
+//  linearPhaseCrossover.cpp
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//  This code has been referenced and adapted from Smith (2011), Wefers (2015) and Zolzer (2011).
+//
+
+#include <algorithm>
+#include <cmath>
+#include <JuceHeader.h>
+
+#include "linearPhaseCrossover.h"
+
+// ======================================================================
+// One background thread for every linear-phase crossover in the process. It sleeps
+// until a crossover asks for something, then goes through all of them: building
+// the engines that were switched on, freeing the ones that were switched off and
+// redesigning the kernels of those whose crossover frequencies moved.
+class LinearPhaseCrossover::KernelDesigner : public juce::Thread
+{
+public:
+    KernelDesigner() : juce::Thread("Linear phase kernel designer")
+    {
+        startThread();
+    }
+    
+    ~KernelDesigner() override
+    {
+        stopThread(2000);
+    }
+    
+    void add(LinearPhaseCrossover& crossover)
+    {
+        const juce::ScopedLock lock(crossoversLock);
+        crossovers.push_back(&crossover);
+    }
+    
+    // Returns once the designer has finished anything it was doing for crossover
+    void remove(LinearPhaseCrossover& crossover)
+    {
+        const juce::ScopedLock lock(crossoversLock);
+        crossovers.erase(std::remove(crossovers.begin(), crossovers.end(), &crossover), crossovers.end());
+    }
+    
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait(-1);
+            
+            const juce::ScopedLock lock(crossoversLock);
+            for (auto* crossover : crossovers)
+                crossover->serviceRequests(kernelScratch, spectrumScratch);
+        }
+    }
+    
+private:
+    juce::CriticalSection crossoversLock;
+    std::vector<LinearPhaseCrossover*> crossovers;
+    std::vector<float> kernelScratch, spectrumScratch;
+};
+
+// ======================================================================
+LinearPhaseCrossover::LinearPhaseCrossover() = default;
+
+LinearPhaseCrossover::~LinearPhaseCrossover()
+{
+    release();
+}
+
+void LinearPhaseCrossover::release()
+{
+    if (registeredWithDesigner)
+    {
+        designer->remove(*this);
+        registeredWithDesigner = false;
+    }
+    
+    freeBuffers();
+    state.store(State::released);
+}
+
+void LinearPhaseCrossover::prepare(const juce::dsp::ProcessSpec& spec, double lowMidFrequency, double midHighFrequency, bool allocateNow)
+{
+    // The designer reads the sizes below, so it must not see this crossover while they change
+    release();
+    
+    sampleRate = spec.sampleRate;
+    numChannels = spec.numChannels;
+    
+    kernelLength = getKernelLength(sampleRate);
+    partitionSize = juce::jlimit(minimumPartitionSize, kernelLength,
+                                 juce::nextPowerOfTwo(static_cast<int>(spec.maximumBlockSize)));
+    numPartitions = kernelLength / partitionSize;
+    numBins = partitionSize + 1;
+    
+    partitionFFT = &sharedResources->getFFT(juce::roundToInt(std::log2(2 * partitionSize)));
+    kernelFFT = &sharedResources->getFFT(juce::roundToInt(std::log2(kernelLength)));
+    
+    requestedLowMidFrequency.store(static_cast<float>(lowMidFrequency));
+    requestedMidHighFrequency.store(static_cast<float>(midHighFrequency));
+    
+    // Built here, the engine is ready for the first block
+    if (allocateNow)
+    {
+        std::vector<float> kernelScratch, spectrumScratch;
+        allocate(static_cast<float>(lowMidFrequency), static_cast<float>(midHighFrequency), kernelScratch, spectrumScratch);
+        state.store(State::ready);
+    }
+    
+    designer->add(*this);
+    registeredWithDesigner = true;
+}
+
+void LinearPhaseCrossover::setActive(bool shouldBeActive)
+{
+    // A request made while the designer is still on the previous one waits for the next call
+    auto expected = shouldBeActive ? State::released : State::ready;
+    
+    if (state.compare_exchange_strong(expected, shouldBeActive ? State::building : State::freeing, std::memory_order_acq_rel))
+        designer->notify();
+}
+
+void LinearPhaseCrossover::serviceRequests(std::vector<float>& kernelScratch, std::vector<float>& spectrumScratch)
+{
+    if (state.load(std::memory_order_acquire) == State::freeing)
+    {
+        freeBuffers();
+        state.store(State::released, std::memory_order_release);
+        return;
+    }
+    
+    if (state.load(std::memory_order_acquire) == State::building)
+    {
+        allocate(requestedLowMidFrequency.load(std::memory_order_relaxed), requestedMidHighFrequency.load(std::memory_order_relaxed),
+                 kernelScratch, spectrumScratch);
+        state.store(State::ready, std::memory_order_release);
+    }
+    
+    // The previous design has not been picked up yet; the audio thread wakes the designer when it is
+    if (state.load(std::memory_order_acquire) != State::ready || pendingKernelsReady.load(std::memory_order_acquire))
+        return;
+    
+    const auto lowMid = requestedLowMidFrequency.load(std::memory_order_relaxed);
+    const auto midHigh = requestedMidHighFrequency.load(std::memory_order_relaxed);
+    
+    if (lowMid == designedLowMidFrequency && midHigh == designedMidHighFrequency)
+        return;
+    
+    designKernels(*pendingKernels, lowMid, midHigh, kernelScratch, spectrumScratch);
+    
+    designedLowMidFrequency = lowMid;
+    designedMidHighFrequency = midHigh;
+    pendingKernelsReady.store(true, std::memory_order_release);
+}
+
+void LinearPhaseCrossover::allocate(float lowMidFrequency, float midHighFrequency,
+                                    std::vector<float>& kernelScratch, std::vector<float>& spectrumScratch)
+{
+    fftBuffer.assign(static_cast<size_t>(4 * partitionSize), 0.f);
+    crossfadeBuffer.assign(static_cast<size_t>(partitionSize), 0.f);
+    accumulator.assign(static_cast<size_t>(numBins), {});
+    
+    inputHistory.assign(numChannels, std::vector<float>(static_cast<size_t>(2 * partitionSize), 0.f));
+    frequencyDelayLines.assign(numChannels, std::vector<Complex>(static_cast<size_t>(numPartitions * numBins)));
+    bandOutputs.resize(numChannels);
+    for (auto& outputs : bandOutputs)
+        for (auto& output : outputs)
+            output.assign(static_cast<size_t>(partitionSize), 0.f);
+    
+    for (auto* kernels : { &currentKernels, &previousKernels, &pendingKernels })
+    {
+        *kernels = std::make_unique<KernelSet>();
+        for (auto& spectrum : (*kernels)->spectra)
+            spectrum.assign(static_cast<size_t>(numPartitions * numBins), {});
+    }
+    
+    designKernels(*currentKernels, lowMidFrequency, midHighFrequency, kernelScratch, spectrumScratch);
+    
+    designedLowMidFrequency = lowMidFrequency;
+    designedMidHighFrequency = midHighFrequency;
+    pendingKernelsReady.store(false);
+    
+    fifoPosition = 0;
+    delayLineWriteIndex = 0;
+    crossfading = false;
+}
+
+void LinearPhaseCrossover::freeBuffers()
+{
+    // Assigning empty vectors gives the memory back, where clear() would keep it
+    fftBuffer = {};
+    crossfadeBuffer = {};
+    accumulator = {};
+    inputHistory = {};
+    frequencyDelayLines = {};
+    bandOutputs = {};
+    
+    currentKernels.reset();
+    previousKernels.reset();
+    pendingKernels.reset();
+    pendingKernelsReady.store(false);
+}
+
+void LinearPhaseCrossover::reset()
+{
+    if (! isReady())
+        return;
+    
+    for (auto& history : inputHistory)
+        std::fill(history.begin(), history.end(), 0.f);
+    
+    for (auto& delayLine : frequencyDelayLines)
+        std::fill(delayLine.begin(), delayLine.end(), Complex());
+    
+    for (auto& outputs : bandOutputs)
+        for (auto& output : outputs)
+            std::fill(output.begin(), output.end(), 0.f);
+    
+    fifoPosition = 0;
+    delayLineWriteIndex = 0;
+    crossfading = false;
+}
+
+void LinearPhaseCrossover::setCrossoverFrequencies(double lowMidFrequency, double midHighFrequency)
+{
+    const auto lowMid = static_cast<float>(lowMidFrequency);
+    const auto midHigh = static_cast<float>(midHighFrequency);
+    
+    const auto lowMidMoved = requestedLowMidFrequency.exchange(lowMid, std::memory_order_relaxed) != lowMid;
+    const auto midHighMoved = requestedMidHighFrequency.exchange(midHigh, std::memory_order_relaxed) != midHigh;
+    
+    // The designer sleeps until there is something to redesign
+    if ((lowMidMoved || midHighMoved) && isReady())
+        designer->notify();
+}
+
+void LinearPhaseCrossover::setActiveBands(const std::array<bool, 3>& bands)
+{
+    // Convolving the partition being played out for a newly active band would double
+    // its work for one block; it joins at the next partition instead
+    for (size_t band = 0; band < bands.size(); ++band)
+    {
+        if (! bands[band])
+            liveBands[band] = false;
+    }
+    
+    activeBands = bands;
+}
+
+double LinearPhaseCrossover::getBandMagnitude(size_t band, double frequency, double lowMidFrequency, double midHighFrequency)
+{
+    // Zero-phase Linkwitz-Riley magnitudes: |LP4| = 1 / (1 + (f/fc)^4) and |HP4| = 1 - |LP4|
+    auto lowPass = [frequency](double cutOff)
+    {
+        auto ratio = frequency / cutOff;
+        auto ratio4 = (ratio * ratio) * (ratio * ratio);
+        return 1.0 / (1.0 + ratio4);
+    };
+    
+    const auto lowMid = lowPass(lowMidFrequency);
+    const auto midHigh = lowPass(midHighFrequency);
+    
+    // The three bands sum to exactly 1
+    return band == 0 ? lowMid
+         : band == 1 ? (1.0 - lowMid) * midHigh
+                     : (1.0 - lowMid) * (1.0 - midHigh);
+}
+
+int LinearPhaseCrossover::getKernelLength(double sampleRate)
+{
+    return juce::nextPowerOfTwo(juce::roundToInt(sampleRate * kernelLengthSeconds));
+}
+
+void LinearPhaseCrossover::designBandKernel(size_t band, double sampleRate, double lowMidFrequency, double midHighFrequency,
+                                            const juce::dsp::FFT& kernelFFT, std::vector<float>& kernel)
+{
+    const auto kernelLength = getKernelLength(sampleRate);
+    const auto halfLength = kernelLength / 2;
+    
+    // Real, zero-phase spectrum of this band
+    std::fill(kernel.begin(), kernel.end(), 0.f);
+    for (int bin = 0; bin <= halfLength; ++bin)
+    {
+        auto magnitude = getBandMagnitude(band, bin * sampleRate / kernelLength, lowMidFrequency, midHighFrequency);
+        kernel[static_cast<size_t>(2 * bin)] = static_cast<float>(magnitude);
+        
+        // Mirror for engines that expect the full conjugate-symmetric spectrum
+        if (bin > 0 && bin < halfLength)
+            kernel[static_cast<size_t>(2 * (kernelLength - bin))] = static_cast<float>(magnitude);
+    }
+    
+    kernelFFT.performRealOnlyInverseTransform(kernel.data());
+    
+    // Centre the impulse at halfLength (rotating the zero-phase response) and
+    // window it. The window is 1 at the centre, so the bands still sum to a delay.
+    std::rotate(kernel.begin(), kernel.begin() + halfLength, kernel.begin() + kernelLength);
+    
+    for (int n = 0; n < kernelLength; ++n)
+    {
+        auto phase = juce::MathConstants<double>::twoPi * n / kernelLength;
+        auto window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+        kernel[static_cast<size_t>(n)] *= static_cast<float>(window);
+    }
+}
+
+void LinearPhaseCrossover::designKernels(KernelSet& target, double lowMidFrequency, double midHighFrequency,
+                                         std::vector<float>& kernelScratch, std::vector<float>& spectrumScratch) const
+{
+    // The designer's scratch serves every crossover in the process, whatever its rate
+    // and partition size, so it is sized for this one before each design
+    kernelScratch.resize(static_cast<size_t>(2 * kernelLength));
+    spectrumScratch.resize(static_cast<size_t>(4 * partitionSize));
+    
+    for (size_t band = 0; band < target.spectra.size(); ++band)
+    {
+        designBandKernel(band, sampleRate, lowMidFrequency, midHighFrequency, *kernelFFT, kernelScratch);
+        
+        // Each partition of the kernel as the spectrum of a zero-padded partition
+        auto& spectrum = target.spectra[band];
+        for (int partition = 0; partition < numPartitions; ++partition)
+        {
+            std::fill(spectrumScratch.begin(), spectrumScratch.end(), 0.f);
+            std::copy_n(kernelScratch.begin() + partition * partitionSize, partitionSize, spectrumScratch.begin());
+            
+            partitionFFT->performRealOnlyForwardTransform(spectrumScratch.data(), true);
+            
+            const auto* bins = reinterpret_cast<const Complex*>(spectrumScratch.data());
+            std::copy(bins, bins + numBins, spectrum.begin() + partition * numBins);
+        }
+    }
+}
+
+void LinearPhaseCrossover::convolveBand(const KernelSet& kernels, size_t band, size_t channel, int newestSlot, float* output)
+{
+    std::fill(accumulator.begin(), accumulator.end(), Complex());
+    
+    const auto& delayLine = frequencyDelayLines[channel];
+    const auto& spectrum = kernels.spectra[band];
+    auto* acc = reinterpret_cast<float*>(accumulator.data());
+    
+    // Newest input spectrum against the first kernel partition, and so on back in time
+    for (int partition = 0; partition < numPartitions; ++partition)
+    {
+        auto slot = (newestSlot - partition + numPartitions) % numPartitions;
+        const auto* x = reinterpret_cast<const float*>(delayLine.data() + slot * numBins);
+        const auto* h = reinterpret_cast<const float*>(spectrum.data() + partition * numBins);
+        
+        // Written out by hand so the complex multiply-accumulate vectorises
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            const auto xr = x[2 * bin], xi = x[2 * bin + 1];
+            const auto hr = h[2 * bin], hi = h[2 * bin + 1];
+            acc[2 * bin]     += xr * hr - xi * hi;
+            acc[2 * bin + 1] += xr * hi + xi * hr;
+        }
+    }
+    
+    // Back to the time domain; the second half of the circular result is the valid part
+    const auto fftSize = 2 * partitionSize;
+    std::fill(fftBuffer.begin(), fftBuffer.end(), 0.f);
+    std::copy(acc, acc + 2 * numBins, fftBuffer.begin());
+    for (int bin = 1; bin < partitionSize; ++bin)
+    {
+        fftBuffer[static_cast<size_t>(2 * (fftSize - bin))] = acc[2 * bin];
+        fftBuffer[static_cast<size_t>(2 * (fftSize - bin) + 1)] = -acc[2 * bin + 1];
+    }
+    
+    partitionFFT->performRealOnlyInverseTransform(fftBuffer.data());
+    std::copy(fftBuffer.begin() + partitionSize, fftBuffer.begin() + fftSize, output);
+}
+
+void LinearPhaseCrossover::processPartitions()
+{
+    // Pick up a finished redesign and fade to it over this partition
+    if (pendingKernelsReady.load(std::memory_order_acquire))
+    {
+        std::swap(previousKernels, currentKernels);
+        std::swap(currentKernels, pendingKernels);
+        crossfading = true;
+        pendingKernelsReady.store(false, std::memory_order_release);
+        
+        // The frequencies may have moved again while that design was waiting
+        designer->notify();
+    }
+    
+    for (size_t channel = 0; channel < numChannels; ++channel)
+    {
+        // Spectrum of the last two partitions of input goes into the delay line
+        auto& history = inputHistory[channel];
+        std::fill(fftBuffer.begin(), fftBuffer.end(), 0.f);
+        std::copy(history.begin(), history.end(), fftBuffer.begin());
+        partitionFFT->performRealOnlyForwardTransform(fftBuffer.data(), true);
+        
+        const auto* bins = reinterpret_cast<const Complex*>(fftBuffer.data());
+        std::copy(bins, bins + numBins, frequencyDelayLines[channel].begin() + delayLineWriteIndex * numBins);
+        std::copy(history.begin() + partitionSize, history.end(), history.begin());
+        
+        for (size_t band = 0; band < 3; ++band)
+        {
+            auto* output = bandOutputs[channel][band].data();
+            
+            if (! activeBands[band])
+            {
+                std::fill(output, output + partitionSize, 0.f);
+                continue;
+            }
+            
+            convolveBand(*currentKernels, band, channel, delayLineWriteIndex, output);
+            
+            if (crossfading)
+            {
+                convolveBand(*previousKernels, band, channel, delayLineWriteIndex, crossfadeBuffer.data());
+                
+                for (int i = 0; i < partitionSize; ++i)
+                {
+                    auto fade = float(i + 1) / float(partitionSize);
+                    output[i] = crossfadeBuffer[static_cast<size_t>(i)] + fade * (output[i] - crossfadeBuffer[static_cast<size_t>(i)]);
+                }
+            }
+        }
+    }
+    
+    crossfading = false;
+    delayLineWriteIndex = (delayLineWriteIndex + 1) % numPartitions;
+    liveBands = activeBands;
+}
+
+template <typename SampleType>
+void LinearPhaseCrossover::process(const juce::dsp::AudioBlock<SampleType>& lowBlock,
+                                   const juce::dsp::AudioBlock<SampleType>& midBlock,
+                                   const juce::dsp::AudioBlock<SampleType>& highBlock)
+{
+    const auto channels = juce::jmin(lowBlock.getNumChannels(), numChannels);
+    const auto numSamples = static_cast<int>(lowBlock.getNumSamples());
+    const std::array<const juce::dsp::AudioBlock<SampleType>*, 3> blocks { &lowBlock, &midBlock, &highBlock };
+    
+    // Silence while the designer is still building the engine
+    if (! isReady())
+    {
+        for (auto* block : blocks)
+            block->clear();
+        
+        return;
+    }
+    
+    // Any host block size: stream through the partition-sized input/output buffers
+    for (int start = 0; start < numSamples;)
+    {
+        const auto numToDo = juce::jmin(partitionSize - fifoPosition, numSamples - start);
+        
+        for (size_t channel = 0; channel < channels; ++channel)
+        {
+            const auto* input = lowBlock.getChannelPointer(channel) + start;
+            auto* history = inputHistory[channel].data() + partitionSize + fifoPosition;
+            
+            for (int i = 0; i < numToDo; ++i)
+                history[i] = static_cast<float>(input[i]);
+            
+            for (size_t band = 0; band < 3; ++band)
+            {
+                auto* output = blocks[band]->getChannelPointer(channel) + start;
+                const auto* bandOutput = bandOutputs[channel][band].data() + fifoPosition;
+                
+                for (int i = 0; i < numToDo; ++i)
+                    output[i] = static_cast<SampleType>(bandOutput[i]);
+            }
+        }
+        
+        fifoPosition += numToDo;
+        start += numToDo;
+        
+        if (fifoPosition == partitionSize)
+        {
+            processPartitions();
+            fifoPosition = 0;
+        }
+    }
+}
+
+template void LinearPhaseCrossover::process<float>(const juce::dsp::AudioBlock<float>&,
+                                                   const juce::dsp::AudioBlock<float>&,
+                                                   const juce::dsp::AudioBlock<float>&);
+template void LinearPhaseCrossover::process<double>(const juce::dsp::AudioBlock<double>&,
+                                                    const juce::dsp::AudioBlock<double>&,
+                                                    const juce::dsp::AudioBlock<double>&);
@@ -0,0 +1,164 @@
+//
+//  linearPhaseCrossover.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//  This code has been referenced and adapted from Smith (2011), Wefers (2015) and Zolzer (2011).
+//
+
+#ifndef linearPhaseCrossover_h
+#define linearPhaseCrossover_h
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <complex>
+#include <memory>
+#include <vector>
+#include "sharedResources.h"
+
+// =====================LinearPhaseCrossover========================
+
+// Three-band linear-phase crossover. Each band's FIR kernel has the zero-phase
+// magnitude of the matching Linkwitz-Riley band, so the bands sum back to a pure
+// delay. The kernels run as a uniformly partitioned overlap-save convolution with
+// partitions sized to the host block, sharing one input spectrum between bands.
+// When a crossover moves, a background thread redesigns the kernels and the audio
+// thread crossfades to them over one partition.
+//
+// The kernels, delay lines and history take about 0.7 MB at 48 kHz in stereo and
+// twice that at 96 kHz, so they only exist while the engine is in use. setActive()
+// has the designer build them in the background and free them again. One designer
+// thread serves every crossover in the process, and sleeps until one asks for work.
+class LinearPhaseCrossover
+{
+public:
+    LinearPhaseCrossover();
+    ~LinearPhaseCrossover();
+    
+    // Sizes the engine for spec, so the latency is known. The buffers and the initial
+    // kernels are built here, on the calling thread, only if allocateNow is set;
+    // otherwise they wait for setActive(true).
+    void prepare(const juce::dsp::ProcessSpec& spec, double lowMidFrequency, double midHighFrequency, bool allocateNow);
+    
+    // Frees the buffers and kernels and leaves the designer
+    void release();
+    
+    // Safe to call for every block. Asks the designer to build the engine at the
+    // requested frequencies, or to free it. Until it is built, process() outputs silence.
+    void setActive(bool shouldBeActive);
+    
+    // Whether the buffers and kernels exist and process() is running the convolution
+    bool isReady() const { return state.load(std::memory_order_acquire) == State::ready; }
+    
+    // Clears the convolution history without touching the kernels
+    void reset();
+    
+    // Requests new crossover frequencies; the kernels follow asynchronously
+    void setCrossoverFrequencies(double lowMidFrequency, double midHighFrequency);
+    
+    // Inactive bands aren't convolved and output silence. The shared input spectra
+    // keep running, so a band switched back on needs no catch-up: it stays silent to
+    // the end of the partition being played out, and is exact from the next one.
+    void setActiveBands(const std::array<bool, 3>& bands);
+    
+    // Whether all of band's output since the last call to process() was real output,
+    // rather than the silence of a band that was inactive or is only joining
+    bool isBandLive(size_t band) const { return liveBands[band]; }
+    
+    // Kernel centre delay plus one partition of input buffering
+    int getLatencyInSamples() const { return kernelLength / 2 + partitionSize; }
+    
+    // How long the output keeps going after the (delayed) input stops: the second half of the kernel
+    double getTailLengthSeconds() const { return kernelLength > 0 ? kernelLength / 2 / sampleRate : 0.0; }
+    
+    // Reads the input from lowBlock and writes the three bands to the three blocks
+    template <typename SampleType>
+    void process(const juce::dsp::AudioBlock<SampleType>& lowBlock,
+                 const juce::dsp::AudioBlock<SampleType>& midBlock,
+                 const juce::dsp::AudioBlock<SampleType>& highBlock);
+    
+    // The zero-phase magnitude band 0, 1 or 2 is designed to at frequency, before windowing
+    static double getBandMagnitude(size_t band, double frequency, double lowMidFrequency, double midHighFrequency);
+    
+    // FIR length at sampleRate
+    static int getKernelLength(double sampleRate);
+    
+    // Designs band 0, 1 or 2's FIR into the first getKernelLength() samples of kernel,
+    // windowed and centred, exactly as the engine partitions it. kernelFFT must be of
+    // that length, and kernel twice as long for its real-only transform.
+    static void designBandKernel(size_t band, double sampleRate, double lowMidFrequency, double midHighFrequency,
+                                 const juce::dsp::FFT& kernelFFT, std::vector<float>& kernel);
+    
+    // FIR length is the next power of two above this duration
+    static constexpr double kernelLengthSeconds = 0.1;
+    static constexpr int minimumPartitionSize = 128;
+
+private:
+    using Complex = std::complex<float>;
+    
+    // Partitioned kernel spectra, [band][partition * numBins + bin]
+    struct KernelSet
+    {
+        std::array<std::vector<Complex>, 3> spectra;
+    };
+    
+    class KernelDesigner;
+    
+    // Only the audio thread moves the state from released to building and from ready
+    // to freeing, and only the designer (or prepare and release) moves it on from
+    // those. The audio thread owns the buffers while the state is ready, the designer
+    // while it is building or freeing.
+    enum class State
+    {
+        released,
+        building,
+        ready,
+        freeing
+    };
+    
+    double sampleRate = 44100.0;
+    int kernelLength = 0, partitionSize = 0, numPartitions = 0, numBins = 0;
+    size_t numChannels = 0;
+    
+    // FFT plans come from the process-wide cache
+    juce::SharedResourcePointer<SharedResources> sharedResources;
+    const juce::dsp::FFT* partitionFFT = nullptr;
+    const juce::dsp::FFT* kernelFFT = nullptr;
+    
+    // Audio thread state
+    std::vector<float> fftBuffer, crossfadeBuffer;
+    std::vector<Complex> accumulator;
+    std::vector<std::vector<float>> inputHistory;                   // [previous | current] partition per channel
+    std::vector<std::vector<Complex>> frequencyDelayLines;           // [partition * numBins + bin] per channel
+    std::vector<std::array<std::vector<float>, 3>> bandOutputs;      // one partition per band per channel
+    int fifoPosition = 0, delayLineWriteIndex = 0;
+    bool crossfading = false;
+    std::array<bool, 3> activeBands { true, true, true }, liveBands { true, true, true };
+    
+    // Kernel hand-over. The designer only writes pendingKernels while pendingKernelsReady
+    // is false; the audio thread only rotates the sets while it is true.
+    std::unique_ptr<KernelSet> currentKernels, previousKernels, pendingKernels;
+    std::atomic<bool> pendingKernelsReady { false };
+    std::atomic<float> requestedLowMidFrequency { 0.f }, requestedMidHighFrequency { 0.f };
+    float designedLowMidFrequency = 0.f, designedMidHighFrequency = 0.f;
+    std::atomic<State> state { State::released };
+    
+    juce::SharedResourcePointer<KernelDesigner> designer;
+    bool registeredWithDesigner = false;
+    
+    // Called on the designer thread whenever it wakes
+    void serviceRequests(std::vector<float>& kernelScratch, std::vector<float>& spectrumScratch);
+    
+    void allocate(float lowMidFrequency, float midHighFrequency,
+                  std::vector<float>& kernelScratch, std::vector<float>& spectrumScratch);
+    void freeBuffers();
+    
+    void designKernels(KernelSet& target, double lowMidFrequency, double midHighFrequency,
+                       std::vector<float>& kernelScratch, std::vector<float>& spectrumScratch) const;
+    
+    void processPartitions();
+    void convolveBand(const KernelSet& kernels, size_t band, size_t channel, int newestSlot, float* output);
+};
+
+#endif /* linearPhaseCrossover_h */
@@ -0,0 +1,552 @@
+//
+//  multibandBatch.cpp
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <cmath>
+#include <vector>
+#include <JuceHeader.h>
+
+#include "multibandBatch.h"
+#include "butterworthFilter.h"
+#include "BasicCompressor.h"
+#include "fastMath.h"
+
+namespace
+{
+using Lanes = juce::dsp::SIMDRegister<float>;
+constexpr size_t numLanes = Lanes::SIMDNumElements;
+
+// One value per lane, aligned for loading into and storing from a register
+struct alignas(Lanes::SIMDRegisterSize) LaneValues
+{
+    float values[numLanes];
+};
+
+Lanes select(Lanes::vMaskType mask, Lanes whenTrue, Lanes whenFalse) noexcept
+{
+    return (whenTrue & mask) + (whenFalse & ~mask);
+}
+
+// Coefficients of one biquad section, expanded across the lanes
+struct LaneSection
+{
+    Lanes coefficientA0, coefficientA1, coefficientA2, coefficientB1, coefficientB2;
+
+    void setCoefficients(const std::array<double, 5>& coefficients)
+    {
+        coefficientA0 = Lanes::expand(static_cast<float>(coefficients[0]));
+        coefficientA1 = Lanes::expand(static_cast<float>(coefficients[1]));
+        coefficientA2 = Lanes::expand(static_cast<float>(coefficients[2]));
+        coefficientB1 = Lanes::expand(static_cast<float>(coefficients[3]));
+        coefficientB2 = Lanes::expand(static_cast<float>(coefficients[4]));
+    }
+};
+
+// Previous outputs of one section, one per lane
+struct LaneState
+{
+    Lanes previousSample1, previousSample2;
+};
+
+// BiquadKernel::processSample for every lane at once, run twice per sample like
+// a LinkwitzRFilter
+Lanes processLinkwitzRiley(const LaneSection& section, LaneState& state, Lanes sample) noexcept
+{
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        sample = section.coefficientA0 * sample + section.coefficientA1 * state.previousSample1 + section.coefficientA2 * state.previousSample2
+               - section.coefficientB1 * state.previousSample1 - section.coefficientB2 * state.previousSample2;
+
+        state.previousSample2 = state.previousSample1;
+        state.previousSample1 = sample;
+    }
+
+    return sample;
+}
+}
+
+struct MultibandBatch::Impl
+{
+    //  FC0             FC1
+    enum Section
+    {
+        lowPass1,       allPass2,
+        highPass1,      lowPass2,
+                        highPass2,
+        numSections
+    };
+
+    // Per-lane state for numLanes streams
+    struct LaneGroup
+    {
+        std::array<LaneState, numSections> sections;
+        std::array<Lanes, 3> envelopes;
+    };
+
+    MultibandCore::Settings settings;
+    double sampleRate = 44100.0;
+    int maximumBlockSize = 0;
+
+    // Design the sections exactly as the biquad crossover does
+    std::array<ButterFilter, numSections> designers
+    {
+        ButterFilter(44100.0, FilterType::lowpass), ButterFilter(44100.0, FilterType::allpass),
+        ButterFilter(44100.0, FilterType::highpass), ButterFilter(44100.0, FilterType::lowpass),
+        ButterFilter(44100.0, FilterType::highpass)
+    };
+    std::array<LaneSection, numSections> sections;
+    bool sectionsNeedDouble = false;
+
+    // Compressor coefficients, shared by every lane, and where each envelope rests in silence
+    std::array<Lanes, 3> alphaAttack, alphaRelease, restingEnvelopes;
+
+    std::vector<LaneGroup> groups;
+    std::vector<Lanes> inputLanes;
+    std::array<std::vector<Lanes>, 3> bandLanes;
+
+    // Stream by stream path, for settings the lanes can't run
+    std::vector<std::unique_ptr<MultibandCore>> cores;
+    bool usingLanes = true;
+
+    bool canUseLanes() const
+    {
+        // The lanes' detector runs on every sample
+        for (const auto& bandSettings : settings.bands)
+        {
+            if (bandSettings.detectorDecimation > 1)
+                return false;
+        }
+
+        return settings.crossoverMode == MultibandCore::CrossoverMode::biquad && ! sectionsNeedDouble;
+    }
+
+    bool isBandAudible(size_t band) const
+    {
+        for (const auto& bandSettings : settings.bands)
+        {
+            if (bandSettings.soloed)
+                return settings.bands[band].soloed;
+        }
+
+        return ! settings.bands[band].muted;
+    }
+
+    void designSections();
+    void resetLanes();
+    void processLanes(float* const* streams, int numStreams, int numSamples);
+    void processGroup(float* const* streams, int numStreams, size_t group, size_t start, size_t numSamples);
+    void compressBand(size_t band, Lanes& envelope, size_t numSamples);
+
+    template <typename GainComputer>
+    void compressBandWith(size_t band, Lanes& envelope, size_t numSamples);
+    void processCores(float* const* streams, int numStreams, int numSamples);
+};
+
+MultibandBatch::MultibandBatch() : impl(std::make_unique<Impl>())
+{
+}
+
+MultibandBatch::~MultibandBatch() = default;
+
+int MultibandBatch::getNumLanes()
+{
+    return static_cast<int>(numLanes);
+}
+
+void MultibandBatch::prepare(double sampleRate, int maximumBlockSize, int maximumNumStreams)
+{
+    auto& batch = *impl;
+
+    batch.sampleRate = sampleRate;
+    batch.maximumBlockSize = maximumBlockSize;
+
+    juce::dsp::ProcessSpec spec;
+    spec.sampleRate = sampleRate;
+    spec.maximumBlockSize = static_cast<juce::uint32>(maximumBlockSize);
+    spec.numChannels = 1;
+
+    for (auto& designer : batch.designers)
+        designer.prepare(spec);
+
+    const auto numGroups = (static_cast<size_t>(maximumNumStreams) + numLanes - 1) / numLanes;
+    batch.groups.resize(numGroups);
+    batch.inputLanes.resize(static_cast<size_t>(maximumBlockSize));
+
+    for (auto& lanes : batch.bandLanes)
+        lanes.resize(static_cast<size_t>(maximumBlockSize));
+
+    batch.cores.clear();
+    batch.cores.resize(static_cast<size_t>(maximumNumStreams));
+
+    setSettings(batch.settings);
+    batch.usingLanes = batch.canUseLanes();
+    reset();
+}
+
+void MultibandBatch::reset()
+{
+    impl->resetLanes();
+
+    for (auto& core : impl->cores)
+    {
+        if (core != nullptr)
+            core->reset();
+    }
+}
+
+void MultibandBatch::setSettings(const MultibandCore::Settings& newSettings)
+{
+    auto& batch = *impl;
+    batch.settings = newSettings;
+    batch.designSections();
+
+    // The same expressions as BasicCompressor, so every lane gets the stream's coefficients
+    for (size_t band = 0; band < newSettings.bands.size(); ++band)
+    {
+        const auto& bandSettings = newSettings.bands[band];
+        batch.alphaAttack[band] = Lanes::expand(static_cast<float>(std::exp(-1.0f / (bandSettings.attackMs * batch.sampleRate / 1000.0f))));
+        batch.alphaRelease[band] = Lanes::expand(static_cast<float>(std::exp(-1.0f / (bandSettings.releaseMs * batch.sampleRate / 1000.0f))));
+        batch.restingEnvelopes[band] = Lanes::expand(BasicCompressor::computeGainChangeDb(static_cast<BasicCompressor::Mode>(bandSettings.mode),
+                                                                                          BasicCompressor::silenceLevelDb,
+                                                                                          bandSettings.thresholdDb, bandSettings.ratio));
+    }
+
+    for (auto& core : batch.cores)
+    {
+        if (core != nullptr)
+            core->setSettings(newSettings);
+    }
+}
+
+const MultibandCore::Settings& MultibandBatch::getSettings() const
+{
+    return impl->settings;
+}
+
+void MultibandBatch::process(float* const* streams, int numStreams, int numSamples)
+{
+    auto& batch = *impl;
+    numStreams = juce::jmin(numStreams, static_cast<int>(batch.cores.size()));
+
+    // Whichever path takes over starts from rest. The fallback cores are dropped
+    // rather than kept idle, since a linear-phase core holds its kernels until it
+    // processes again.
+    const auto useLanes = batch.canUseLanes();
+    if (useLanes != batch.usingLanes)
+    {
+        batch.usingLanes = useLanes;
+
+        if (useLanes)
+        {
+            for (auto& core : batch.cores)
+                core = nullptr;
+        }
+
+        reset();
+    }
+
+    if (useLanes)
+        batch.processLanes(streams, numStreams, numSamples);
+    else
+        batch.processCores(streams, numStreams, numSamples);
+}
+
+void MultibandBatch::Impl::designSections()
+{
+    const auto lowMidCutoff = static_cast<double>(settings.lowMidFrequency);
+    const auto midHighCutoff = static_cast<double>(settings.midHighFrequency);
+
+    designers[lowPass1].setFilterParameters(lowMidCutoff, 0.707, FilterType::lowpass);
+    designers[highPass1].setFilterParameters(lowMidCutoff, 0.707, FilterType::highpass);
+    designers[allPass2].setFilterParameters(midHighCutoff, 0.707, FilterType::allpass);
+    designers[lowPass2].setFilterParameters(midHighCutoff, 0.707, FilterType::lowpass);
+    designers[highPass2].setFilterParameters(midHighCutoff, 0.707, FilterType::highpass);
+
+    sectionsNeedDouble = false;
+    for (size_t section = 0; section < designers.size(); ++section)
+    {
+        sections[section].setCoefficients(designers[section].getCoefficients());
+        sectionsNeedDouble = sectionsNeedDouble || designers[section].isUsingDoublePrecision();
+    }
+}
+
+void MultibandBatch::Impl::resetLanes()
+{
+    const auto zero = Lanes::expand(0.f);
+
+    for (auto& group : groups)
+    {
+        for (auto& state : group.sections)
+            state.previousSample1 = state.previousSample2 = zero;
+
+        group.envelopes = restingEnvelopes;
+    }
+}
+
+void MultibandBatch::Impl::processLanes(float* const* streams, int numStreams, int numSamples)
+{
+    const auto blockSize = static_cast<size_t>(juce::jmax(1, maximumBlockSize));
+    const auto numGroups = (static_cast<size_t>(numStreams) + numLanes - 1) / numLanes;
+
+    for (size_t start = 0; start < static_cast<size_t>(numSamples); start += blockSize)
+    {
+        const auto length = juce::jmin(blockSize, static_cast<size_t>(numSamples) - start);
+
+        for (size_t group = 0; group < numGroups; ++group)
+            processGroup(streams, numStreams, group, start, length);
+    }
+}
+
+void MultibandBatch::Impl::processGroup(float* const* streams, int numStreams, size_t group, size_t start, size_t numSamples)
+{
+    auto& laneGroup = groups[group];
+    const auto firstStream = group * numLanes;
+    const auto numGroupStreams = juce::jmin(numLanes, static_cast<size_t>(numStreams) - firstStream);
+
+    // Interleave the group's streams, one sample of each per register; unused lanes run silence
+    auto* input = reinterpret_cast<float*>(inputLanes.data());
+    for (size_t lane = 0; lane < numLanes; ++lane)
+    {
+        const auto* stream = lane < numGroupStreams ? streams[firstStream + lane] + start : nullptr;
+
+        for (size_t i = 0; i < numSamples; ++i)
+            input[i * numLanes + lane] = stream != nullptr ? stream[i] : 0.f;
+    }
+
+    // Culled bands don't run, nor do the sections that only feed them
+    std::array<bool, 3> audible {};
+    for (size_t band = 0; band < audible.size(); ++band)
+        audible[band] = isBandAudible(band);
+
+    auto& states = laneGroup.sections;
+    const auto zero = Lanes::expand(0.f);
+
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        const auto sample = inputLanes[i];
+        auto low = zero, mid = zero, high = zero;
+
+        if (audible[0])
+            low = processLinkwitzRiley(sections[allPass2], states[allPass2],
+                                       processLinkwitzRiley(sections[lowPass1], states[lowPass1], sample));
+
+        if (audible[1] || audible[2])
+        {
+            const auto rest = processLinkwitzRiley(sections[highPass1], states[highPass1], sample);
+
+            if (audible[1])
+                mid = processLinkwitzRiley(sections[lowPass2], states[lowPass2], rest);
+
+            if (audible[2])
+                high = processLinkwitzRiley(sections[highPass2], states[highPass2], rest);
+        }
+
+        bandLanes[0][i] = low;
+        bandLanes[1][i] = mid;
+        bandLanes[2][i] = high;
+    }
+
+    // Culled bands restart from rest, as in the core
+    auto clearIfUnused = [&states, zero](Section section, bool used)
+    {
+        if (! used)
+            states[section].previousSample1 = states[section].previousSample2 = zero;
+    };
+
+    clearIfUnused(lowPass1, audible[0]);
+    clearIfUnused(allPass2, audible[0]);
+    clearIfUnused(highPass1, audible[1] || audible[2]);
+    clearIfUnused(lowPass2, audible[1]);
+    clearIfUnused(highPass2, audible[2]);
+
+    for (size_t band = 0; band < bandLanes.size(); ++band)
+    {
+        if (! audible[band])
+            laneGroup.envelopes[band] = restingEnvelopes[band];
+        else if (! settings.bands[band].bypassed)
+            compressBand(band, laneGroup.envelopes[band], numSamples);
+    }
+
+    // Sum the bands and write each lane back to its stream
+    for (size_t i = 0; i < numSamples; ++i)
+        inputLanes[i] = zero + bandLanes[0][i] + bandLanes[1][i] + bandLanes[2][i];
+
+    for (size_t lane = 0; lane < numGroupStreams; ++lane)
+    {
+        auto* stream = streams[firstStream + lane] + start;
+
+        for (size_t i = 0; i < numSamples; ++i)
+            stream[i] = input[i * numLanes + lane];
+    }
+}
+
+void MultibandBatch::Impl::compressBand(size_t band, Lanes& envelope, size_t numSamples)
+{
+    // One specialised loop per mode, as in BasicCompressor::process
+    switch (settings.bands[band].mode)
+    {
+        case MultibandCore::DynamicsMode::downwardCompression: compressBandWith<GainComputers::DownwardCompression>(band, envelope, numSamples); break;
+        case MultibandCore::DynamicsMode::upwardCompression:   compressBandWith<GainComputers::UpwardCompression>(band, envelope, numSamples); break;
+        case MultibandCore::DynamicsMode::downwardExpansion:   compressBandWith<GainComputers::DownwardExpansion>(band, envelope, numSamples); break;
+        case MultibandCore::DynamicsMode::gate:                compressBandWith<GainComputers::Gate>(band, envelope, numSamples); break;
+    }
+}
+
+template <typename GainComputer>
+void MultibandBatch::Impl::compressBandWith(size_t band, Lanes& envelope, size_t numSamples)
+{
+    const auto& bandSettings = settings.bands[band];
+    const auto thresholdLevelDb = bandSettings.thresholdDb;
+    const auto slope = GainComputer::slope(bandSettings.ratio);
+    const auto one = Lanes::expand(1.f);
+    auto& lanes = bandLanes[band];
+
+    LaneValues samples, levelDifferences, gains;
+
+    // The block pre-scan of BasicCompressor, decided lane by lane as each stream's
+    // core would: a settled lane whose peak stays where the gain change is flat gets
+    // one constant gain, and its envelope is advanced in one step
+    std::array<bool, numLanes> flat {};
+    LaneValues flatGains, flatEnvelopes;
+    size_t numFlat = 0;
+
+    if constexpr (GainComputer::flatBelowThreshold)
+    {
+        LaneValues restingLevels, attackAlphas, releaseAlphas, alphasTowardsRest, peaks {};
+        envelope.copyToRawArray(flatEnvelopes.values);
+        restingEnvelopes[band].copyToRawArray(restingLevels.values);
+
+        alphaAttack[band].copyToRawArray(attackAlphas.values);
+        alphaRelease[band].copyToRawArray(releaseAlphas.values);
+
+        std::array<bool, numLanes> stalled {};
+        auto anySettled = false;
+
+        for (size_t lane = 0; lane < numLanes; ++lane)
+        {
+            const auto restingLevel = restingLevels.values[lane];
+            const auto laneEnvelope = flatEnvelopes.values[lane];
+            const auto attacking = GainComputer::attacksOnRisingLevel ? restingLevel > laneEnvelope : restingLevel < laneEnvelope;
+            const auto alpha = attacking ? attackAlphas.values[lane] : releaseAlphas.values[lane];
+
+            stalled[lane] = alpha * laneEnvelope + (1.f - alpha) * restingLevel == laneEnvelope;
+            flat[lane] = stalled[lane] || std::abs(laneEnvelope - restingLevel) < 0.0001f;
+            anySettled = anySettled || flat[lane];
+            alphasTowardsRest.values[lane] = alpha;
+        }
+
+        if (anySettled)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                lanes[i].copyToRawArray(samples.values);
+
+                for (size_t lane = 0; lane < numLanes; ++lane)
+                    peaks.values[lane] = juce::jmax(peaks.values[lane], std::abs(samples.values[lane]));
+            }
+
+            for (size_t lane = 0; lane < numLanes; ++lane)
+            {
+                const auto restingLevel = restingLevels.values[lane];
+                const auto peakLevelInDecibels = FastMath::gainToDecibels(peaks.values[lane], BasicCompressor::silenceLevelDb);
+                flat[lane] = flat[lane] && GainComputer::gainChangeDb(peakLevelInDecibels, thresholdLevelDb, slope) == restingLevel;
+
+                if (! flat[lane])
+                    continue;
+
+                auto& laneEnvelope = flatEnvelopes.values[lane];
+                flatGains.values[lane] = FastMath::decibelsToGain(0.0f - laneEnvelope);
+
+                if (! stalled[lane])
+                    laneEnvelope = restingLevel + (laneEnvelope - restingLevel) * std::pow(alphasTowardsRest.values[lane], static_cast<float>(numSamples));
+
+                ++numFlat;
+            }
+        }
+    }
+
+    if (numFlat == numLanes)
+    {
+        const auto gain = Lanes::fromRawArray(flatGains.values);
+        for (size_t i = 0; i < numSamples; ++i)
+            lanes[i] = lanes[i] * gain;
+
+        envelope = Lanes::fromRawArray(flatEnvelopes.values);
+        return;
+    }
+
+    // The identity fast path of BasicCompressor, taken once every lane has released
+    if (GainComputer::usesRatio && bandSettings.ratio == 1.f)
+    {
+        envelope.copyToRawArray(gains.values);
+
+        auto released = true;
+        for (size_t lane = 0; lane < numLanes; ++lane)
+            released = released && std::abs(gains.values[lane]) < 0.0001f;
+
+        if (released)
+        {
+            envelope = Lanes::expand(0.f);
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        lanes[i].copyToRawArray(samples.values);
+
+        // The level and gain computer of BasicCompressor::process, lane by lane
+        for (size_t lane = 0; lane < numLanes; ++lane)
+        {
+            const auto inputLevelInDecibels = FastMath::gainToDecibels(std::abs(samples.values[lane]), BasicCompressor::silenceLevelDb);
+            levelDifferences.values[lane] = GainComputer::gainChangeDb(inputLevelInDecibels, thresholdLevelDb, slope);
+        }
+
+        // The attack/release envelope runs in the register
+        const auto levelDifference = Lanes::fromRawArray(levelDifferences.values);
+        const auto attacking = GainComputer::attacksOnRisingLevel ? Lanes::greaterThan(levelDifference, envelope)
+                                                                  : Lanes::lessThan(levelDifference, envelope);
+        envelope = select(attacking,
+                          alphaAttack[band] * envelope + (one - alphaAttack[band]) * levelDifference,
+                          alphaRelease[band] * envelope + (one - alphaRelease[band]) * levelDifference);
+
+        envelope.copyToRawArray(gains.values);
+
+        for (size_t lane = 0; lane < numLanes; ++lane)
+            gains.values[lane] = flat[lane] ? flatGains.values[lane] : FastMath::decibelsToGain(-gains.values[lane]);
+
+        lanes[i] = lanes[i] * Lanes::fromRawArray(gains.values);
+    }
+
+    // The flat lanes ran through the loop above only to keep it branch-free
+    if (numFlat > 0)
+    {
+        envelope.copyToRawArray(gains.values);
+
+        for (size_t lane = 0; lane < numLanes; ++lane)
+            gains.values[lane] = flat[lane] ? flatEnvelopes.values[lane] : gains.values[lane];
+
+        envelope = Lanes::fromRawArray(gains.values);
+    }
+}
+
+void MultibandBatch::Impl::processCores(float* const* streams, int numStreams, int numSamples)
+{
+    for (size_t stream = 0; stream < static_cast<size_t>(numStreams); ++stream)
+    {
+        auto& core = cores[stream];
+
+        if (core == nullptr)
+        {
+            core = std::make_unique<MultibandCore>();
+            core->setSettings(settings);
+            core->prepare(sampleRate, maximumBlockSize, 1);
+        }
+
+        core->process(streams + stream, 1, numSamples);
+    }
+}
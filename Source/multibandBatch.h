@@ -0,0 +1,61 @@
+//
+//  multibandBatch.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef multibandBatch_h
+#define multibandBatch_h
+#include <memory>
+#include "multibandCore.h"
+
+// =====================MultibandBatch========================
+
+// Runs many independent mono streams through identical MultibandCore settings at
+// once. Streams are packed into the lanes of a SIMD register: every lane keeps its
+// own filter and envelope state, and all lanes share the coefficients, so one pass
+// of the biquad crossover and the compressor detector serves getNumLanes() streams.
+//
+// The lanes reproduce the biquad crossover with float sections. Settings the lanes
+// can't run (the TPT and linear-phase engines, a crossover low enough to need the
+// double precision sections, or a control-rate detector) go through one
+// MultibandCore per stream instead, created on first use. Their linear-phase
+// engines share the process's one kernel designer thread. Stream n keeps its state
+// between process calls, so pass the streams in the same order every time, and
+// reset() before a new batch.
+//
+// The lanes ignore Settings::timeParallelBiquads, which vectorises one stream along
+// time: they already fill the register across streams, and match a core with it off.
+class MultibandBatch
+{
+public:
+    MultibandBatch();
+    ~MultibandBatch();
+
+    // Streams processed side by side in one pass: the float width of the SIMD
+    // instruction set the plugin is built for (4 for SSE and NEON, 8 for AVX)
+    static int getNumLanes();
+
+    // Allocates for up to maximumNumStreams streams and maximumBlockSize samples per
+    // internal pass
+    void prepare(double sampleRate, int maximumBlockSize, int maximumNumStreams);
+
+    // Clears every stream's filters and envelopes
+    void reset();
+
+    // Shared by every stream. Mute and solo apply without the core's ramps, since a
+    // batch normally keeps one set of settings for the whole run.
+    void setSettings(const MultibandCore::Settings& newSettings);
+    const MultibandCore::Settings& getSettings() const;
+
+    // Processes numSamples of each of the first numStreams streams in place
+    void process(float* const* streams, int numStreams, int numSamples);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif /* multibandBatch_h */
@@ -0,0 +1,479 @@
+//
+//  multibandCore.cpp
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <cmath>
+#include <JuceHeader.h>
+
+#include "multibandCore.h"
+#include "BasicCompressor.h"
+#include "butterworthFilter.h"
+#include "tptCrossover.h"
+#include "linearPhaseCrossover.h"
+
+static_assert(MultibandCore::maximumDetectorDecimation == BasicCompressor::maximumDetectorDecimation,
+              "the core passes detectorDecimation straight to the compressors");
+
+struct MultibandCore::Impl
+{
+    Impl() : LP1(44100.0), AP2(44100.0), HP1(44100.0), LP2(44100.0), HP2(44100.0)
+    {
+        LP1.setType(FilterType::lowpass);
+        HP1.setType(FilterType::highpass);
+        AP2.setType(FilterType::allpass);
+        LP2.setType(FilterType::lowpass);
+        HP2.setType(FilterType::highpass);
+    }
+
+    Settings settings;
+    CrossoverMode activeMode = CrossoverMode::biquad;
+    double sampleRate = 44100.0;
+    int maximumBlockSize = 0;
+    size_t numChannels = 0;
+
+    //      FC0     FC1
+    LinkwitzRFilter LP1,    AP2,
+                    HP1,    LP2,
+                            HP2;
+
+    // Alternative zero-delay-feedback engine
+    //              FC0                 FC1
+    TPTCrossover    lowMidCrossover,    midHighAllPass,
+                                        midHighCrossover;
+
+    // FIR engine with Linkwitz-Riley magnitudes and no phase shift, at the cost of latency
+    LinearPhaseCrossover linearPhaseCrossover;
+
+    std::array<BasicCompressor, 3> compressors;
+
+    std::array<juce::AudioBuffer<float>, 3> bandBuffers;
+    std::array<juce::AudioBuffer<double>, 3> doubleBandBuffers;
+
+    // Each band's gain in the sum ramps to 1 while it is audible and to 0 when it is
+    // muted or another band is soloed; bands at 0 are culled
+    std::array<float, 3> bandGains { 1.f, 1.f, 1.f };
+    float bandGainStep = 1.f;
+    static constexpr double bandGainRampSeconds = 0.01;
+
+    // How far below their peak the crossovers' impulse responses count as rung out;
+    // the plugin's silence threshold is -120 dBFS
+    static constexpr double tailLevelDb = -120.0;
+
+    template <typename SampleType>
+    std::array<juce::AudioBuffer<SampleType>, 3>& getBandBuffers()
+    {
+        if constexpr (std::is_same_v<SampleType, double>)
+            return doubleBandBuffers;
+        else
+            return bandBuffers;
+    }
+
+    bool isBandAudible(size_t band) const
+    {
+        // If any band is soloed only the soloed bands are heard, otherwise every unmuted band
+        for (const auto& bandSettings : settings.bands)
+        {
+            if (bandSettings.soloed)
+                return settings.bands[band].soloed;
+        }
+
+        return ! settings.bands[band].muted;
+    }
+
+    // Running peak and sum of squares of the output, in the block's sample type
+    template <typename SampleType>
+    struct LevelSums
+    {
+        SampleType peak = 0, sumOfSquares = 0;
+    };
+
+    template <typename SampleType>
+    OutputLevels process(SampleType* const* channels, int numChannelsToProcess, int numSamples, const SampleType* outputGains);
+
+    template <typename SampleType>
+    void splitAndCompress(juce::dsp::AudioBlock<SampleType>& block, const SampleType* outputGains, LevelSums<SampleType>& levels);
+
+    // Writes the weighted sum of the bands times the output gain into block, in one
+    // pass that also ramps the band weights and measures the result
+    template <typename SampleType>
+    void sumBands(juce::dsp::AudioBlock<SampleType>& block,
+                  const std::array<juce::dsp::AudioBlock<SampleType>, 3>& bandBlocks,
+                  const std::array<bool, 3>& audible,
+                  const SampleType* outputGains,
+                  LevelSums<SampleType>& levels);
+};
+
+MultibandCore::MultibandCore() : impl(std::make_unique<Impl>())
+{
+}
+
+MultibandCore::~MultibandCore() = default;
+
+void MultibandCore::prepare(double sampleRate, int maximumBlockSize, int numChannels, bool useDoublePrecision)
+{
+    auto& core = *impl;
+    const auto& settings = core.settings;
+
+    juce::dsp::ProcessSpec spec;
+    spec.sampleRate = sampleRate;
+    spec.maximumBlockSize = static_cast<juce::uint32>(maximumBlockSize);
+    spec.numChannels = static_cast<juce::uint32>(numChannels);
+
+    core.sampleRate = sampleRate;
+    core.maximumBlockSize = maximumBlockSize;
+    core.numChannels = static_cast<size_t>(numChannels);
+
+    for (auto& compressor : core.compressors)
+        compressor.prepare(spec);
+
+    for (auto* filter : { &core.LP1, &core.HP1, &core.AP2, &core.LP2, &core.HP2 })
+        filter->prepare(spec);
+
+    // Start the TPT crossovers at the current frequencies rather than ramping in
+    core.lowMidCrossover.prepare(spec);
+    core.midHighAllPass.prepare(spec);
+    core.midHighCrossover.prepare(spec);
+
+    core.lowMidCrossover.setCrossoverFrequency(settings.lowMidFrequency);
+    core.midHighAllPass.setCrossoverFrequency(settings.midHighFrequency);
+    core.midHighCrossover.setCrossoverFrequency(settings.midHighFrequency);
+
+    // Builds the linear-phase engine here, off the audio thread, only if it is the
+    // selected mode; otherwise the designer builds it when it is first selected
+    core.linearPhaseCrossover.prepare(spec, settings.lowMidFrequency, settings.midHighFrequency,
+                                      settings.crossoverMode == CrossoverMode::linearPhase);
+
+    for (auto& buffer : core.bandBuffers)
+        buffer.setSize(numChannels, useDoublePrecision ? 0 : maximumBlockSize);
+
+    for (auto& buffer : core.doubleBandBuffers)
+        buffer.setSize(numChannels, useDoublePrecision ? maximumBlockSize : 0);
+
+    core.bandGainStep = static_cast<float>(1.0 / (Impl::bandGainRampSeconds * sampleRate));
+    for (size_t band = 0; band < core.bandGains.size(); ++band)
+        core.bandGains[band] = core.isBandAudible(band) ? 1.f : 0.f;
+
+    core.activeMode = settings.crossoverMode;
+
+    // Preparing the compressors recalculates their time constants from the old spec
+    setSettings(settings);
+    reset();
+}
+
+bool MultibandCore::isLinearPhaseReady() const
+{
+    return impl->linearPhaseCrossover.isReady();
+}
+
+void MultibandCore::release()
+{
+    impl->linearPhaseCrossover.release();
+}
+
+void MultibandCore::reset()
+{
+    auto& core = *impl;
+
+    for (auto* filter : { &core.LP1, &core.HP1, &core.AP2, &core.LP2, &core.HP2 })
+        filter->reset();
+
+    core.lowMidCrossover.reset();
+    core.midHighAllPass.reset();
+    core.midHighCrossover.reset();
+
+    core.linearPhaseCrossover.reset();
+
+    for (auto& compressor : core.compressors)
+        compressor.reset();
+}
+
+void MultibandCore::setSettings(const Settings& newSettings)
+{
+    auto& core = *impl;
+    core.settings = newSettings;
+
+    for (size_t band = 0; band < core.compressors.size(); ++band)
+    {
+        const auto& bandSettings = newSettings.bands[band];
+        auto& compressor = core.compressors[band];
+
+        compressor.setAttackTime(bandSettings.attackMs);
+        compressor.setReleaseTime(bandSettings.releaseMs);
+        compressor.setThresholdLevel(bandSettings.thresholdDb);
+        compressor.setCompressionRatio(bandSettings.ratio);
+        compressor.setMode(static_cast<BasicCompressor::Mode>(bandSettings.mode)); // listed in the same order
+        compressor.setDetectorDecimation(bandSettings.detectorDecimation);
+    }
+
+    for (auto* filter : { &core.LP1, &core.HP1, &core.AP2, &core.LP2, &core.HP2 })
+        filter->setTimeParallel(newSettings.timeParallelBiquads);
+}
+
+const MultibandCore::Settings& MultibandCore::getSettings() const
+{
+    return impl->settings;
+}
+
+int MultibandCore::getLatencySamples(CrossoverMode mode) const
+{
+    // Only the linear-phase engine adds any
+    return mode == CrossoverMode::linearPhase ? impl->linearPhaseCrossover.getLatencyInSamples() : 0;
+}
+
+int MultibandCore::getLatencySamples() const
+{
+    return getLatencySamples(impl->settings.crossoverMode);
+}
+
+double MultibandCore::getTailLengthSeconds(double lowestCrossoverFrequency) const
+{
+    // The lowest crossover rings longest. Each biquad section runs twice per sample
+    // through one state, and that recursion's poles sit far closer to 1 than an ideal
+    // Butterworth pair's: at 20 Hz it takes about 0.59 s to fall 120 dB. The TPT sections have the ideal poles and die away sooner. The linear-phase tail
+    // follows the kernel.
+    auto ringSamples = 0;
+
+    for (auto type : { FilterType::lowpass, FilterType::highpass, FilterType::allpass })
+    {
+        ButterFilter section(impl->sampleRate, type);
+        section.setFilterParameters(lowestCrossoverFrequency, 0.707, type);
+        ringSamples = juce::jmax(ringSamples, section.getDecaySamples(Impl::tailLevelDb, 2));
+    }
+
+    return juce::jmax(ringSamples / impl->sampleRate, impl->linearPhaseCrossover.getTailLengthSeconds());
+}
+
+float MultibandCore::getGainReductionDb(int band) const
+{
+    return impl->compressors[static_cast<size_t>(band)].getGainReductionDb();
+}
+
+float MultibandCore::getRestingGainReductionDb(int band) const
+{
+    return impl->compressors[static_cast<size_t>(band)].getRestingGainReductionDb();
+}
+
+template <typename SampleType>
+MultibandCore::OutputLevels MultibandCore::Impl::process(SampleType* const* channels, int numChannelsToProcess, int numSamples,
+                                                         const SampleType* outputGains)
+{
+    // Switching engines: start the linear-phase history clean
+    if (settings.crossoverMode != activeMode)
+    {
+        activeMode = settings.crossoverMode;
+        linearPhaseCrossover.reset();
+    }
+
+    // The linear-phase engine's memory is given back in the background once it is left
+    if (activeMode != CrossoverMode::linearPhase)
+        linearPhaseCrossover.setActive(false);
+
+    const auto channelCount = juce::jmin(static_cast<size_t>(numChannelsToProcess), numChannels);
+    auto block = juce::dsp::AudioBlock<SampleType>(channels, channelCount, static_cast<size_t>(numSamples));
+    const auto blockSize = static_cast<size_t>(juce::jmax(1, maximumBlockSize));
+
+    LevelSums<SampleType> levels;
+
+    for (size_t start = 0; start < block.getNumSamples(); start += blockSize)
+    {
+        auto subBlock = block.getSubBlock(start, juce::jmin(blockSize, block.getNumSamples() - start));
+        splitAndCompress(subBlock, outputGains != nullptr ? outputGains + start : nullptr, levels);
+    }
+
+    const auto numValues = static_cast<SampleType>(juce::jmax(static_cast<size_t>(1), channelCount * block.getNumSamples()));
+    return { static_cast<float>(levels.peak), static_cast<float>(levels.sumOfSquares / numValues) };
+}
+
+template <typename SampleType>
+void MultibandCore::Impl::splitAndCompress(juce::dsp::AudioBlock<SampleType>& block, const SampleType* outputGains,
+                                           LevelSums<SampleType>& levels)
+{
+    auto& buffers = getBandBuffers<SampleType>();
+
+    // Create AudioBlocks over the front of the band buffers, sized to this block
+    const auto numSamples = block.getNumSamples();
+    const auto channelCount = block.getNumChannels();
+
+    auto bandBlock = [numSamples, channelCount](auto& bandBuffer)
+    {
+        return juce::dsp::AudioBlock<SampleType>(bandBuffer).getSubsetChannelBlock(0, channelCount).getSubBlock(0, numSamples);
+    };
+
+    auto lowBlock = bandBlock(buffers[0]);
+    auto midBlock = bandBlock(buffers[1]);
+    auto highBlock = bandBlock(buffers[2]);
+
+    // A band that is neither heard nor still fading out is culled: its compressor
+    // doesn't run, and neither do the filters that only feed it. Skipped filters are
+    // kept cleared, so they re-converge from rest behind the fade-in on unmute.
+    std::array<bool, 3> audible {}, needed {};
+    for (size_t band = 0; band < audible.size(); ++band)
+    {
+        audible[band] = isBandAudible(band);
+        needed[band] = audible[band] || bandGains[band] > 0.f;
+    }
+
+    // Copy the input into every band
+    lowBlock.copyFrom(block);
+    midBlock.copyFrom(block);
+    highBlock.copyFrom(block);
+
+    const auto lowMidCutoff = static_cast<double>(settings.lowMidFrequency);
+    const auto midHighCutoff = static_cast<double>(settings.midHighFrequency);
+
+    if (activeMode == CrossoverMode::linearPhase)
+    {
+        // Kernels are redesigned in the background and crossfaded in. On first use the
+        // engine is built in the background too, and outputs silence until it is ready.
+        linearPhaseCrossover.setCrossoverFrequencies(lowMidCutoff, midHighCutoff);
+        linearPhaseCrossover.setActive(true);
+        linearPhaseCrossover.setActiveBands(needed);
+
+        // A band coming back is silent until the next partition, so its fade-in waits
+        // for the first block that is all real output
+        for (size_t band = 0; band < audible.size(); ++band)
+            audible[band] = audible[band] && linearPhaseCrossover.isBandLive(band);
+
+        linearPhaseCrossover.process(lowBlock, midBlock, highBlock);
+    }
+    else if (activeMode == CrossoverMode::topologyPreserving)
+    {
+        // Targets only; the TPT crossovers ramp the cutoff per sample themselves
+        lowMidCrossover.setCrossoverFrequency(lowMidCutoff);
+        midHighAllPass.setCrossoverFrequency(midHighCutoff);
+        midHighCrossover.setCrossoverFrequency(midHighCutoff);
+
+        // Low/rest split, allpass-compensate the low band, then mid/high split
+        if (needed[0] || needed[1] || needed[2])
+            lowMidCrossover.processSplit(lowBlock, midBlock);
+        else
+            lowMidCrossover.reset();
+
+        if (needed[0])
+            midHighAllPass.processAllPass(lowBlock);
+        else
+            midHighAllPass.reset();
+
+        if (needed[1] || needed[2])
+            midHighCrossover.processSplit(midBlock, highBlock);
+        else
+            midHighCrossover.reset();
+    }
+    else
+    {
+        LP1.setCrossoverFrequency(lowMidCutoff);
+        HP1.setCrossoverFrequency(lowMidCutoff);
+        AP2.setCrossoverFrequency(midHighCutoff);
+        LP2.setCrossoverFrequency(midHighCutoff);
+        HP2.setCrossoverFrequency(midHighCutoff);
+
+        auto lowContext = juce::dsp::ProcessContextReplacing<SampleType>(lowBlock);
+        auto midContext = juce::dsp::ProcessContextReplacing<SampleType>(midBlock);
+        auto highContext = juce::dsp::ProcessContextReplacing<SampleType>(highBlock);
+
+        auto processIfNeeded = [](LinkwitzRFilter& filter, bool isNeeded, auto& context)
+        {
+            if (isNeeded)
+                filter.process(context);
+            else
+                filter.reset();
+        };
+
+        // Process the filters in a certain order (flow)
+        processIfNeeded(LP1, needed[0], lowContext);
+        processIfNeeded(AP2, needed[0], lowContext);
+        processIfNeeded(HP1, needed[1] || needed[2], midContext);
+        highBlock.copyFrom(midBlock);
+        processIfNeeded(LP2, needed[1], midContext);
+        processIfNeeded(HP2, needed[2], highContext);
+    }
+
+    std::array<juce::dsp::AudioBlock<SampleType>, 3> bandBlocks { lowBlock, midBlock, highBlock };
+
+    // Compress each band; culled bands restart from rest
+    for (size_t band = 0; band < bandBlocks.size(); ++band)
+    {
+        if (needed[band])
+        {
+            auto context = juce::dsp::ProcessContextReplacing<SampleType>(bandBlocks[band]);
+            context.isBypassed = settings.bands[band].bypassed;
+            compressors[band].process(context);
+        }
+        else
+        {
+            compressors[band].reset();
+        }
+    }
+
+    sumBands(block, bandBlocks, audible, outputGains, levels);
+}
+
+template <typename SampleType>
+void MultibandCore::Impl::sumBands(juce::dsp::AudioBlock<SampleType>& block,
+                                   const std::array<juce::dsp::AudioBlock<SampleType>, 3>& bandBlocks,
+                                   const std::array<bool, 3>& audible,
+                                   const SampleType* outputGains,
+                                   LevelSums<SampleType>& levels)
+{
+    const auto numSamples = block.getNumSamples();
+
+    // Each band's weight ramps towards 1 while it is heard and 0 when it is muted or
+    // another band is soloed. Culled bands sit at 0, so their stale buffers add nothing.
+    // Weights are a function of the sample index, which keeps the loop free of
+    // carried state other than the level sums.
+    std::array<float, 3> steps {};
+    for (size_t band = 0; band < steps.size(); ++band)
+    {
+        const auto target = audible[band] ? 1.f : 0.f;
+        steps[band] = bandGains[band] == target ? 0.f : (target > bandGains[band] ? bandGainStep : -bandGainStep);
+    }
+
+    auto peak = levels.peak;
+    auto sumOfSquares = levels.sumOfSquares;
+
+    for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+    {
+        auto* output = block.getChannelPointer(channel);
+        const auto* low = bandBlocks[0].getChannelPointer(channel);
+        const auto* mid = bandBlocks[1].getChannelPointer(channel);
+        const auto* high = bandBlocks[2].getChannelPointer(channel);
+
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            const auto ramp = static_cast<float>(i + 1);
+            const auto lowWeight = static_cast<SampleType>(juce::jlimit(0.f, 1.f, bandGains[0] + ramp * steps[0]));
+            const auto midWeight = static_cast<SampleType>(juce::jlimit(0.f, 1.f, bandGains[1] + ramp * steps[1]));
+            const auto highWeight = static_cast<SampleType>(juce::jlimit(0.f, 1.f, bandGains[2] + ramp * steps[2]));
+
+            auto sample = lowWeight * low[i] + midWeight * mid[i] + highWeight * high[i];
+
+            if (outputGains != nullptr)
+                sample *= outputGains[i];
+
+            output[i] = sample;
+            peak = juce::jmax(peak, std::abs(sample));
+            sumOfSquares += sample * sample;
+        }
+    }
+
+    levels.peak = peak;
+    levels.sumOfSquares = sumOfSquares;
+
+    const auto ramp = static_cast<float>(numSamples);
+    for (size_t band = 0; band < steps.size(); ++band)
+        bandGains[band] = juce::jlimit(0.f, 1.f, bandGains[band] + ramp * steps[band]);
+}
+
+MultibandCore::OutputLevels MultibandCore::process(float* const* channels, int numChannels, int numSamples, const float* outputGains)
+{
+    return impl->process(channels, numChannels, numSamples, outputGains);
+}
+
+MultibandCore::OutputLevels MultibandCore::process(double* const* channels, int numChannels, int numSamples, const double* outputGains)
+{
+    return impl->process(channels, numChannels, numSamples, outputGains);
+}
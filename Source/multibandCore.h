@@ -0,0 +1,119 @@
+//
+//  multibandCore.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef multibandCore_h
+#define multibandCore_h
+#include <array>
+#include <memory>
+
+// =====================MultibandCore========================
+
+// The three-band split, compression and sum, behind a plain C++ interface over raw
+// channel pointers. It knows nothing about the plugin wrapper, the parameters or the
+// GUI, and this header includes no JUCE, so a service can link the DSP sources and
+// run exactly what the plugin runs. Everything except getGainReductionDb must be
+// called from one thread.
+class MultibandCore
+{
+public:
+    enum class CrossoverMode
+    {
+        biquad,
+        topologyPreserving,
+        linearPhase
+    };
+
+    // What a band's compressor does around its threshold
+    enum class DynamicsMode
+    {
+        downwardCompression,
+        upwardCompression,
+        downwardExpansion,
+        gate
+    };
+
+    // A band's detector and gain computer can run once per detectorDecimation samples,
+    // on their peak, with the gain interpolated in between. Powers of two are best.
+    static constexpr int maximumDetectorDecimation = 32;
+
+    struct BandSettings
+    {
+        float attackMs = 50.f, releaseMs = 250.f, thresholdDb = 0.f, ratio = 2.5f;
+        DynamicsMode mode = DynamicsMode::downwardCompression;
+        int detectorDecimation = 1; // samples per detector step, up to maximumDetectorDecimation
+        bool bypassed = false, muted = false, soloed = false;
+    };
+
+    struct Settings
+    {
+        CrossoverMode crossoverMode = CrossoverMode::biquad;
+        float lowMidFrequency = 400.f, midHighFrequency = 2000.f;
+        std::array<BandSettings, 3> bands;  // low, mid, high
+        
+        // Runs the biquad crossover's sections a few samples at a time, vectorised
+        // along time. Several times faster per channel, and equal to the default
+        // sample-by-sample sections to rounding rather than bit for bit.
+        bool timeParallelBiquads = false;
+    };
+
+    MultibandCore();
+    ~MultibandCore();
+
+    // Allocates for up to maximumBlockSize samples per internal pass. Only the band
+    // buffers for the chosen precision are allocated, and the linear-phase engine only
+    // if it is the selected mode.
+    void prepare(double sampleRate, int maximumBlockSize, int numChannels, bool useDoublePrecision = false);
+
+    // Frees the linear-phase engine
+    void release();
+
+    // The linear-phase engine is built in the background when its mode is selected
+    // after prepare(), and freed again once another mode is. process() outputs
+    // silence in that mode until this returns true.
+    bool isLinearPhaseReady() const;
+
+    // Clears every filter and envelope, as if the core had only ever seen silence
+    void reset();
+
+    // Used from the next process call on; cheap enough to call for every block
+    void setSettings(const Settings& newSettings);
+    const Settings& getSettings() const;
+
+    // Peak and mean square of what process() wrote, over all its channels
+    struct OutputLevels
+    {
+        float peak = 0.f, meanSquare = 0.f;
+    };
+
+    // Splits, compresses and sums the channels in place. Blocks longer than
+    // maximumBlockSize are worked through in pieces. If outputGains is given it
+    // holds one gain per sample, shared by the channels, applied as the bands are
+    // summed; the sum, the mute/solo ramps, the gain and the metering are one pass.
+    OutputLevels process(float* const* channels, int numChannels, int numSamples, const float* outputGains = nullptr);
+    OutputLevels process(double* const* channels, int numChannels, int numSamples, const double* outputGains = nullptr);
+
+    int getLatencySamples(CrossoverMode mode) const;
+    int getLatencySamples() const;
+
+    // How long the output can ring on after the input stops, if the low-mid
+    // crossover may go down to lowestCrossoverFrequency
+    double getTailLengthSeconds(double lowestCrossoverFrequency) const;
+
+    // Gain reduction of a band at the end of the last block; safe from any thread
+    float getGainReductionDb(int band) const;
+
+    // The gain reduction a band settles at once its input is silent: 0 dB when
+    // compressing downwards, its full boost or cut in the other modes
+    float getRestingGainReductionDb(int band) const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif /* multibandCore_h */
@@ -0,0 +1,299 @@
+//
+//  offlineRenderer.cpp
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <cstring>
+#include <vector>
+#include <JuceHeader.h>
+
+#include "offlineRenderer.h"
+
+#if JUCE_MAC || JUCE_LINUX || JUCE_BSD
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+namespace
+{
+struct WavLayout
+{
+    int numChannels = 0;
+    int bitsPerSample = 0;
+    bool isFloat = false;
+    double sampleRate = 0.0;
+    juce::int64 dataOffset = 0;
+    juce::int64 numFrames = 0;
+
+    int getBytesPerFrame() const { return numChannels * bitsPerSample / 8; }
+};
+
+bool hasId(const char* chunk, const char* id)
+{
+    return std::memcmp(chunk, id, 4) == 0;
+}
+
+juce::Result parseWav(const juce::MemoryMappedFile& file, WavLayout& layout)
+{
+    const auto* data = static_cast<const char*>(file.getData());
+    const auto size = static_cast<juce::int64>(file.getSize());
+
+    if (data == nullptr || size < 12 || ! hasId(data + 8, "WAVE"))
+        return juce::Result::fail("Not a WAV file");
+
+    const auto isRF64 = hasId(data, "RF64") || hasId(data, "BW64");
+    if (! isRF64 && ! hasId(data, "RIFF"))
+        return juce::Result::fail("Not a WAV file");
+
+    juce::int64 dataSize = -1, rf64DataSize = -1;
+    auto formatTag = 0;
+
+    for (juce::int64 position = 12; position + 8 <= size;)
+    {
+        const auto* chunk = data + position;
+        const auto chunkSize = static_cast<juce::int64>(juce::ByteOrder::littleEndianInt(chunk + 4));
+        const auto* body = chunk + 8;
+
+        if (hasId(chunk, "ds64") && chunkSize >= 16)
+        {
+            // 64-bit RIFF size, then 64-bit data size
+            rf64DataSize = static_cast<juce::int64>(juce::ByteOrder::littleEndianInt64(body + 8));
+        }
+        else if (hasId(chunk, "fmt ") && chunkSize >= 16)
+        {
+            formatTag = juce::ByteOrder::littleEndianShort(body);
+            layout.numChannels = juce::ByteOrder::littleEndianShort(body + 2);
+            layout.sampleRate = static_cast<double>(juce::ByteOrder::littleEndianInt(body + 4));
+            layout.bitsPerSample = juce::ByteOrder::littleEndianShort(body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE: the real format is the start of the sub-format GUID
+            if (formatTag == 0xfffe && chunkSize >= 26)
+                formatTag = juce::ByteOrder::littleEndianShort(body + 24);
+        }
+        else if (hasId(chunk, "data"))
+        {
+            layout.dataOffset = position + 8;
+            dataSize = isRF64 && chunkSize == 0xffffffff ? rf64DataSize : chunkSize;
+            break;
+        }
+
+        position += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    if (dataSize < 0 || layout.numChannels <= 0 || layout.sampleRate <= 0.0)
+        return juce::Result::fail("WAV file has no usable fmt or data chunk");
+
+    layout.isFloat = formatTag == 3;
+    const auto supported = layout.isFloat ? layout.bitsPerSample == 32
+                                          : formatTag == 1 && (layout.bitsPerSample == 16 || layout.bitsPerSample == 24 || layout.bitsPerSample == 32);
+
+    if (! supported)
+        return juce::Result::fail("Unsupported sample format: " + juce::String(layout.bitsPerSample) + " bit, format " + juce::String(formatTag));
+
+    // A recording cut short keeps whatever whole frames made it to disk
+    dataSize = juce::jlimit(static_cast<juce::int64>(0), size - layout.dataOffset, dataSize);
+    layout.numFrames = dataSize / layout.getBytesPerFrame();
+
+    return juce::Result::ok();
+}
+
+// Writes a canonical header for layout; RF64 once the data no longer fits a RIFF size
+juce::int64 writeWavHeader(juce::OutputStream& stream, const WavLayout& layout)
+{
+    const auto dataSize = layout.numFrames * layout.getBytesPerFrame();
+    const auto needsRF64 = dataSize + 36 > 0xffffffffLL;
+    const auto riffSize = dataSize + 36 + (needsRF64 ? 36 : 0);
+
+    stream.write(needsRF64 ? "RF64" : "RIFF", 4);
+    stream.writeInt(needsRF64 ? -1 : static_cast<int>(riffSize));
+    stream.write("WAVE", 4);
+
+    if (needsRF64)
+    {
+        stream.write("ds64", 4);
+        stream.writeInt(28);
+        stream.writeInt64(riffSize);
+        stream.writeInt64(dataSize);
+        stream.writeInt64(layout.numFrames);
+        stream.writeInt(0); // no table entries
+    }
+
+    stream.write("fmt ", 4);
+    stream.writeInt(16);
+    stream.writeShort(layout.isFloat ? 3 : 1);
+    stream.writeShort(static_cast<short>(layout.numChannels));
+    stream.writeInt(static_cast<int>(layout.sampleRate));
+    stream.writeInt(static_cast<int>(layout.sampleRate) * layout.getBytesPerFrame());
+    stream.writeShort(static_cast<short>(layout.getBytesPerFrame()));
+    stream.writeShort(static_cast<short>(layout.bitsPerSample));
+
+    stream.write("data", 4);
+    stream.writeInt(needsRF64 ? -1 : static_cast<int>(dataSize));
+
+    return stream.getPosition();
+}
+
+using Planar = juce::AudioData::Pointer<juce::AudioData::Float32, juce::AudioData::NativeEndian,
+                                        juce::AudioData::NonInterleaved, juce::AudioData::NonConst>;
+using ConstPlanar = juce::AudioData::Pointer<juce::AudioData::Float32, juce::AudioData::NativeEndian,
+                                             juce::AudioData::NonInterleaved, juce::AudioData::Const>;
+
+// Converts and deinterleaves numFrames from the file into the channels
+template <typename SampleFormat>
+void readFrames(const char* source, float* const* channels, int numChannels, int numFrames)
+{
+    using Source = juce::AudioData::Pointer<SampleFormat, juce::AudioData::LittleEndian,
+                                            juce::AudioData::Interleaved, juce::AudioData::Const>;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        Planar(channels[channel]).convertSamples(Source(source + channel * SampleFormat::bytesPerSample, numChannels), numFrames);
+}
+
+// Converts and interleaves numFrames from the channels into the file
+template <typename SampleFormat>
+void writeFrames(char* destination, const float* const* channels, int numChannels, int numFrames)
+{
+    using Destination = juce::AudioData::Pointer<SampleFormat, juce::AudioData::LittleEndian,
+                                                 juce::AudioData::Interleaved, juce::AudioData::NonConst>;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        Destination(destination + channel * SampleFormat::bytesPerSample, numChannels).convertSamples(ConstPlanar(channels[channel]), numFrames);
+}
+
+template <typename Function>
+void withSampleFormat(const WavLayout& layout, Function&& function)
+{
+    if (layout.isFloat)
+        function(juce::AudioData::Float32());
+    else if (layout.bitsPerSample == 16)
+        function(juce::AudioData::Int16());
+    else if (layout.bitsPerSample == 24)
+        function(juce::AudioData::Int24());
+    else
+        function(juce::AudioData::Int32());
+}
+
+// Asks the OS to start paging in the source ahead of the block being processed.
+// Elsewhere the OS's own read-ahead for mapped files does the same job.
+void prefetch(const char* start, juce::int64 numBytes)
+{
+   #if JUCE_MAC || JUCE_LINUX || JUCE_BSD
+    static const auto pageSize = static_cast<juce::pointer_sized_uint>(sysconf(_SC_PAGESIZE));
+    const auto address = reinterpret_cast<juce::pointer_sized_uint>(start);
+    const auto pageStart = address & ~(pageSize - 1);
+
+    posix_madvise(reinterpret_cast<void*>(pageStart), static_cast<size_t>(address - pageStart + static_cast<juce::pointer_sized_uint>(numBytes)), POSIX_MADV_WILLNEED);
+   #else
+    juce::ignoreUnused(start, numBytes);
+   #endif
+}
+}
+
+juce::Result OfflineRenderer::render(const juce::File& source,
+                                     const juce::File& destination,
+                                     const MultibandCore::Settings& settings,
+                                     int blockSize)
+{
+    jassert(blockSize > 0);
+
+    const juce::MemoryMappedFile sourceMap(source, juce::MemoryMappedFile::readOnly);
+    if (sourceMap.getData() == nullptr)
+        return juce::Result::fail("Can't map " + source.getFullPathName());
+
+    WavLayout layout;
+    auto result = parseWav(sourceMap, layout);
+    if (result.failed())
+        return result;
+
+    // Write the header, then size the file so the whole data chunk can be mapped
+    juce::int64 dataOffset = 0;
+    {
+        juce::FileOutputStream stream(destination);
+        if (stream.failedToOpen())
+            return stream.getStatus();
+
+        stream.setPosition(0);
+        stream.truncate();
+
+        dataOffset = writeWavHeader(stream, layout);
+        const auto fileSize = dataOffset + layout.numFrames * layout.getBytesPerFrame();
+
+        if (fileSize > dataOffset)
+        {
+            stream.setPosition(fileSize - 1);
+            stream.writeByte(0);
+        }
+
+        stream.flush();
+        if (stream.getStatus().failed())
+            return stream.getStatus();
+    }
+
+    const juce::MemoryMappedFile destinationMap(destination, juce::MemoryMappedFile::readWrite);
+    if (layout.numFrames > 0 && destinationMap.getData() == nullptr)
+        return juce::Result::fail("Can't map " + destination.getFullPathName());
+
+    const auto* sourceData = static_cast<const char*>(sourceMap.getData()) + layout.dataOffset;
+    auto* destinationData = static_cast<char*>(destinationMap.getData()) + dataOffset;
+    const auto bytesPerFrame = layout.getBytesPerFrame();
+
+   #if JUCE_MAC || JUCE_LINUX || JUCE_BSD
+    posix_madvise(sourceMap.getData(), sourceMap.getSize(), POSIX_MADV_SEQUENTIAL);
+   #endif
+
+    MultibandCore core;
+    core.setSettings(settings);
+    core.prepare(layout.sampleRate, blockSize, layout.numChannels);
+
+    const auto latency = static_cast<juce::int64>(core.getLatencySamples());
+    const auto totalFrames = layout.numFrames + latency;
+
+    juce::AudioBuffer<float> scratch(layout.numChannels, blockSize);
+    auto* const* channels = scratch.getArrayOfWritePointers();
+    std::vector<const float*> outputChannels(static_cast<size_t>(layout.numChannels));
+
+    // Prefetch a few blocks ahead, so the next page faults are already in flight
+    const auto prefetchFrames = static_cast<juce::int64>(blockSize) * 8;
+
+    for (juce::int64 frame = 0; frame < totalFrames; frame += blockSize)
+    {
+        const auto numFrames = static_cast<int>(juce::jmin(static_cast<juce::int64>(blockSize), totalFrames - frame));
+
+        // Past the end of the source, silence pushes the last samples through the latency
+        const auto available = static_cast<int>(juce::jlimit(static_cast<juce::int64>(0), static_cast<juce::int64>(numFrames), layout.numFrames - frame));
+
+        const auto prefetchStart = frame + prefetchFrames;
+        if (prefetchStart < layout.numFrames && frame % prefetchFrames == 0)
+            prefetch(sourceData + prefetchStart * bytesPerFrame,
+                     juce::jmin(prefetchFrames, layout.numFrames - prefetchStart) * bytesPerFrame);
+
+        withSampleFormat(layout, [&](auto format)
+        {
+            readFrames<decltype(format)>(sourceData + frame * bytesPerFrame, channels, layout.numChannels, available);
+        });
+
+        for (int channel = 0; channel < layout.numChannels; ++channel)
+            scratch.clear(channel, available, numFrames - available);
+
+        core.process(channels, layout.numChannels, numFrames);
+
+        // The first latency frames out of the core precede the input and are dropped
+        const auto skip = static_cast<int>(juce::jlimit(static_cast<juce::int64>(0), static_cast<juce::int64>(numFrames), latency - frame));
+        if (skip == numFrames)
+            continue;
+
+        for (size_t channel = 0; channel < outputChannels.size(); ++channel)
+            outputChannels[channel] = channels[channel] + skip;
+
+        withSampleFormat(layout, [&](auto format)
+        {
+            writeFrames<decltype(format)>(destinationData + (frame + skip - latency) * bytesPerFrame,
+                                          outputChannels.data(), layout.numChannels, numFrames - skip);
+        });
+    }
+
+    return juce::Result::ok();
+}
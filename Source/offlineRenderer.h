@@ -0,0 +1,35 @@
+//
+//  offlineRenderer.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef offlineRenderer_h
+#define offlineRenderer_h
+#include <JuceHeader.h>
+#include "multibandCore.h"
+
+// =====================OfflineRenderer========================
+
+// Renders a WAV or RF64 file through a MultibandCore into a new file of the same
+// format, for long recordings processed outside a host. Both files are memory
+// mapped: samples go straight from the source mapping into a block-sized scratch
+// buffer, with the format conversion and deinterleaving done in that one pass,
+// and straight back out into the destination mapping the same way. There are no
+// stream reads, no whole-file buffers and no separate conversion passes.
+//
+// The output is aligned with the input: the core's latency is dropped from the
+// start and flushed out at the end. 16, 24 and 32-bit integer and 32-bit float
+// data are supported; outputs over 4 GB are written as RF64.
+class OfflineRenderer
+{
+public:
+    static juce::Result render(const juce::File& source,
+                               const juce::File& destination,
+                               const MultibandCore::Settings& settings,
+                               int blockSize = 4096);
+};
+
+#endif /* offlineRenderer_h */
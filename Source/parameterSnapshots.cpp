@@ -0,0 +1,93 @@
+//
+//  parameterSnapshots.cpp
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+
+#include "parameterSnapshots.h"
+
+void ParameterSnapshots::prepare(const std::vector<juce::RangedAudioParameter*>& parametersToCapture)
+{
+    parameters = parametersToCapture;
+    
+    for( auto& slot : slots )
+    {
+        for( auto& buffer : slot.buffers )
+            buffer.assign(parameters.size(), 0.f);
+        
+        slot.buffersHoldValues.fill(false);
+        slot.middle.store(1);
+        slot.front = 0;
+        slot.back = 2;
+        
+        slot.stored.assign(parameters.size(), 0.f);
+        slot.isStored = false;
+    }
+}
+
+void ParameterSnapshots::store(int slotIndex)
+{
+    jassert( juce::isPositiveAndBelow(slotIndex, numSlots) );
+    auto& slot = slots[static_cast<size_t>(slotIndex)];
+    
+    for( size_t index = 0; index < parameters.size(); ++index )
+    {
+        auto* parameter = parameters[index];
+        slot.stored[index] = parameter->convertFrom0to1(parameter->getValue());
+    }
+    
+    slot.isStored = true;
+    publish(slot);
+}
+
+void ParameterSnapshots::set(int slotIndex, const float* values)
+{
+    jassert( juce::isPositiveAndBelow(slotIndex, numSlots) );
+    auto& slot = slots[static_cast<size_t>(slotIndex)];
+    
+    slot.isStored = values != nullptr;
+    if( slot.isStored )
+        std::copy(values, values + slot.stored.size(), slot.stored.begin());
+    
+    publish(slot);
+}
+
+const float* ParameterSnapshots::getStoredValues(int slotIndex) const
+{
+    jassert( juce::isPositiveAndBelow(slotIndex, numSlots) );
+    const auto& slot = slots[static_cast<size_t>(slotIndex)];
+    return slot.isStored ? slot.stored.data() : nullptr;
+}
+
+void ParameterSnapshots::publish(Slot& slot)
+{
+    const auto back = static_cast<size_t>(slot.back);
+    std::copy(slot.stored.begin(), slot.stored.end(), slot.buffers[back].begin());
+    slot.buffersHoldValues[back] = slot.isStored;
+    
+    // Publish, and take back whichever buffer was in the middle
+    slot.back = slot.middle.exchange(slot.back | freshFlag, std::memory_order_acq_rel) & indexMask;
+}
+
+void ParameterSnapshots::pullUpdates()
+{
+    for( auto& slot : slots )
+    {
+        if( (slot.middle.load(std::memory_order_relaxed) & freshFlag) == 0 )
+            continue;
+        
+        slot.front = slot.middle.exchange(slot.front, std::memory_order_acq_rel) & indexMask;
+    }
+}
+
+const float* ParameterSnapshots::getValues(int slotIndex) const
+{
+    jassert( juce::isPositiveAndBelow(slotIndex, numSlots) );
+    const auto& slot = slots[static_cast<size_t>(slotIndex)];
+    const auto front = static_cast<size_t>(slot.front);
+    return slot.buffersHoldValues[front] ? slot.buffers[front].data() : nullptr;
+}
@@ -0,0 +1,75 @@
+//
+//  parameterSnapshots.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef parameterSnapshots_h
+#define parameterSnapshots_h
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <vector>
+
+// =====================ParameterSnapshots========================
+
+// A/B/C/D slots of plain parameter values, stored on the message thread and read
+// on the audio thread without locks. Each slot is a triple buffer: the message
+// thread fills its back buffer and swaps it into the middle with one atomic
+// exchange; the audio thread swaps the middle to its front buffer when it sees a
+// new one. All buffers are allocated in prepare(), so neither side allocates or
+// waits on the other afterwards.
+class ParameterSnapshots
+{
+public:
+    static constexpr int numSlots = 4;
+    
+    // Message thread; sizes every buffer for these parameters and empties the slots
+    void prepare(const std::vector<juce::RangedAudioParameter*>& parametersToCapture);
+    
+    // Message thread; captures the current plain value of every parameter into a slot
+    void store(int slot);
+    
+    // Message thread; puts plain values, by parameter index, into a slot, as a restored
+    // state does, or empties the slot if values is nullptr
+    void set(int slot, const float* values);
+    
+    // Message thread; the values last stored or set in a slot, or nullptr if it is empty
+    const float* getStoredValues(int slot) const;
+    
+    // Audio thread; picks up snapshots stored since the last call
+    void pullUpdates();
+    
+    // Audio thread; the slot's values by parameter index, or nullptr if it has never been stored
+    const float* getValues(int slot) const;
+
+private:
+    struct Slot
+    {
+        std::array<std::vector<float>, 3> buffers;
+        std::array<bool, 3> buffersHoldValues { }; // written by whichever side owns the buffer
+        
+        // Index of the middle buffer, with freshFlag set while it holds a newer snapshot
+        // than the audio thread's front buffer
+        std::atomic<int> middle { 1 };
+        int front = 0; // audio thread
+        int back = 2;  // message thread
+        
+        // Message thread's copy of what it last published, for the state and recall
+        std::vector<float> stored;
+        bool isStored = false;
+    };
+    
+    static constexpr int freshFlag = 4;
+    static constexpr int indexMask = 3;
+    
+    // Message thread; hands the slot's stored copy to the audio thread
+    static void publish(Slot& slot);
+    
+    std::vector<juce::RangedAudioParameter*> parameters;
+    std::array<Slot, numSlots> slots;
+};
+
+#endif /* parameterSnapshots_h */
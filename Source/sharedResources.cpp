@@ -0,0 +1,35 @@
+//
+//  sharedResources.cpp
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+
+#include "sharedResources.h"
+
+const juce::dsp::FFT& SharedResources::getFFT(int order)
+{
+    const juce::ScopedLock lock(cacheLock);
+    
+    auto& plan = fftPlans[order];
+    if( plan == nullptr )
+        plan = std::make_unique<const juce::dsp::FFT>(order);
+    
+    return *plan;
+}
+
+std::shared_ptr<const std::vector<float>> SharedResources::getWindow(size_t size,
+                                                                     juce::dsp::WindowingFunction<float>::WindowingMethod method)
+{
+    auto key = "window/" + juce::String(static_cast<int>(method)) + "/" + juce::String(static_cast<juce::int64>(size));
+    
+    return getTable<std::vector<float>>(key, [size, method]
+    {
+        std::vector<float> window(size, 0.f);
+        juce::dsp::WindowingFunction<float>::fillWindowingTables(window.data(), size, method, true);
+        return window;
+    });
+}
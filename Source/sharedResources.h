@@ -0,0 +1,56 @@
+//
+//  sharedResources.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef sharedResources_h
+#define sharedResources_h
+#include <JuceHeader.h>
+#include <functional>
+#include <map>
+#include <memory>
+
+// =====================SharedResources========================
+
+// Process-wide cache of immutable data that every plugin instance would otherwise
+// build for itself: FFT plans, window tables, frequency grids and other lookup
+// tables. Hold it through a juce::SharedResourcePointer<SharedResources>; the cache
+// and everything in it is freed when the last holder goes away.
+//
+// Lookups lock, so call them from prepare/constructor code, never per block.
+// Everything handed out is const: juce::dsp::FFT's transforms are const and
+// keep no state between calls, so one plan can serve any number of threads.
+class SharedResources
+{
+public:
+    // FFT plan for 2^order points. Valid for as long as the caller holds the cache.
+    const juce::dsp::FFT& getFFT(int order);
+    
+    // Window of the given size, as a table to multiply samples with
+    std::shared_ptr<const std::vector<float>> getWindow(size_t size,
+                                                        juce::dsp::WindowingFunction<float>::WindowingMethod method);
+    
+    // Any other immutable table, built by build() the first time key is asked for.
+    // The key must describe everything build() depends on (sizes, sample rate, ...).
+    template <typename Table>
+    std::shared_ptr<const Table> getTable(const juce::String& key, const std::function<Table()>& build)
+    {
+        const juce::ScopedLock lock(cacheLock);
+        
+        auto& entry = tables[key];
+        if( entry == nullptr )
+            entry = std::make_shared<const Table>(build());
+        
+        return std::static_pointer_cast<const Table>(entry);
+    }
+
+private:
+    juce::CriticalSection cacheLock;
+    std::map<int, std::unique_ptr<const juce::dsp::FFT>> fftPlans;
+    std::map<juce::String, std::shared_ptr<const void>> tables;
+};
+
+#endif /* sharedResources_h */
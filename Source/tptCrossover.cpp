@@ -0,0 +1,184 @@
+//
+//  tptCrossover.cpp
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//  This code has been referenced and adapted from Zavalishin (2018) and Zolzer (2011).
+//
+
+#include <cmath>
+#include <JuceHeader.h>
+
+#include "tptCrossover.h"
+
+namespace
+{
+    // One zero-delay-feedback state-variable filter step. Writes the highpass,
+    // bandpass and lowpass outputs and advances the two integrators.
+    inline void processCore(double inputSample, double g, double h, double damping,
+                            double& integrator1, double& integrator2,
+                            double& highPass, double& bandPass, double& lowPass) noexcept
+    {
+        highPass = (inputSample - (2.0 * damping + g) * integrator1 - integrator2) * h;
+        
+        auto v1 = g * highPass;
+        bandPass = v1 + integrator1;
+        integrator1 = bandPass + v1;
+        
+        auto v2 = g * bandPass;
+        lowPass = v2 + integrator2;
+        integrator2 = lowPass + v2;
+    }
+}
+
+void TPTCrossover::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    sampleRate = spec.sampleRate;
+    
+    states.assign(spec.numChannels, {});
+    gainCoefficients.assign(spec.maximumBlockSize, 0.0);
+    normalisationCoefficients.assign(spec.maximumBlockSize, 0.0);
+    
+    cutOffFrequency.reset(sampleRate, rampDurationSeconds);
+    reset();
+}
+
+void TPTCrossover::reset()
+{
+    for (auto& channelStates : states)
+        channelStates.fill({});
+    
+    cutOffFrequency.setCurrentAndTargetValue(cutOffFrequency.getTargetValue());
+}
+
+void TPTCrossover::setCrossoverFrequency(double crossoverFrequency)
+{
+    // Keep the prewarped cutoff below Nyquist, where tan() blows up
+    cutOffFrequency.setTargetValue(juce::jlimit(1.0, sampleRate * 0.49, crossoverFrequency));
+}
+
+void TPTCrossover::setRampDurationSeconds(double newDurationSeconds)
+{
+    rampDurationSeconds = newDurationSeconds;
+    cutOffFrequency.reset(sampleRate, rampDurationSeconds);
+}
+
+double TPTCrossover::getLowPassMagnitude(double frequency, double crossoverFrequency, double sampleRate)
+{
+    const auto pi = juce::MathConstants<double>::pi;
+    const auto ratio = std::tan(pi * juce::jmin(frequency, 0.499 * sampleRate) / sampleRate) / std::tan(pi * crossoverFrequency / sampleRate);
+    const auto ratio4 = (ratio * ratio) * (ratio * ratio);
+    return 1.0 / (1.0 + ratio4);
+}
+
+void TPTCrossover::updateCoefficients(size_t numSamples)
+{
+    auto computeCoefficients = [this](double frequency, double& g, double& h)
+    {
+        g = std::tan(juce::MathConstants<double>::pi * frequency / sampleRate);
+        h = 1.0 / (1.0 + 2.0 * damping * g + g * g);
+    };
+    
+    if (! cutOffFrequency.isSmoothing())
+    {
+        double g, h;
+        computeCoefficients(cutOffFrequency.getTargetValue(), g, h);
+        std::fill(gainCoefficients.begin(), gainCoefficients.begin() + numSamples, g);
+        std::fill(normalisationCoefficients.begin(), normalisationCoefficients.begin() + numSamples, h);
+        return;
+    }
+    
+    for (size_t i = 0; i < numSamples; ++i)
+        computeCoefficients(cutOffFrequency.getNextValue(), gainCoefficients[i], normalisationCoefficients[i]);
+}
+
+template <typename SampleType>
+void TPTCrossover::processSplit(const juce::dsp::AudioBlock<SampleType>& lowBlock,
+                                const juce::dsp::AudioBlock<SampleType>& highBlock)
+{
+    // Not prepared, or prepared for empty blocks: there is nothing to chunk by
+    jassert(! gainCoefficients.empty());
+    if (gainCoefficients.empty())
+        return;
+    
+    const auto numChannels = juce::jmin(lowBlock.getNumChannels(), highBlock.getNumChannels(), states.size());
+    const auto totalNumSamples = lowBlock.getNumSamples();
+    
+    // Work in chunks that fit the coefficient buffers sized in prepare()
+    for (size_t start = 0; start < totalNumSamples; start += gainCoefficients.size())
+    {
+        const auto numSamples = juce::jmin(gainCoefficients.size(), totalNumSamples - start);
+        updateCoefficients(numSamples);
+        
+        for (size_t channel = 0; channel < numChannels; ++channel)
+        {
+            auto* low = lowBlock.getChannelPointer(channel) + start;
+            auto* high = highBlock.getChannelPointer(channel) + start;
+            auto& channelStates = states[channel];
+            
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                const auto g = gainCoefficients[i];
+                const auto h = normalisationCoefficients[i];
+                double highPass, bandPass, lowPass, unused1, unused2;
+                
+                processCore(static_cast<double>(low[i]), g, h, damping,
+                            channelStates[input].integrator1, channelStates[input].integrator2,
+                            highPass, bandPass, lowPass);
+                
+                double lowOut, highOut;
+                processCore(lowPass, g, h, damping,
+                            channelStates[lowSection].integrator1, channelStates[lowSection].integrator2,
+                            unused1, unused2, lowOut);
+                processCore(highPass, g, h, damping,
+                            channelStates[highSection].integrator1, channelStates[highSection].integrator2,
+                            highOut, unused1, unused2);
+                
+                low[i] = static_cast<SampleType>(lowOut);
+                high[i] = static_cast<SampleType>(highOut);
+            }
+        }
+    }
+}
+
+template <typename SampleType>
+void TPTCrossover::processAllPass(const juce::dsp::AudioBlock<SampleType>& block)
+{
+    jassert(! gainCoefficients.empty());
+    if (gainCoefficients.empty())
+        return;
+    
+    const auto numChannels = juce::jmin(block.getNumChannels(), states.size());
+    const auto totalNumSamples = block.getNumSamples();
+    
+    for (size_t start = 0; start < totalNumSamples; start += gainCoefficients.size())
+    {
+        const auto numSamples = juce::jmin(gainCoefficients.size(), totalNumSamples - start);
+        updateCoefficients(numSamples);
+        
+        for (size_t channel = 0; channel < numChannels; ++channel)
+        {
+            auto* data = block.getChannelPointer(channel) + start;
+            auto& core = states[channel][input];
+            
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                double highPass, bandPass, lowPass;
+                const auto inputSample = static_cast<double>(data[i]);
+                
+                processCore(inputSample, gainCoefficients[i], normalisationCoefficients[i], damping,
+                            core.integrator1, core.integrator2,
+                            highPass, bandPass, lowPass);
+                
+                // LP4 + HP4 of the split equals this 2nd order allpass
+                data[i] = static_cast<SampleType>(inputSample - 4.0 * damping * bandPass);
+            }
+        }
+    }
+}
+
+template void TPTCrossover::processSplit<float>(const juce::dsp::AudioBlock<float>&, const juce::dsp::AudioBlock<float>&);
+template void TPTCrossover::processSplit<double>(const juce::dsp::AudioBlock<double>&, const juce::dsp::AudioBlock<double>&);
+template void TPTCrossover::processAllPass<float>(const juce::dsp::AudioBlock<float>&);
+template void TPTCrossover::processAllPass<double>(const juce::dsp::AudioBlock<double>&);
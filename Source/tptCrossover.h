@@ -0,0 +1,83 @@
+//
+//  tptCrossover.h
+//  one_MBComp
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//  This code has been referenced and adapted from Zavalishin (2018) and Zolzer (2011).
+//
+
+#ifndef tptCrossover_h
+#define tptCrossover_h
+#include <JuceHeader.h>
+#include <array>
+#include <vector>
+
+// =====================TPTCrossover========================
+
+// Linkwitz-Riley crossover built from topology-preserving (zero-delay-feedback)
+// state-variable filters. One structure produces the 4th order low and high
+// outputs and the matching 2nd order allpass, so it replaces the three
+// ButterFilters of a LinkwitzRFilter. The cutoff can move every sample: only
+// g = tan(pi * fc / fs) and one reciprocal change, and the filter stays stable
+// however fast it is modulated.
+class TPTCrossover
+{
+public:
+    // Sizes the per-sample coefficient buffers for maximumBlockSize, which must not
+    // be 0. Blocks processed before then are left as they are.
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    
+    // Clears the filter state and jumps to the target frequency
+    void reset();
+    
+    // Set crossover frequency; moves there over the ramp duration
+    void setCrossoverFrequency(double crossoverFrequency);
+    
+    void setRampDurationSeconds(double newDurationSeconds);
+    
+    // Splits the signal in lowBlock into its low and high bands (lowBlock and highBlock)
+    template <typename SampleType>
+    void processSplit(const juce::dsp::AudioBlock<SampleType>& lowBlock,
+                      const juce::dsp::AudioBlock<SampleType>& highBlock);
+    
+    // Runs the block through the allpass that matches the split's phase response
+    template <typename SampleType>
+    void processAllPass(const juce::dsp::AudioBlock<SampleType>& block);
+    
+    // Magnitude of the low output at frequency: the bilinear Linkwitz-Riley response
+    // 1 / (1 + W^4), with W = tan(pi f / fs) / tan(pi fc / fs). The high output is
+    // 1 minus this and the allpass is flat.
+    static double getLowPassMagnitude(double frequency, double crossoverFrequency, double sampleRate);
+
+private:
+    // Two integrator states of one state-variable filter core
+    struct CoreState
+    {
+        double integrator1 = 0.0, integrator2 = 0.0;
+    };
+    
+    enum Core
+    {
+        input,      // splits the input, and provides the allpass
+        lowSection, // second lowpass of the 4th order low output
+        highSection // second highpass of the 4th order high output
+    };
+    
+    // Butterworth damping, R = 1 / (2Q) with Q = 1/sqrt(2)
+    static constexpr double damping = 0.70710678118654752440;
+    
+    double sampleRate = 44100.0;
+    double rampDurationSeconds = 0.02;
+    juce::SmoothedValue<double, juce::ValueSmoothingTypes::Multiplicative> cutOffFrequency { 1000.0 };
+    
+    // Per-sample g and h for the block being processed
+    std::vector<double> gainCoefficients, normalisationCoefficients;
+    
+    std::vector<std::array<CoreState, 3>> states;
+    
+    // Fills the coefficient buffers for numSamples, ramping if the cutoff is moving
+    void updateCoefficients(size_t numSamples);
+};
+
+#endif /* tptCrossover_h */
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+#
+#  generate_reference_vectors.py
+#  one_MBComp
+#
+#  Copyright © 2023 Oberon Day-West. All rights reserved.
+#
+#  Writes the stored reference vectors the test target checks the plugin's kernels
+#  against. Each model is a line-for-line port of a MATLAB prototype in prototypes/:
+#  setFilterParameters.m, processFilter.m, linkWorth.m, linkWorth_HP.m,
+#  linkWorth_AP.m and basicComp.m, run in double precision with the same order of
+#  operations. basicComp.m reads audioLoop1.wav, which isn't in the repository, so
+#  the compressor runs on a synthetic tone-burst signal instead.
+#
+#  Run from this directory: python3 generate_reference_vectors.py
+
+import math
+import random
+
+NUM_SAMPLES = 2048
+
+
+# setFilterParameters.m
+def set_filter_parameters(cut_off_frequency, quality_factor, filter_type, sample_rate):
+    w0 = 2 * math.pi * cut_off_frequency / sample_rate
+    alpha = math.sin(w0) / (2 * quality_factor)
+    a0 = 1 + alpha
+
+    if filter_type == 'lowpass':
+        A0 = (1 - math.cos(w0)) / 2 / a0
+        A1 = (1 - math.cos(w0)) / a0
+        A2 = A0
+        B1 = -2 * math.cos(w0) / a0
+        B2 = (1 - alpha) / a0
+    elif filter_type == 'highpass':
+        A0 = (1 + math.cos(w0)) / 2 / a0
+        A1 = -(1 + math.cos(w0)) / a0
+        A2 = A0
+        B1 = -2 * math.cos(w0) / a0
+        B2 = (1 - alpha) / a0
+    elif filter_type == 'allpass':
+        A0 = (1 - alpha) / a0
+        A1 = -2 * math.cos(w0) / a0
+        A2 = (1 + alpha) / a0
+        B1 = A1
+        B2 = A0
+    else:
+        raise ValueError('Invalid filter type.')
+
+    return (A0, A1, A2, B1, B2)
+
+
+# processFilter.m, with the state carried in a two-element list
+def process_filter(input_sample, state, coefficients):
+    A0, A1, A2, B1, B2 = coefficients
+    output_sample = A0 * input_sample + A1 * state[0] + A2 * state[1] - B1 * state[0] - B2 * state[1]
+    state[1] = state[0]
+    state[0] = output_sample
+    return output_sample
+
+
+# linkWorth*.m runs each sample through processFilter.m once. The plugin's
+# Linkwitz-Riley sections run it twice per sample through the same state.
+def filter_signal(x, coefficients, num_passes):
+    state = [0.0, 0.0]
+    y = []
+    for sample in x:
+        for _ in range(num_passes):
+            sample = process_filter(sample, state, coefficients)
+        y.append(sample)
+    return y
+
+
+# basicComp.m, returning the control gain c for every sample
+def basic_comp(x, sample_rate, threshold, ratio, tau_attack, tau_release, make_up_gain):
+    alpha_attack = math.exp(-1 / (tau_attack * sample_rate / 1000))
+    alpha_release = math.exp(-1 / (tau_release * sample_rate / 1000))
+    yL_prev = 0.0
+    c = []
+
+    for sample in x:
+        if abs(sample) < 0.000001:
+            x_g = -120.0
+        else:
+            x_g = 20 * math.log10(abs(sample))
+
+        if x_g >= threshold:
+            y_g = threshold + (x_g - threshold) / ratio
+        else:
+            y_g = x_g
+        x_l = x_g - y_g
+
+        if x_l > yL_prev:
+            y_l = alpha_attack * yL_prev + (1 - alpha_attack) * x_l
+        else:
+            y_l = alpha_release * yL_prev + (1 - alpha_release) * x_l
+
+        c.append(10 ** ((make_up_gain - y_l) / 20))
+        yL_prev = y_l
+
+    return c
+
+
+def sum_of_sines(sample_rate, frequencies):
+    return [sum(math.sin(2 * math.pi * f * n / sample_rate) for f in frequencies) for n in range(NUM_SAMPLES)]
+
+
+# Bursts at 0, -6 and -30 dBFS with a stretch of digital silence, so every branch of
+# the detector and the ballistics is taken
+def tone_bursts(sample_rate):
+    levels = [1.0, 0.5, 0.0316, 0.0, 1.0, 0.0316, 0.5, 0.0]
+    length = NUM_SAMPLES // len(levels)
+    return [levels[n // length] * math.sin(2 * math.pi * 1000 * n / sample_rate) for n in range(NUM_SAMPLES)]
+
+
+def write_vectors(file_name, description, columns):
+    names = [name for name, _ in columns]
+    with open(file_name, 'w') as f:
+        for line in description:
+            f.write('# ' + line + '\n')
+        f.write('# columns: ' + ' '.join(names) + '\n')
+        for row in zip(*[values for _, values in columns]):
+            f.write(' '.join('%.17g' % value for value in row) + '\n')
+
+
+def write_filter_vectors(file_name, script, sample_rate, frequencies, cut_off, q, filter_type):
+    x = sum_of_sines(sample_rate, frequencies)
+    coefficients = set_filter_parameters(cut_off, q, filter_type, sample_rate)
+    write_vectors(file_name,
+                  ['%s: %s %g Hz, Q %g, %g Hz sample rate, input sin %s' % (script, filter_type, cut_off, q, sample_rate,
+                                                                            ' + sin '.join('%g Hz' % f for f in frequencies)),
+                   'output: processFilter.m once per sample; linkwitzRiley: twice per sample through the same state'],
+                  [('input', x), ('output', filter_signal(x, coefficients, 1)),
+                   ('linkwitzRiley', filter_signal(x, coefficients, 2))])
+
+
+def write_compressor_vectors(file_name, sample_rate, threshold, ratio, attack, release):
+    x = tone_bursts(sample_rate)
+    c = basic_comp(x, sample_rate, threshold, ratio, attack, release, 0)
+    write_vectors(file_name,
+                  ['basicComp.m: threshold %g dB, ratio %g, attack %g ms, release %g ms, make-up 0 dB, %g Hz sample rate'
+                   % (threshold, ratio, attack, release, sample_rate),
+                   'input: 1 kHz bursts at 0, -6 and -30 dBFS with silence between'],
+                  [('input', x), ('gain', c), ('output', [a * b for a, b in zip(x, c)])])
+
+
+# The plugin's biquad engine: low = LP(fc1) AP(fc2), mid = HP(fc1) LP(fc2),
+# high = HP(fc1) HP(fc2), every section a Linkwitz-Riley pair of passes with Q 0.707,
+# then basicComp.m on each band and the plain sum
+def write_chain_vectors(file_name, sample_rate, low_mid, mid_high, threshold, ratio, attack, release):
+    rng = random.Random(21501990)
+    sines = sum_of_sines(sample_rate, [60, 700, 5000])
+    x = [0.25 * s + 0.2 * rng.uniform(-1, 1) for s in sines]
+
+    def section(signal, cut_off, filter_type):
+        return filter_signal(signal, set_filter_parameters(cut_off, 0.707, filter_type, sample_rate), 2)
+
+    low = section(section(x, low_mid, 'lowpass'), mid_high, 'allpass')
+    rest = section(x, low_mid, 'highpass')
+    mid = section(rest, mid_high, 'lowpass')
+    high = section(rest, mid_high, 'highpass')
+
+    def compress(band):
+        return [s * g for s, g in zip(band, basic_comp(band, sample_rate, threshold, ratio, attack, release, 0))]
+
+    low, mid, high = compress(low), compress(mid), compress(high)
+    write_vectors(file_name,
+                  ['biquad crossover at %g and %g Hz, %g Hz sample rate; every band basicComp.m with threshold %g dB, '
+                   'ratio %g, attack %g ms, release %g ms' % (low_mid, mid_high, sample_rate, threshold, ratio, attack, release),
+                   'input: 60, 700 and 5000 Hz sines at 0.25 plus uniform noise at 0.2'],
+                  [('input', x), ('low', low), ('mid', mid), ('high', high),
+                   ('output', [a + b + c for a, b, c in zip(low, mid, high)])])
+
+
+if __name__ == '__main__':
+    write_filter_vectors('linkWorth_lowpass.txt', 'linkWorth.m', 44100, [400, 25], 300, 0.707, 'lowpass')
+    write_filter_vectors('linkWorth_highpass.txt', 'linkWorth_HP.m', 44100, [3000, 10000], 5000, 0.5, 'highpass')
+    write_filter_vectors('linkWorth_allpass.txt', 'linkWorth_AP.m', 44100, [500, 1000], 750, 0.707, 'allpass')
+    write_compressor_vectors('basicComp.txt', 44100, -10, 20, 2000, 6000)
+    write_compressor_vectors('basicComp_fast.txt', 44100, -20, 4, 1, 20)
+    write_chain_vectors('multibandChain.txt', 44100, 400, 2000, -18, 4, 5, 50)
@@ -0,0 +1,71 @@
+//
+//  AccuracyBudgets.h
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef AccuracyBudgets_h
+#define AccuracyBudgets_h
+#include <array>
+
+// =====================AccuracyBudgets========================
+
+// The error each processing path may have against its reference, as listed in the
+// README's accuracy table. Levels in dB are relative to the reference's peak. A
+// change that needs a looser budget has to change it here and in the README.
+namespace AccuracyBudgets
+{
+// Double blocks against processFilter.m, linkWorth*.m and basicComp.m. The filters
+// run the same difference equation in the same order. The compressor keeps its
+// attack and release coefficients in float, and with time constants of seconds
+// the rounding shows: 1 - alpha is then only good to a few parts in a thousand.
+constexpr double doubleFiltersDb = -240.0;
+constexpr double doubleCompressorDb = -100.0;
+
+// Float blocks against the same references
+constexpr double floatBlocksDb = -70.0;
+
+// Float blocks against double blocks of the same core on full-scale noise: the float
+// path's rounding noise alone, without the prototypes' own error against float
+constexpr double floatNoiseFloorDb = -90.0;
+
+// Float blocks with a crossover below ButterFilter::doublePrecisionCutoffRatio of the
+// sample rate, where those sections switch to double, against double blocks
+constexpr double lowCrossoverFloatDb = -120.0;
+
+// The biquad 3-band sum against the prototypes' response, which itself is not flat
+constexpr double biquadSumDb = 0.01;
+
+// TPT 3-band sum against a flat magnitude
+constexpr double tptSumDb = 0.01;
+
+// Linear Phase 3-band sum against the input delayed by the reported latency
+constexpr double linearPhaseSumAbsolute = 1e-5;
+
+// The editor's crossover overlay against each band the core outputs, at every point
+// above the floor. The linear-phase overlay interpolates between the bins of the
+// kernel spectra, which is coarsest against the steep slopes of a low crossover.
+constexpr double crossoverOverlayDb = 0.1;
+constexpr double linearPhaseOverlayDb = 0.5;
+constexpr double crossoverOverlayFloorDb = -60.0;
+
+// Settings::timeParallelBiquads against the sample-by-sample sections
+constexpr double timeParallelDb = -100.0;
+
+// Control-rate detector against the same band at every sample: the largest gain
+// difference, at a detector decimation of 4, 8, 16 and 32 samples
+constexpr std::array<int, 4> controlRateDecimations { 4, 8, 16, 32 };
+constexpr std::array<double, 4> controlRateGainDb { 0.5, 1.0, 2.0, 4.0 };
+
+// FastMath's exact, hundredthDb and tenthDb tiers against log10 and pow in double:
+// gain to decibels, decibels to gain and the round trip, as level errors in dB over
+// gains of 1e-6 to 16 and levels of -120 to +24 dB
+constexpr std::array<double, 3> fastMathDb { 2e-5, 0.01, 0.1 };
+
+// Settled blocks below the threshold against the per-sample detector, as a gain difference
+constexpr double settledBlockGainDb = 0.0001;
+}
+
+#endif /* AccuracyBudgets_h */
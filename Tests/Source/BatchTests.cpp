@@ -0,0 +1,128 @@
+//
+//  BatchTests.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "multibandBatch.h"
+#include "TestHelpers.h"
+
+// MultibandBatch against one MultibandCore per stream, which is what it claims to
+// reproduce sample for sample
+
+namespace
+{
+constexpr double sampleRate = 48000.0;
+constexpr int maximumBlockSize = 64;
+constexpr size_t hostBlockSize = 100; // not a multiple of the internal pass
+
+MultibandCore::Settings makeSettings(MultibandCore::CrossoverMode mode)
+{
+    MultibandCore::Settings settings;
+    settings.crossoverMode = mode;
+
+    const MultibandCore::DynamicsMode dynamicsModes[] { MultibandCore::DynamicsMode::downwardCompression,
+                                                        MultibandCore::DynamicsMode::upwardCompression,
+                                                        MultibandCore::DynamicsMode::gate };
+
+    for (size_t band = 0; band < settings.bands.size(); ++band)
+    {
+        auto& bandSettings = settings.bands[band];
+        bandSettings.thresholdDb = -24.f;
+        bandSettings.ratio = 4.f;
+        bandSettings.attackMs = 5.f;
+        bandSettings.releaseMs = 50.f;
+        bandSettings.mode = dynamicsModes[band];
+    }
+
+    return settings;
+}
+
+// Every stream gets its own noise, at a different level, so a lane mix-up shows
+std::vector<std::vector<double>> makeStreams(int numStreams)
+{
+    std::vector<std::vector<double>> streams;
+
+    for (int stream = 0; stream < numStreams; ++stream)
+        streams.push_back(TestHelpers::noise(static_cast<size_t>(sampleRate / 2), 0.2 + 0.1 * (stream % 8), 1000 + stream));
+
+    return streams;
+}
+
+std::vector<std::vector<float>> processBatch(const MultibandCore::Settings& settings, const std::vector<std::vector<double>>& inputs)
+{
+    std::vector<std::vector<float>> streams;
+    for (const auto& input : inputs)
+        streams.push_back(TestHelpers::convert<float>(input));
+
+    const auto numStreams = static_cast<int>(streams.size());
+
+    MultibandBatch batch;
+    batch.setSettings(settings);
+    batch.prepare(sampleRate, maximumBlockSize, numStreams);
+
+    const auto numSamples = streams.front().size();
+    std::vector<float*> pointers(streams.size());
+
+    for (size_t start = 0; start < numSamples; start += hostBlockSize)
+    {
+        for (size_t stream = 0; stream < streams.size(); ++stream)
+            pointers[stream] = streams[stream].data() + start;
+
+        batch.process(pointers.data(), numStreams, static_cast<int>(juce::jmin(hostBlockSize, numSamples - start)));
+    }
+
+    return streams;
+}
+
+std::vector<double> processCore(const MultibandCore::Settings& settings, const std::vector<double>& input)
+{
+    MultibandCore core;
+    core.setSettings(settings);
+    core.prepare(sampleRate, maximumBlockSize, 1);
+
+    const auto output = TestHelpers::processCore<float>(core, input, hostBlockSize);
+    core.release();
+    return std::vector<double>(output.begin(), output.end());
+}
+}
+
+class MultibandBatchTests : public juce::UnitTest
+{
+public:
+    MultibandBatchTests() : juce::UnitTest("MultibandBatch", "one_MBComp") {}
+
+    void runTest() override
+    {
+        // Two full groups of lanes and one lane of a third
+        const auto numStreams = 2 * MultibandBatch::getNumLanes() + 1;
+        const auto inputs = makeStreams(numStreams);
+
+        const std::pair<MultibandCore::CrossoverMode, const char*> modes[]
+        {
+            { MultibandCore::CrossoverMode::biquad, "Biquad lanes" },
+            { MultibandCore::CrossoverMode::topologyPreserving, "TPT, one core per stream" },
+            { MultibandCore::CrossoverMode::linearPhase, "Linear Phase, one core per stream" }
+        };
+
+        for (const auto& mode : modes)
+        {
+            beginTest(juce::String(mode.second) + " against separate cores, " + juce::String(numStreams) + " streams");
+
+            const auto settings = makeSettings(mode.first);
+            const auto outputs = processBatch(settings, inputs);
+            double largestError = 0;
+
+            for (size_t stream = 0; stream < inputs.size(); ++stream)
+                largestError = juce::jmax(largestError, TestHelpers::maximumError(outputs[stream], processCore(settings, inputs[stream])));
+
+            logMessage("  largest difference " + juce::String(largestError));
+            expectEquals(largestError, 0.0);
+        }
+    }
+};
+
+static MultibandBatchTests multibandBatchTests;
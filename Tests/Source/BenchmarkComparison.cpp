@@ -0,0 +1,160 @@
+//
+//  BenchmarkComparison.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "Benchmarks.h"
+
+// Compares two benchmark records stage by stage. A stage regresses when its mean time
+// is higher by more than the tolerance even at the favourable end of the 95%
+// confidence interval of the difference (Welch's t, which doesn't assume the two runs
+// are equally noisy). A difference inside the noise is reported but never flagged.
+
+namespace Benchmarks
+{
+namespace
+{
+struct RecordedStage
+{
+    juce::String benchmark, stage, unit;
+    std::vector<double> trials;
+};
+
+bool loadRecord(const juce::File& file, juce::var& record, std::vector<RecordedStage>& stages)
+{
+    if (! file.existsAsFile())
+    {
+        std::cout << "No record at " << file.getFullPathName() << std::endl;
+        return false;
+    }
+
+    record = juce::JSON::parse(file);
+
+    if (record["format"].toString() != recordFormat || static_cast<int>(record["version"]) != recordVersion)
+    {
+        std::cout << file.getFullPathName() << " isn't a version " << recordVersion << " benchmark record" << std::endl;
+        return false;
+    }
+
+    if (auto* results = record["results"].getArray())
+    {
+        for (const auto& result : *results)
+        {
+            RecordedStage stage { result["benchmark"].toString(), result["stage"].toString(), result["unit"].toString(), {} };
+
+            if (auto* trials = result["trials"].getArray())
+                for (const auto& value : *trials)
+                    stage.trials.push_back(static_cast<double>(value));
+
+            stages.push_back(stage);
+        }
+    }
+
+    return true;
+}
+
+// Warns about anything that makes the two records measure different things
+void describeMismatches(const juce::var& baseline, const juce::var& candidate)
+{
+    for (auto* property : { "sampleRate", "blockSize" })
+        if (baseline[property] != candidate[property])
+            std::cout << "Warning: " << property << " differs, " << baseline[property].toString()
+                      << " against " << candidate[property].toString() << std::endl;
+
+    for (auto* property : { "cpu", "compiler", "build" })
+        if (baseline["machine"][property] != candidate["machine"][property])
+            std::cout << "Warning: " << property << " differs, " << baseline["machine"][property].toString()
+                      << " against " << candidate["machine"][property].toString() << std::endl;
+}
+}
+
+int compare(const juce::StringArray& arguments)
+{
+    const auto first = arguments.indexOf("--compare");
+    const auto workingDirectory = juce::File::getCurrentWorkingDirectory();
+    const auto baselineFile = workingDirectory.getChildFile(arguments[first + 1]);
+    const auto candidateFile = workingDirectory.getChildFile(arguments[first + 2]);
+
+    double tolerance = 2.0;
+    const auto toleranceIndex = arguments.indexOf("--tolerance");
+    if (toleranceIndex >= 0)
+        tolerance = arguments[toleranceIndex + 1].getDoubleValue();
+
+    juce::var baseline, candidate;
+    std::vector<RecordedStage> baselineStages, candidateStages;
+
+    if (! loadRecord(baselineFile, baseline, baselineStages) || ! loadRecord(candidateFile, candidate, candidateStages))
+        return 1;
+
+    describeMismatches(baseline, candidate);
+
+    std::cout << "Change in mean time, with 95% confidence interval; tolerance " << tolerance << "%" << std::endl;
+
+    int numRegressions = 0;
+
+    for (const auto& candidateStage : candidateStages)
+    {
+        const auto name = candidateStage.benchmark + " / " + candidateStage.stage;
+        const auto baselineStage = std::find_if(baselineStages.begin(), baselineStages.end(), [&](const RecordedStage& stage)
+        {
+            return stage.benchmark == candidateStage.benchmark && stage.stage == candidateStage.stage;
+        });
+
+        if (baselineStage == baselineStages.end())
+        {
+            std::cout << "  " << name << ": not in the baseline" << std::endl;
+            continue;
+        }
+
+        const auto before = summarise(baselineStage->trials);
+        const auto after = summarise(candidateStage.trials);
+
+        if (before.count < 2 || after.count < 2 || before.mean <= 0)
+        {
+            std::cout << "  " << name << ": too few trials to compare" << std::endl;
+            continue;
+        }
+
+        const auto beforeError = before.variance / before.count;
+        const auto afterError = after.variance / after.count;
+        const auto standardError = std::sqrt(beforeError + afterError);
+
+        // Welch-Satterthwaite degrees of freedom
+        const auto degreesOfFreedom = standardError > 0
+            ? std::pow(beforeError + afterError, 2) / (beforeError * beforeError / (before.count - 1) + afterError * afterError / (after.count - 1))
+            : static_cast<double>(before.count + after.count - 2);
+
+        const auto change = 100.0 * (after.mean - before.mean) / before.mean;
+        const auto interval = 100.0 * studentT95(degreesOfFreedom) * standardError / before.mean;
+        const auto regressed = change - interval > tolerance;
+
+        std::cout << "  " << name << ": " << juce::String(before.mean, 2) << " -> " << juce::String(after.mean, 2) << " "
+                  << candidateStage.unit << ", " << (change >= 0 ? "+" : "") << juce::String(change, 1) << "% +/- "
+                  << juce::String(interval, 1) << "%" << (regressed ? "  REGRESSION" : "") << std::endl;
+
+        if (regressed)
+            ++numRegressions;
+    }
+
+    for (const auto& baselineStage : baselineStages)
+    {
+        const auto inCandidate = std::any_of(candidateStages.begin(), candidateStages.end(), [&](const RecordedStage& stage)
+        {
+            return stage.benchmark == baselineStage.benchmark && stage.stage == baselineStage.stage;
+        });
+
+        if (! inCandidate)
+            std::cout << "  " << baselineStage.benchmark << " / " << baselineStage.stage << ": not in the candidate" << std::endl;
+    }
+
+    std::cout << numRegressions << " significant regression" << (numRegressions == 1 ? "" : "s") << std::endl;
+    return numRegressions > 0 ? 1 : 0;
+}
+}
@@ -0,0 +1,251 @@
+//
+//  Benchmarks.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "Benchmarks.h"
+#include "multibandBatch.h"
+
+namespace Benchmarks
+{
+namespace
+{
+juce::String getCompilerDescription()
+{
+   #if defined (__clang__)
+    return "Clang " __clang_version__;
+   #elif defined (__GNUC__)
+    return "GCC " __VERSION__;
+   #elif defined (_MSC_VER)
+    return "MSVC " + juce::String(_MSC_FULL_VER);
+   #else
+    return "unknown";
+   #endif
+}
+
+juce::var makeMachineDescription()
+{
+    auto* machine = new juce::DynamicObject();
+    machine->setProperty("cpu", juce::SystemStats::getCpuModel());
+    machine->setProperty("cpuCores", juce::SystemStats::getNumCpus());
+    machine->setProperty("os", juce::SystemStats::getOperatingSystemName());
+    machine->setProperty("compiler", getCompilerDescription());
+   #if JUCE_DEBUG
+    machine->setProperty("build", "Debug");
+   #else
+    machine->setProperty("build", "Release");
+   #endif
+    machine->setProperty("simdLanes", MultibandBatch::getNumLanes());
+    return juce::var(machine);
+}
+
+// Every trial of one stage, in the order the stages were first recorded
+struct StageResults
+{
+    juce::String benchmark, stage, unit;
+    std::vector<double> trials;
+};
+
+void runBenchmark(Benchmark& benchmark, const Config& config, std::vector<StageResults>& results)
+{
+    benchmark.prepare(config);
+
+    const auto firstStage = results.size();
+
+    for (int trialIndex = -1; trialIndex < config.numTrials; ++trialIndex)
+    {
+        Trial trial;
+        benchmark.runTrial(config, trial);
+
+        if (trialIndex < 0)
+            continue; // warm-up
+
+        for (const auto& measurement : trial.getMeasurements())
+        {
+            auto stage = std::find_if(results.begin() + static_cast<std::ptrdiff_t>(firstStage), results.end(),
+                                      [&](const StageResults& existing) { return existing.stage == measurement.stage; });
+
+            if (stage == results.end())
+            {
+                results.push_back({ benchmark.name, measurement.stage, measurement.unit, {} });
+                stage = results.end() - 1;
+            }
+
+            stage->trials.push_back(measurement.nanosecondsPerUnit);
+        }
+    }
+
+    benchmark.release();
+
+    for (auto stage = results.begin() + static_cast<std::ptrdiff_t>(firstStage); stage != results.end(); ++stage)
+    {
+        const auto summary = summarise(stage->trials);
+        std::cout << "  " << benchmark.name << " / " << stage->stage << ": "
+                  << juce::String(summary.mean, 2) << " +/- " << juce::String(summary.confidenceInterval, 2)
+                  << " " << stage->unit << std::endl;
+    }
+}
+
+juce::var makeRecord(const Config& config, const std::vector<StageResults>& results)
+{
+    auto* record = new juce::DynamicObject();
+    record->setProperty("format", recordFormat);
+    record->setProperty("version", recordVersion);
+    record->setProperty("date", juce::Time::getCurrentTime().toISO8601(true));
+    record->setProperty("machine", makeMachineDescription());
+    record->setProperty("sampleRate", config.sampleRate);
+    record->setProperty("blockSize", config.blockSize);
+    record->setProperty("trials", config.numTrials);
+
+    juce::Array<juce::var> stages;
+    for (const auto& stage : results)
+    {
+        const auto summary = summarise(stage.trials);
+        auto* result = new juce::DynamicObject();
+        result->setProperty("benchmark", stage.benchmark);
+        result->setProperty("stage", stage.stage);
+        result->setProperty("unit", stage.unit);
+        result->setProperty("mean", summary.mean);
+        result->setProperty("ci95", summary.confidenceInterval);
+
+        juce::Array<juce::var> trials;
+        for (auto value : stage.trials)
+            trials.add(value);
+
+        result->setProperty("trials", trials);
+        stages.add(juce::var(result));
+    }
+
+    record->setProperty("results", stages);
+    return juce::var(record);
+}
+}
+
+void Trial::record(const juce::String& stage, double nanosecondsPerUnit, const juce::String& unit)
+{
+    measurements.push_back({ stage, unit, nanosecondsPerUnit });
+}
+
+Benchmark::Benchmark(const juce::String& benchmarkName) : name(benchmarkName)
+{
+    getAllBenchmarks().push_back(this);
+}
+
+Benchmark::~Benchmark()
+{
+    auto& benchmarks = getAllBenchmarks();
+    benchmarks.erase(std::remove(benchmarks.begin(), benchmarks.end(), this), benchmarks.end());
+}
+
+std::vector<Benchmark*>& Benchmark::getAllBenchmarks()
+{
+    static std::vector<Benchmark*> benchmarks;
+    return benchmarks;
+}
+
+Summary summarise(const std::vector<double>& values)
+{
+    Summary summary;
+    summary.count = static_cast<int>(values.size());
+
+    if (values.empty())
+        return summary;
+
+    for (auto value : values)
+        summary.mean += value;
+
+    summary.mean /= summary.count;
+
+    if (summary.count < 2)
+        return summary;
+
+    for (auto value : values)
+        summary.variance += (value - summary.mean) * (value - summary.mean);
+
+    summary.variance /= summary.count - 1;
+    summary.confidenceInterval = studentT95(summary.count - 1) * std::sqrt(summary.variance / summary.count);
+    return summary;
+}
+
+double studentT95(double degreesOfFreedom)
+{
+    // Exact for small samples, then the Cornish-Fisher expansion around the normal
+    // quantile, which is within 0.001 of the exact value from 10 degrees of freedom up
+    static constexpr double table[] { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262 };
+
+    if (degreesOfFreedom < 1.0)
+        return table[0];
+
+    if (degreesOfFreedom < 10.0)
+        return table[static_cast<int>(degreesOfFreedom) - 1];
+
+    const auto z = 1.959964;
+    const auto n = degreesOfFreedom;
+    return z + (std::pow(z, 3) + z) / (4 * n)
+             + (5 * std::pow(z, 5) + 16 * std::pow(z, 3) + 3 * z) / (96 * n * n)
+             + (3 * std::pow(z, 7) + 19 * std::pow(z, 5) + 17 * std::pow(z, 3) - 15 * z) / (384 * n * n * n);
+}
+
+int run(const juce::StringArray& arguments)
+{
+    // The plugin needs a message manager, though nothing here runs its loop
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    Config config;
+    juce::File jsonFile;
+    juce::StringArray names;
+
+    for (int i = arguments.indexOf("--benchmark") + 1; i < arguments.size(); ++i)
+    {
+        const auto& argument = arguments[i];
+
+        if (argument == "--trials")
+            config.numTrials = juce::jmax(2, arguments[++i].getIntValue());
+        else if (argument == "--block-size")
+            config.blockSize = juce::jmax(1, arguments[++i].getIntValue());
+        else if (argument == "--sample-rate")
+            config.sampleRate = arguments[++i].getDoubleValue();
+        else if (argument == "--json")
+            jsonFile = juce::File::getCurrentWorkingDirectory().getChildFile(arguments[++i]);
+        else
+            names.add(argument);
+    }
+
+    std::cout << "Benchmarks at " << config.sampleRate << " Hz, " << config.blockSize << "-sample blocks, "
+              << config.numTrials << " trials; mean +/- 95% confidence interval" << std::endl;
+
+    std::vector<StageResults> results;
+
+    for (auto* benchmark : Benchmark::getAllBenchmarks())
+    {
+        if (names.isEmpty() || names.contains(benchmark->name))
+            runBenchmark(*benchmark, config, results);
+    }
+
+    if (results.empty())
+    {
+        std::cout << "No benchmark matches" << std::endl;
+        return 1;
+    }
+
+    if (jsonFile != juce::File())
+    {
+        if (! jsonFile.replaceWithText(juce::JSON::toString(makeRecord(config, results))))
+        {
+            std::cout << "Couldn't write " << jsonFile.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        std::cout << "Wrote " << jsonFile.getFullPathName() << std::endl;
+    }
+
+    return 0;
+}
+}
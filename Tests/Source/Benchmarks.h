@@ -0,0 +1,108 @@
+//
+//  Benchmarks.h
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef Benchmarks_h
+#define Benchmarks_h
+#include <JuceHeader.h>
+#include <vector>
+
+// =====================Benchmarks========================
+
+// Timing runs for the processing chain, kept apart from the tests so the tests stay
+// fast. Each benchmark times one or more named stages over several trials of the
+// same fixed amount of work. The runner writes the trials of every stage to a
+// versioned JSON record, and compare() says which stages of a later record are
+// significantly slower than an earlier one.
+namespace Benchmarks
+{
+// Records name their format and version, so compare() can refuse what it can't read.
+// Bump the version when a field changes meaning.
+constexpr const char* recordFormat = "one_MBComp benchmark record";
+constexpr int recordVersion = 1;
+
+struct Config
+{
+    double sampleRate = 48000.0;
+    int blockSize = 512;
+    int numTrials = 10;
+};
+
+// What one trial measured: a time per unit of work for each stage. A sample is one
+// sample frame, across all the channels the stage processes.
+class Trial
+{
+public:
+    void record(const juce::String& stage, double nanosecondsPerUnit, const juce::String& unit = "ns/sample");
+
+    struct Measurement
+    {
+        juce::String stage, unit;
+        double nanosecondsPerUnit;
+    };
+
+    const std::vector<Measurement>& getMeasurements() const { return measurements; }
+
+private:
+    std::vector<Measurement> measurements;
+};
+
+// Construct one as a static object to register it, as with juce::UnitTest
+class Benchmark
+{
+public:
+    explicit Benchmark(const juce::String& benchmarkName);
+    virtual ~Benchmark();
+
+    // Builds whatever the trials share; called once before the first trial
+    virtual void prepare(const Config& config) = 0;
+
+    // Times every stage once. The first trial is a warm-up and isn't recorded.
+    virtual void runTrial(const Config& config, Trial& trial) = 0;
+
+    // Frees what prepare() built
+    virtual void release() {}
+
+    static std::vector<Benchmark*>& getAllBenchmarks();
+
+    const juce::String name;
+};
+
+// Time per unit of work of one call of function, which does numUnits units of work
+template <typename Function>
+double nanosecondsPerUnit(double numUnits, Function&& function)
+{
+    const auto start = juce::Time::getHighResolutionTicks();
+    function();
+    const auto ticks = juce::Time::getHighResolutionTicks() - start;
+
+    return 1.0e9 * static_cast<double>(ticks) / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond()) / numUnits;
+}
+
+// --benchmark [name...] [--trials n] [--block-size n] [--sample-rate hz] [--json file]
+// Runs the named benchmarks, or all of them, and prints mean and 95% confidence
+// interval per stage. Returns the process exit code.
+int run(const juce::StringArray& arguments);
+
+// --compare baseline.json candidate.json [--tolerance percent]
+// Returns 1 if any stage is significantly slower, by more than the tolerance.
+int compare(const juce::StringArray& arguments);
+
+// Mean and half-width of the two-sided 95% confidence interval of the mean
+struct Summary
+{
+    double mean = 0, confidenceInterval = 0, variance = 0;
+    int count = 0;
+};
+
+Summary summarise(const std::vector<double>& values);
+
+// Two-sided 95% critical value of Student's t distribution
+double studentT95(double degreesOfFreedom);
+}
+
+#endif /* Benchmarks_h */
@@ -0,0 +1,371 @@
+//
+//  CrossoverTests.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "multibandCore.h"
+#include "crossoverResponse.h"
+#include "AccuracyBudgets.h"
+#include "ReferenceModels.h"
+#include "TestHelpers.h"
+
+// The 3-band sum of each crossover engine, with every band's compressor bypassed,
+// and the editor's overlay against each band the engines actually output
+
+namespace
+{
+struct CrossoverCase
+{
+    double sampleRate;
+    float lowMidFrequency, midHighFrequency;
+};
+
+const CrossoverCase crossoverCases[]
+{
+    { 44100.0, 400.f, 2000.f },
+    { 48000.0, 80.f, 6000.f },
+    { 96000.0, 400.f, 2000.f }
+};
+
+MultibandCore::Settings makeSettings(MultibandCore::CrossoverMode mode, const CrossoverCase& crossoverCase)
+{
+    MultibandCore::Settings settings;
+    settings.crossoverMode = mode;
+    settings.lowMidFrequency = crossoverCase.lowMidFrequency;
+    settings.midHighFrequency = crossoverCase.midHighFrequency;
+
+    for (auto& band : settings.bands)
+        band.bypassed = true;
+
+    return settings;
+}
+
+// Half a second of the core's output for input, in float blocks as the plugin runs
+// it; only soloBand if one is given
+std::vector<double> processThroughCore(MultibandCore::CrossoverMode mode, const CrossoverCase& crossoverCase, const std::vector<double>& input,
+                                       int soloBand = -1)
+{
+    auto settings = makeSettings(mode, crossoverCase);
+    if (soloBand >= 0)
+        settings.bands[static_cast<size_t>(soloBand)].soloed = true;
+
+    MultibandCore core;
+    core.setSettings(settings);
+    core.prepare(crossoverCase.sampleRate, 512, 1);
+
+    const auto output = TestHelpers::processCore<float>(core, input, 512);
+    core.release();
+    return std::vector<double>(output.begin(), output.end());
+}
+
+std::vector<double> impulse(double sampleRate)
+{
+    std::vector<double> samples(static_cast<size_t>(sampleRate / 2), 0.0);
+    samples[0] = 1.0;
+    return samples;
+}
+
+juce::String describe(const CrossoverCase& crossoverCase)
+{
+    return juce::String(crossoverCase.lowMidFrequency) + " / " + juce::String(crossoverCase.midHighFrequency)
+         + " Hz at " + juce::String(crossoverCase.sampleRate) + " Hz";
+}
+}
+
+class CrossoverSumTests : public juce::UnitTest
+{
+public:
+    CrossoverSumTests() : juce::UnitTest("Crossover sums", "one_MBComp") {}
+
+    void runTest() override
+    {
+        for (const auto& crossoverCase : crossoverCases)
+        {
+            const auto sampleRate = crossoverCase.sampleRate;
+            const auto frequencies = TestHelpers::logFrequencies(sampleRate);
+
+            beginTest("Biquad sum follows the prototypes' response, " + describe(crossoverCase));
+            {
+                const auto input = impulse(sampleRate);
+                const auto response = processThroughCore(MultibandCore::CrossoverMode::biquad, crossoverCase, input);
+                const auto reference = ReferenceModels::multibandSum(ReferenceModels::multibandBands(input, crossoverCase.lowMidFrequency,
+                                                                                                     crossoverCase.midHighFrequency, {},
+                                                                                                     sampleRate, false));
+                double largestDifference = 0, lowestDb = 0, highestDb = 0;
+
+                for (auto frequency : frequencies)
+                {
+                    const auto referenceDb = TestHelpers::magnitudeDb(reference, frequency, sampleRate);
+                    largestDifference = juce::jmax(largestDifference, std::abs(TestHelpers::magnitudeDb(response, frequency, sampleRate) - referenceDb));
+                    lowestDb = juce::jmin(lowestDb, referenceDb);
+                    highestDb = juce::jmax(highestDb, referenceDb);
+                }
+
+                logMessage("  difference " + juce::String(largestDifference, 6) + " dB; prototype ripple "
+                           + juce::String(lowestDb, 1) + " to +" + juce::String(highestDb, 1) + " dB");
+                expectLessOrEqual(largestDifference, AccuracyBudgets::biquadSumDb);
+            }
+
+            beginTest("TPT sum is flat, " + describe(crossoverCase));
+            {
+                const auto response = processThroughCore(MultibandCore::CrossoverMode::topologyPreserving, crossoverCase, impulse(sampleRate));
+                double largestDeviation = 0;
+
+                for (auto frequency : frequencies)
+                    largestDeviation = juce::jmax(largestDeviation, std::abs(TestHelpers::magnitudeDb(response, frequency, sampleRate)));
+
+                logMessage("  deviation " + juce::String(largestDeviation, 6) + " dB");
+                expectLessOrEqual(largestDeviation, AccuracyBudgets::tptSumDb);
+            }
+
+            beginTest("Linear Phase sum is the delayed input, " + describe(crossoverCase));
+            {
+                MultibandCore core;
+                core.setSettings(makeSettings(MultibandCore::CrossoverMode::linearPhase, crossoverCase));
+                core.prepare(sampleRate, 512, 1);
+                const auto latency = static_cast<size_t>(core.getLatencySamples());
+
+                const auto input = TestHelpers::noise(static_cast<size_t>(sampleRate / 2), 0.5);
+                const auto output = TestHelpers::processCore<float>(core, input, 512);
+                core.release();
+
+                std::vector<double> delayedInput(input.size(), 0.0);
+                std::copy(input.begin(), input.end() - static_cast<std::ptrdiff_t>(latency), delayedInput.begin() + static_cast<std::ptrdiff_t>(latency));
+
+                const auto error = TestHelpers::maximumError(output, delayedInput);
+                logMessage("  error " + juce::String(error));
+                expectLessOrEqual(error, AccuracyBudgets::linearPhaseSumAbsolute);
+            }
+        }
+    }
+};
+
+class CrossoverOverlayTests : public juce::UnitTest
+{
+public:
+    CrossoverOverlayTests() : juce::UnitTest("Crossover overlay", "one_MBComp") {}
+
+    void runTest() override
+    {
+        const std::pair<MultibandCore::CrossoverMode, const char*> modes[]
+        {
+            { MultibandCore::CrossoverMode::biquad, "Biquad" },
+            { MultibandCore::CrossoverMode::topologyPreserving, "TPT" },
+            { MultibandCore::CrossoverMode::linearPhase, "Linear Phase" }
+        };
+
+        for (const auto& crossoverCase : crossoverCases)
+        {
+            const auto sampleRate = crossoverCase.sampleRate;
+
+            CrossoverResponse overlay;
+            overlay.prepare(200, sampleRate);
+
+            for (const auto& [mode, modeName] : modes)
+            {
+                beginTest(juce::String(modeName) + " overlay follows the processed bands, " + describe(crossoverCase));
+
+                overlay.update(mode, crossoverCase.lowMidFrequency, crossoverCase.midHighFrequency);
+                double largestDifference = 0;
+
+                for (int band = 0; band < 3; ++band)
+                {
+                    const auto response = processThroughCore(mode, crossoverCase, impulse(sampleRate), band);
+                    const auto& overlayDb = overlay.getBandMagnitudesDb(static_cast<size_t>(band));
+
+                    // Down to where float rounding in the processed band takes over
+                    for (int point = 0; point < overlay.getNumPoints(); ++point)
+                    {
+                        const auto expectedDb = static_cast<double>(overlayDb[static_cast<size_t>(point)]);
+
+                        if (expectedDb > AccuracyBudgets::crossoverOverlayFloorDb)
+                            largestDifference = juce::jmax(largestDifference, std::abs(TestHelpers::magnitudeDb(response, overlay.getFrequency(point), sampleRate)
+                                                                                       - expectedDb));
+                    }
+                }
+
+                logMessage("  difference " + juce::String(largestDifference, 4) + " dB");
+                expectLessOrEqual(largestDifference, mode == MultibandCore::CrossoverMode::linearPhase ? AccuracyBudgets::linearPhaseOverlayDb
+                                                                                                      : AccuracyBudgets::crossoverOverlayDb);
+            }
+        }
+    }
+};
+
+class LinearPhaseLifetimeTests : public juce::UnitTest
+{
+public:
+    LinearPhaseLifetimeTests() : juce::UnitTest("Linear Phase engine lifetime", "one_MBComp") {}
+
+    void runTest() override
+    {
+        const CrossoverCase crossoverCase { 48000.0, 400.f, 2000.f };
+        const auto biquadSettings = makeSettings(MultibandCore::CrossoverMode::biquad, crossoverCase);
+        const auto linearPhaseSettings = makeSettings(MultibandCore::CrossoverMode::linearPhase, crossoverCase);
+
+        MultibandCore core;
+        core.setSettings(biquadSettings);
+        core.prepare(crossoverCase.sampleRate, 512, 1);
+
+        beginTest("Not built while another mode is selected");
+        expect(! core.isLinearPhaseReady());
+
+        beginTest("Built in the background when selected, then the sum is the delayed input");
+        {
+            core.setSettings(linearPhaseSettings);
+            expect(TestHelpers::waitForLinearPhase(core, true), "the engine was never built");
+
+            const auto latency = static_cast<size_t>(core.getLatencySamples());
+            const auto input = TestHelpers::noise(static_cast<size_t>(crossoverCase.sampleRate / 2), 0.5);
+            const auto output = TestHelpers::processCore<float>(core, input, 512);
+
+            std::vector<double> delayedInput(input.size(), 0.0);
+            std::copy(input.begin(), input.end() - static_cast<std::ptrdiff_t>(latency), delayedInput.begin() + static_cast<std::ptrdiff_t>(latency));
+            expectLessOrEqual(TestHelpers::maximumError(output, delayedInput), AccuracyBudgets::linearPhaseSumAbsolute);
+        }
+
+        beginTest("Freed when another mode is selected");
+        core.setSettings(biquadSettings);
+        expect(TestHelpers::waitForLinearPhase(core, false), "the engine was never freed");
+
+        beginTest("An unmuted band joins at a partition boundary and is exact from there");
+        {
+            const auto input = TestHelpers::noise(static_cast<size_t>(crossoverCase.sampleRate / 2), 0.5);
+            const auto reference = processThroughCore(MultibandCore::CrossoverMode::linearPhase, crossoverCase, input);
+
+            auto mutedSettings = linearPhaseSettings;
+            mutedSettings.bands[1].muted = true;
+
+            core.setSettings(mutedSettings);
+            core.prepare(crossoverCase.sampleRate, 512, 1);
+
+            // Muted for the first half, then back on; the fade takes 10 ms
+            const auto unmuteAt = input.size() / 2;
+            auto samples = TestHelpers::convert<float>(input);
+
+            for (size_t start = 0; start < samples.size(); start += 100)
+            {
+                if (start >= unmuteAt)
+                    core.setSettings(linearPhaseSettings);
+
+                auto* channel = samples.data() + start;
+                core.process(&channel, 1, static_cast<int>(juce::jmin(static_cast<size_t>(100), samples.size() - start)));
+            }
+
+            const auto settled = unmuteAt + static_cast<size_t>(crossoverCase.sampleRate / 50);
+            const auto error = TestHelpers::maximumError(samples, reference, settled);
+            logMessage("  error after the fade " + juce::String(error));
+            expectLessOrEqual(error, AccuracyBudgets::linearPhaseSumAbsolute);
+        }
+
+        beginTest("Built at prepare when it is the selected mode");
+        core.setSettings(linearPhaseSettings);
+        core.prepare(crossoverCase.sampleRate, 512, 1);
+        expect(core.isLinearPhaseReady());
+
+        core.release();
+        expect(! core.isLinearPhaseReady());
+
+        // The designer's scratch is shared by every engine in the process, so the 96 kHz
+        // kernel, twice as long, has to fit scratch last used at 48 kHz
+        for (auto sampleRate : { 48000.0, 96000.0 })
+        {
+            const CrossoverCase from { sampleRate, 400.f, 2000.f }, to { sampleRate, 800.f, 4000.f };
+            beginTest("Crossovers moved after being built at prepare, " + describe(from) + " to " + describe(to));
+
+            const auto input = TestHelpers::noise(static_cast<size_t>(2 * sampleRate), 0.5);
+            const auto reference = processThroughCore(MultibandCore::CrossoverMode::linearPhase, to, input, 0);
+            const auto moveAt = input.size() / 4;
+
+            auto settings = makeSettings(MultibandCore::CrossoverMode::linearPhase, from);
+            settings.bands[0].soloed = true;
+
+            MultibandCore movedCore;
+            movedCore.setSettings(settings);
+            movedCore.prepare(sampleRate, 512, 1);
+
+            auto samples = TestHelpers::convert<float>(input);
+
+            for (size_t start = 0; start < samples.size(); start += 512)
+            {
+                if (start >= moveAt && start < moveAt + 512)
+                {
+                    settings.lowMidFrequency = to.lowMidFrequency;
+                    settings.midHighFrequency = to.midHighFrequency;
+                    movedCore.setSettings(settings);
+                }
+
+                auto* channel = samples.data() + start;
+                movedCore.process(&channel, 1, static_cast<int>(juce::jmin(static_cast<size_t>(512), samples.size() - start)));
+
+                // Leaves the designer time to finish while the first half plays
+                if (start >= moveAt && start < samples.size() / 2)
+                    juce::Thread::sleep(1);
+            }
+
+            // New kernels over the same input history: the second half is what a core
+            // built at the new frequencies outputs
+            const auto error = TestHelpers::maximumError(samples, reference, samples.size() / 2);
+            logMessage("  error after the crossfade " + juce::String(error));
+            expectLessOrEqual(error, AccuracyBudgets::linearPhaseSumAbsolute);
+            movedCore.release();
+        }
+    }
+};
+
+class CrossoverTailTests : public juce::UnitTest
+{
+public:
+    CrossoverTailTests() : juce::UnitTest("Crossover tails", "one_MBComp") {}
+
+    void runTest() override
+    {
+        // The lowest crossovers the parameters allow
+        constexpr float lowestLowMid = 20.f, lowestMidHigh = 1000.f;
+
+        for (auto sampleRate : { 44100.0, 96000.0 })
+        {
+            const CrossoverCase crossoverCase { sampleRate, lowestLowMid, lowestMidHigh };
+
+            for (auto mode : { MultibandCore::CrossoverMode::biquad, MultibandCore::CrossoverMode::topologyPreserving })
+            {
+                beginTest(juce::String(mode == MultibandCore::CrossoverMode::biquad ? "Biquad" : "TPT")
+                          + " output is below -120 dBFS a tail length after full-scale noise stops, " + describe(crossoverCase));
+
+                MultibandCore core;
+                core.setSettings(makeSettings(mode, crossoverCase));
+                core.prepare(sampleRate, 512, 1);
+
+                const auto tailSamples = static_cast<size_t>(std::ceil(core.getTailLengthSeconds(lowestLowMid) * sampleRate));
+                const auto burstSamples = static_cast<size_t>(sampleRate / 10);
+
+                auto input = TestHelpers::noise(burstSamples, 1.0);
+                input.resize(burstSamples + tailSamples + static_cast<size_t>(sampleRate / 10), 0.0);
+
+                const auto output = TestHelpers::processCore<float>(core, input, 512);
+
+                // Where the output last rose above the silence threshold
+                size_t lastAudible = 0;
+                for (size_t i = 0; i < output.size(); ++i)
+                {
+                    if (std::abs(output[i]) > 1.0e-6f)
+                        lastAudible = i;
+                }
+
+                const auto ringSamples = lastAudible + 1 - burstSamples;
+                logMessage("  rings for " + juce::String(ringSamples / sampleRate, 3) + " s; tail "
+                           + juce::String(tailSamples / sampleRate, 3) + " s");
+                expectLessOrEqual(ringSamples, tailSamples);
+            }
+        }
+    }
+};
+
+static CrossoverSumTests crossoverSumTests;
+static CrossoverOverlayTests crossoverOverlayTests;
+static LinearPhaseLifetimeTests linearPhaseLifetimeTests;
+static CrossoverTailTests crossoverTailTests;
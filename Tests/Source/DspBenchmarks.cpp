@@ -0,0 +1,382 @@
+//
+//  DspBenchmarks.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "multibandCore.h"
+#include "butterworthFilter.h"
+#include "offlineRenderer.h"
+#include "fastMath.h"
+#include "Benchmarks.h"
+#include "TestHelpers.h"
+
+// The core in each crossover mode, the biquad sections with and without
+// timeParallelBiquads, the offline renderer end to end, and the decibel conversions
+// the compressor and the analyser run on
+
+namespace
+{
+constexpr int numChannels = 2;
+
+// Settings that keep every band's compressor working on full-scale noise
+MultibandCore::Settings makeCompressingSettings()
+{
+    MultibandCore::Settings settings;
+
+    for (auto& band : settings.bands)
+    {
+        band.thresholdDb = -30.f;
+        band.ratio = 4.f;
+        band.attackMs = 5.f;
+        band.releaseMs = 50.f;
+    }
+
+    return settings;
+}
+
+class CrossoverModeBenchmark : public Benchmarks::Benchmark
+{
+public:
+    CrossoverModeBenchmark() : Benchmarks::Benchmark("crossoverModes") {}
+
+    void prepare(const Benchmarks::Config& config) override
+    {
+        // One second of stereo noise, processed in place a block at a time
+        const auto numSamples = static_cast<size_t>(config.sampleRate);
+        const auto noise = TestHelpers::convert<float>(TestHelpers::noise(numSamples, 0.9));
+        input.assign(numChannels, noise);
+        working = input;
+
+        for (auto& mode : modes)
+        {
+            auto settings = makeCompressingSettings();
+            settings.crossoverMode = mode.crossoverMode;
+            settings.timeParallelBiquads = mode.timeParallel;
+
+            mode.core = std::make_unique<MultibandCore>();
+            mode.core->setSettings(settings);
+            mode.core->prepare(config.sampleRate, config.blockSize, numChannels);
+        }
+    }
+
+    void runTrial(const Benchmarks::Config& config, Benchmarks::Trial& trial) override
+    {
+        const auto numSamples = working.front().size();
+
+        for (auto& mode : modes)
+        {
+            working = input;
+
+            trial.record(mode.name, Benchmarks::nanosecondsPerUnit(static_cast<double>(numSamples), [&]
+            {
+                for (size_t start = 0; start < numSamples; start += static_cast<size_t>(config.blockSize))
+                {
+                    float* channels[numChannels] { working[0].data() + start, working[1].data() + start };
+                    mode.core->process(channels, numChannels, static_cast<int>(juce::jmin(static_cast<size_t>(config.blockSize), numSamples - start)));
+                }
+            }));
+        }
+    }
+
+    void release() override
+    {
+        for (auto& mode : modes)
+        {
+            mode.core->release();
+            mode.core.reset();
+        }
+    }
+
+private:
+    struct Mode
+    {
+        const char* name;
+        MultibandCore::CrossoverMode crossoverMode;
+        bool timeParallel;
+        std::unique_ptr<MultibandCore> core;
+    };
+
+    Mode modes[4]
+    {
+        { "biquad", MultibandCore::CrossoverMode::biquad, false, {} },
+        { "biquadTimeParallel", MultibandCore::CrossoverMode::biquad, true, {} },
+        { "topologyPreserving", MultibandCore::CrossoverMode::topologyPreserving, false, {} },
+        { "linearPhase", MultibandCore::CrossoverMode::linearPhase, false, {} }
+    };
+
+    std::vector<std::vector<float>> input, working;
+};
+
+// The stereo biquad core on float blocks and on double blocks, as the plugin runs it
+// when the host asks for either precision, then on float blocks with a 20 Hz
+// crossover, where the low sections switch to double on their own
+class SampleTypeBenchmark : public Benchmarks::Benchmark
+{
+public:
+    SampleTypeBenchmark() : Benchmarks::Benchmark("sampleTypes") {}
+
+    void prepare(const Benchmarks::Config& config) override
+    {
+        input = TestHelpers::noise(static_cast<size_t>(config.sampleRate), 0.9);
+    }
+
+    void runTrial(const Benchmarks::Config& config, Benchmarks::Trial& trial) override
+    {
+        trial.record("float blocks", time<float>(config, makeCompressingSettings()));
+        trial.record("double blocks", time<double>(config, makeCompressingSettings()));
+
+        auto lowCrossover = makeCompressingSettings();
+        lowCrossover.lowMidFrequency = 20.f;
+        trial.record("float blocks, 20 Hz crossover", time<float>(config, lowCrossover));
+    }
+
+private:
+    std::vector<double> input;
+
+    template <typename SampleType>
+    double time(const Benchmarks::Config& config, const MultibandCore::Settings& settings)
+    {
+        MultibandCore core;
+        core.setSettings(settings);
+        core.prepare(config.sampleRate, config.blockSize, numChannels, std::is_same<SampleType, double>::value);
+
+        std::vector<std::vector<SampleType>> working(numChannels, TestHelpers::convert<SampleType>(input));
+        const auto numSamples = input.size();
+
+        const auto nanoseconds = Benchmarks::nanosecondsPerUnit(static_cast<double>(numSamples), [&]
+        {
+            for (size_t start = 0; start < numSamples; start += static_cast<size_t>(config.blockSize))
+            {
+                SampleType* channels[numChannels] { working[0].data() + start, working[1].data() + start };
+                core.process(channels, numChannels, static_cast<int>(juce::jmin(static_cast<size_t>(config.blockSize), numSamples - start)));
+            }
+        });
+
+        core.release();
+        return nanoseconds;
+    }
+};
+
+// Settings::timeParallelBiquads against the default sample-by-sample sections, on one
+// channel at block sizes from 32 to 1024 samples: a single biquad section, a
+// Linkwitz-Riley section (the same section run twice per sample) and the whole mono
+// core. The block sizes are fixed rather than taken from --block-size, because how
+// the chunks fall in a block is what is being measured.
+class TimeParallelBenchmark : public Benchmarks::Benchmark
+{
+public:
+    TimeParallelBenchmark() : Benchmarks::Benchmark("timeParallel") {}
+
+    void prepare(const Benchmarks::Config& config) override
+    {
+        input = TestHelpers::convert<float>(TestHelpers::noise(static_cast<size_t>(config.sampleRate), 0.9));
+    }
+
+    void runTrial(const Benchmarks::Config& config, Benchmarks::Trial& trial) override
+    {
+        const juce::dsp::ProcessSpec spec { config.sampleRate, 1024, 1 };
+
+        for (auto blockSize : { 32, 64, 256, 1024 })
+        {
+            for (auto timeParallel : { false, true })
+            {
+                const auto suffix = ", " + juce::String(blockSize) + (timeParallel ? ", time-parallel" : ", sample by sample");
+
+                ButterFilter section(config.sampleRate, FilterType::lowpass);
+                section.setFilterParameters(400.0, 0.707, FilterType::lowpass);
+                section.prepare(spec);
+                section.setTimeParallel(timeParallel);
+
+                trial.record("biquad section" + suffix, time(blockSize, [&](juce::dsp::AudioBlock<float>& block)
+                {
+                    section.process(juce::dsp::ProcessContextReplacing<float>(block));
+                }));
+
+                LinkwitzRFilter linkwitzRiley(config.sampleRate);
+                linkwitzRiley.prepare(spec);
+                linkwitzRiley.setType(FilterType::lowpass);
+                linkwitzRiley.setCrossoverFrequency(400.0);
+                linkwitzRiley.setTimeParallel(timeParallel);
+
+                trial.record("Linkwitz-Riley section" + suffix, time(blockSize, [&](juce::dsp::AudioBlock<float>& block)
+                {
+                    linkwitzRiley.process(juce::dsp::ProcessContextReplacing<float>(block));
+                }));
+
+                auto settings = makeCompressingSettings();
+                settings.timeParallelBiquads = timeParallel;
+
+                MultibandCore core;
+                core.setSettings(settings);
+                core.prepare(config.sampleRate, blockSize, 1);
+
+                trial.record("mono core" + suffix, time(blockSize, [&](juce::dsp::AudioBlock<float>& block)
+                {
+                    auto* channel = block.getChannelPointer(0);
+                    core.process(&channel, 1, static_cast<int>(block.getNumSamples()));
+                }));
+
+                core.release();
+            }
+        }
+    }
+
+private:
+    std::vector<float> input, working;
+
+    // Times processBlock over a fresh copy of the input, blockSize samples at a time
+    template <typename Function>
+    double time(int blockSize, Function&& processBlock)
+    {
+        working = input;
+        const auto numSamples = working.size();
+
+        return Benchmarks::nanosecondsPerUnit(static_cast<double>(numSamples), [&]
+        {
+            for (size_t start = 0; start < numSamples; start += static_cast<size_t>(blockSize))
+            {
+                auto* channel = working.data() + start;
+                juce::dsp::AudioBlock<float> block(&channel, 1, juce::jmin(static_cast<size_t>(blockSize), numSamples - start));
+                processBlock(block);
+            }
+        });
+    }
+};
+
+// Renders ten seconds of stereo 24-bit noise from one file into another, so the
+// time includes the mapping, conversions and latency handling the renderer adds
+class OfflineRenderBenchmark : public Benchmarks::Benchmark
+{
+public:
+    OfflineRenderBenchmark() : Benchmarks::Benchmark("offlineRender") {}
+
+    void prepare(const Benchmarks::Config& config) override
+    {
+        numSamples = static_cast<int>(10 * config.sampleRate);
+        source = juce::File::createTempFile(".wav");
+        destination = juce::File::createTempFile(".wav");
+
+        juce::AudioBuffer<float> noise(numChannels, numSamples);
+        const auto samples = TestHelpers::convert<float>(TestHelpers::noise(static_cast<size_t>(numSamples), 0.9));
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            noise.copyFrom(channel, 0, samples.data(), numSamples);
+
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(new juce::FileOutputStream(source), config.sampleRate,
+                                                                               numChannels, 24, {}, 0));
+        jassert(writer != nullptr);
+        writer->writeFromAudioSampleBuffer(noise, 0, numSamples);
+    }
+
+    void runTrial(const Benchmarks::Config& config, Benchmarks::Trial& trial) override
+    {
+        destination.deleteFile();
+        auto result = juce::Result::ok();
+
+        trial.record("render", Benchmarks::nanosecondsPerUnit(numSamples, [&]
+        {
+            result = OfflineRenderer::render(source, destination, makeCompressingSettings(), config.blockSize);
+        }));
+
+        jassert(! result.failed());
+    }
+
+    void release() override
+    {
+        source.deleteFile();
+        destination.deleteFile();
+    }
+
+private:
+    juce::File source, destination;
+    int numSamples = 0;
+};
+
+// Block conversions between gain and decibels, in ns per value: log10 and pow as
+// juce::Decibels calls them, then each FastMath tier. The values span the ranges
+// the README's error table is measured over.
+class FastMathBenchmark : public Benchmarks::Benchmark
+{
+public:
+    FastMathBenchmark() : Benchmarks::Benchmark("fastMath") {}
+
+    void prepare(const Benchmarks::Config& config) override
+    {
+        const auto numValues = static_cast<size_t>(config.blockSize);
+        gains.resize(numValues);
+        decibels.resize(numValues);
+        output.resize(numValues);
+
+        const auto noise = TestHelpers::noise(numValues, 1.0);
+
+        for (size_t i = 0; i < numValues; ++i)
+        {
+            decibels[i] = static_cast<float>(-48.0 + 72.0 * noise[i]); // -120 to +24 dB
+            gains[i] = std::pow(10.f, decibels[i] / 20.f);
+        }
+    }
+
+    void runTrial(const Benchmarks::Config&, Benchmarks::Trial& trial) override
+    {
+        const auto numValues = static_cast<int>(gains.size());
+
+        record(trial, "gain to dB, log10", [&]
+        {
+            for (int i = 0; i < numValues; ++i)
+                output[static_cast<size_t>(i)] = juce::Decibels::gainToDecibels(gains[static_cast<size_t>(i)]);
+        });
+
+        record(trial, "dB to gain, pow", [&]
+        {
+            for (int i = 0; i < numValues; ++i)
+                output[static_cast<size_t>(i)] = juce::Decibels::decibelsToGain(decibels[static_cast<size_t>(i)], -200.f);
+        });
+
+        recordTier<FastMath::Accuracy::exact>(trial, "exact");
+        recordTier<FastMath::Accuracy::hundredthDb>(trial, "hundredthDb");
+        recordTier<FastMath::Accuracy::tenthDb>(trial, "tenthDb");
+    }
+
+private:
+    static constexpr int repeats = 1000;
+
+    std::vector<float> gains, decibels, output;
+
+    template <typename Function>
+    void record(Benchmarks::Trial& trial, const juce::String& stage, Function&& convertBlock)
+    {
+        trial.record(stage, Benchmarks::nanosecondsPerUnit(static_cast<double>(repeats) * static_cast<double>(gains.size()), [&]
+        {
+            for (int repeat = 0; repeat < repeats; ++repeat)
+                convertBlock();
+        }), "ns/value");
+    }
+
+    template <FastMath::Accuracy accuracy>
+    void recordTier(Benchmarks::Trial& trial, const juce::String& tier)
+    {
+        const auto numValues = static_cast<int>(gains.size());
+
+        record(trial, "gain to dB, " + tier, [&]
+        {
+            FastMath::gainToDecibels<accuracy>(gains.data(), output.data(), numValues);
+        });
+
+        record(trial, "dB to gain, " + tier, [&]
+        {
+            FastMath::decibelsToGain<accuracy>(decibels.data(), output.data(), numValues);
+        });
+    }
+};
+
+CrossoverModeBenchmark crossoverModeBenchmark;
+SampleTypeBenchmark sampleTypeBenchmark;
+TimeParallelBenchmark timeParallelBenchmark;
+OfflineRenderBenchmark offlineRenderBenchmark;
+FastMathBenchmark fastMathBenchmark;
+}
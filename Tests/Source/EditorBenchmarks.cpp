@@ -0,0 +1,129 @@
+//
+//  EditorBenchmarks.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "PluginEditor.h"
+#include "Benchmarks.h"
+#include "TestHelpers.h"
+
+// The editor painted headless, into offscreen images, as a window's repaint would
+
+namespace
+{
+constexpr int numChannels = 2;
+constexpr int framesPerTrial = 60; // one second of refresh ticks
+
+// Every frame feeds the processor a block of noise, lets the analyser take it in as a
+// refresh tick would, and paints the whole editor into an image. The analyser update
+// and the paint are timed apart. Painting after a look-and-feel change rebuilds the
+// analyser's cached layers, which otherwise only happens on a resize or a scale
+// change; painting at twice the scale is what a high-density display costs.
+class EditorPaintBenchmark : public Benchmarks::Benchmark
+{
+public:
+    EditorPaintBenchmark() : Benchmarks::Benchmark("editorPaint") {}
+
+    void prepare(const Benchmarks::Config& config) override
+    {
+        processor = std::make_unique<One_MBCompAudioProcessor>();
+        processor->setPlayConfigDetails(numChannels, numChannels, config.sampleRate, config.blockSize);
+        processor->prepareToPlay(config.sampleRate, config.blockSize);
+
+        const auto noise = TestHelpers::convert<float>(TestHelpers::noise(static_cast<size_t>(config.blockSize), 0.5));
+        input.setSize(numChannels, config.blockSize);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            input.copyFrom(channel, 0, noise.data(), config.blockSize);
+
+        editor.reset(processor->createEditor());
+
+        for (auto* child : editor->getChildren())
+        {
+            if (auto* spectrumAnalyser = dynamic_cast<SpectrumAnalyser*>(child))
+                analyser = spectrumAnalyser;
+        }
+
+        jassert(analyser != nullptr);
+
+        // Windows keep their back buffer from frame to frame
+        for (auto scale : { 1, 2 })
+            images.push_back(juce::Image(juce::Image::ARGB, scale * editor->getWidth(), scale * editor->getHeight(), true));
+    }
+
+    void runTrial(const Benchmarks::Config&, Benchmarks::Trial& trial) override
+    {
+        double updateNanoseconds = 0, paintNanoseconds = 0;
+        paint(1);
+
+        for (int frame = 0; frame < framesPerTrial; ++frame)
+        {
+            feedAudio();
+            updateNanoseconds += Benchmarks::nanosecondsPerUnit(1, [&] { analyser->updateContent(); });
+            paintNanoseconds += Benchmarks::nanosecondsPerUnit(1, [&] { paint(1); });
+        }
+
+        trial.record("analyser update", updateNanoseconds / framesPerTrial, "ns/frame");
+        trial.record("paint", paintNanoseconds / framesPerTrial, "ns/frame");
+
+        double rebuildNanoseconds = 0;
+
+        for (int frame = 0; frame < framesPerTrial; ++frame)
+        {
+            editor->sendLookAndFeelChange();
+            rebuildNanoseconds += Benchmarks::nanosecondsPerUnit(1, [&] { paint(1); });
+        }
+
+        trial.record("paint, layers rebuilt", rebuildNanoseconds / framesPerTrial, "ns/frame");
+
+        double doubleScaleNanoseconds = 0;
+        paint(2);
+
+        for (int frame = 0; frame < framesPerTrial; ++frame)
+        {
+            feedAudio();
+            analyser->updateContent();
+            doubleScaleNanoseconds += Benchmarks::nanosecondsPerUnit(1, [&] { paint(2); });
+        }
+
+        trial.record("paint, 2x scale", doubleScaleNanoseconds / framesPerTrial, "ns/frame");
+    }
+
+    void release() override
+    {
+        images.clear();
+        analyser = nullptr;
+        editor.reset();
+        processor->releaseResources();
+        processor.reset();
+    }
+
+private:
+    std::unique_ptr<One_MBCompAudioProcessor> processor;
+    std::unique_ptr<juce::AudioProcessorEditor> editor;
+    SpectrumAnalyser* analyser = nullptr;
+    juce::AudioBuffer<float> input, block;
+    std::vector<juce::Image> images;
+
+    void feedAudio()
+    {
+        juce::MidiBuffer midi;
+        block.makeCopyOf(input, true);
+        processor->processBlock(block, midi);
+    }
+
+    void paint(int scale)
+    {
+        juce::Graphics g(images[static_cast<size_t>(scale - 1)]);
+        g.addTransform(juce::AffineTransform::scale(static_cast<float>(scale)));
+        editor->paintEntireComponent(g, true);
+    }
+};
+
+EditorPaintBenchmark editorPaintBenchmark;
+}
@@ -0,0 +1,355 @@
+//
+//  EquivalenceTests.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "butterworthFilter.h"
+#include "BasicCompressor.h"
+#include "multibandCore.h"
+#include "AccuracyBudgets.h"
+#include "ReferenceModels.h"
+#include "TestHelpers.h"
+
+// The plugin's kernels against the MATLAB prototypes, through the stored vectors
+// in Tests/ReferenceVectors and the scalar ReferenceModels
+
+namespace
+{
+constexpr double vectorSampleRate = 44100.0;
+constexpr size_t oddBlockSize = 100; // not a multiple of any chunk or partition size
+
+struct FilterCase
+{
+    const char* resourceName;
+    double cutOffFrequency, qualityFactor;
+    FilterType type;
+    ReferenceModels::FilterType referenceType;
+};
+
+const FilterCase filterCases[]
+{
+    { "linkWorth_lowpass_txt", 300.0, 0.707, FilterType::lowpass, ReferenceModels::FilterType::lowpass },
+    { "linkWorth_highpass_txt", 5000.0, 0.5, FilterType::highpass, ReferenceModels::FilterType::highpass },
+    { "linkWorth_allpass_txt", 750.0, 0.707, FilterType::allpass, ReferenceModels::FilterType::allpass }
+};
+
+juce::String dbString(double decibels)
+{
+    return juce::String(decibels, 1) + " dB";
+}
+}
+
+class PrototypeFilterTests : public juce::UnitTest
+{
+public:
+    PrototypeFilterTests() : juce::UnitTest("Biquad sections against linkWorth*.m", "one_MBComp") {}
+
+    void runTest() override
+    {
+        for (const auto& filterCase : filterCases)
+        {
+            const TestHelpers::ReferenceVectors vectors(filterCase.resourceName);
+            const auto& input = vectors["input"];
+
+            beginTest(juce::String(filterCase.resourceName) + ": reference model reproduces the stored vectors");
+            {
+                const auto coefficients = ReferenceModels::setFilterParameters(filterCase.cutOffFrequency, filterCase.qualityFactor,
+                                                                               filterCase.referenceType, vectorSampleRate);
+                expectLessOrEqual(TestHelpers::maximumErrorDb(ReferenceModels::filterSignal(input, coefficients, 1), vectors["output"]),
+                                  AccuracyBudgets::doubleFiltersDb);
+                expectLessOrEqual(TestHelpers::maximumErrorDb(ReferenceModels::filterSignal(input, coefficients, 2), vectors["linkwitzRiley"]),
+                                  AccuracyBudgets::doubleFiltersDb);
+            }
+
+            for (int numPasses : { 1, 2 })
+            {
+                const auto& expected = vectors[numPasses == 1 ? "output" : "linkwitzRiley"];
+                const auto passes = juce::String(numPasses) + (numPasses == 1 ? " pass" : " passes");
+
+                beginTest(juce::String(filterCase.resourceName) + ", " + passes + ": double blocks");
+                {
+                    auto filter = makeFilter(filterCase);
+                    const auto output = TestHelpers::processInBlocks<double>(input, oddBlockSize, [&](auto& context)
+                    {
+                        filter.process(context, numPasses);
+                    });
+
+                    const auto errorDb = TestHelpers::maximumErrorDb(output, expected);
+                    logMessage("  error " + dbString(errorDb));
+                    expectLessOrEqual(errorDb, AccuracyBudgets::doubleFiltersDb);
+                }
+
+                beginTest(juce::String(filterCase.resourceName) + ", " + passes + ": float blocks");
+                {
+                    auto filter = makeFilter(filterCase);
+                    const auto output = TestHelpers::processInBlocks<float>(input, oddBlockSize, [&](auto& context)
+                    {
+                        filter.process(context, numPasses);
+                    });
+
+                    const auto errorDb = TestHelpers::maximumErrorDb(output, expected);
+                    logMessage("  error " + dbString(errorDb));
+                    expectLessOrEqual(errorDb, AccuracyBudgets::floatBlocksDb);
+                }
+            }
+
+            // processFilter() always runs the double kernel
+            beginTest(juce::String(filterCase.resourceName) + ": processFilter, one sample at a time");
+            {
+                auto filter = makeFilter(filterCase);
+                std::vector<double> output;
+
+                for (auto sample : input)
+                    output.push_back(filter.processFilter(sample, 0));
+
+                expectLessOrEqual(TestHelpers::maximumErrorDb(output, vectors["output"]), AccuracyBudgets::doubleFiltersDb);
+            }
+        }
+    }
+
+private:
+    static ButterFilter makeFilter(const FilterCase& filterCase)
+    {
+        ButterFilter filter(vectorSampleRate, filterCase.type);
+        filter.prepare({ vectorSampleRate, static_cast<juce::uint32>(oddBlockSize), 1 });
+        filter.setFilterParameters(filterCase.cutOffFrequency, filterCase.qualityFactor, filterCase.type);
+        return filter;
+    }
+};
+
+class PrototypeCompressorTests : public juce::UnitTest
+{
+public:
+    PrototypeCompressorTests() : juce::UnitTest("BasicCompressor against basicComp.m", "one_MBComp") {}
+
+    void runTest() override
+    {
+        // The settings each stored vector was generated with
+        check("basicComp_txt", { -10, 20, 2000, 6000, 0 });
+        check("basicComp_fast_txt", { -20, 4, 1, 20, 0 });
+    }
+
+private:
+    void check(const char* resourceName, const ReferenceModels::CompressorSettings& settings)
+    {
+        const TestHelpers::ReferenceVectors vectors(resourceName);
+        const auto& input = vectors["input"];
+        const auto& expected = vectors["output"];
+
+        beginTest(juce::String(resourceName) + ": reference model reproduces the stored vectors");
+        expectLessOrEqual(TestHelpers::maximumErrorDb(ReferenceModels::basicComp(input, settings, vectorSampleRate), expected),
+                          AccuracyBudgets::doubleFiltersDb);
+
+        beginTest(juce::String(resourceName) + ": double blocks");
+        {
+            auto compressor = makeCompressor(settings);
+            const auto output = TestHelpers::processInBlocks<double>(input, oddBlockSize, [&](auto& context)
+            {
+                compressor->process(context);
+            });
+
+            const auto errorDb = TestHelpers::maximumErrorDb(output, expected);
+            logMessage("  error " + dbString(errorDb));
+            expectLessOrEqual(errorDb, AccuracyBudgets::doubleCompressorDb);
+        }
+
+        beginTest(juce::String(resourceName) + ": float blocks");
+        {
+            auto compressor = makeCompressor(settings);
+            const auto output = TestHelpers::processInBlocks<float>(input, oddBlockSize, [&](auto& context)
+            {
+                compressor->process(context);
+            });
+
+            const auto errorDb = TestHelpers::maximumErrorDb(output, expected);
+            logMessage("  error " + dbString(errorDb));
+            expectLessOrEqual(errorDb, AccuracyBudgets::floatBlocksDb);
+        }
+    }
+
+    static std::unique_ptr<BasicCompressor> makeCompressor(const ReferenceModels::CompressorSettings& settings)
+    {
+        auto compressor = std::make_unique<BasicCompressor>();
+        compressor->prepare({ vectorSampleRate, static_cast<juce::uint32>(oddBlockSize), 1 });
+        compressor->setAttackTime(static_cast<float>(settings.tauAttack));
+        compressor->setReleaseTime(static_cast<float>(settings.tauRelease));
+        compressor->setThresholdLevel(static_cast<float>(settings.threshold));
+        compressor->setCompressionRatio(static_cast<float>(settings.ratio));
+        compressor->setMakeUpGain(static_cast<float>(settings.makeUpGain));
+        compressor->reset();
+        return compressor;
+    }
+};
+
+class PrototypeChainTests : public juce::UnitTest
+{
+public:
+    PrototypeChainTests() : juce::UnitTest("MultibandCore against the prototype chain", "one_MBComp") {}
+
+    void runTest() override
+    {
+        const TestHelpers::ReferenceVectors vectors("multibandChain_txt");
+        const auto& input = vectors["input"];
+        const auto& expected = vectors["output"];
+
+        // The settings multibandChain.txt was generated with
+        MultibandCore::Settings settings;
+        settings.lowMidFrequency = 400.f;
+        settings.midHighFrequency = 2000.f;
+
+        for (auto& band : settings.bands)
+        {
+            band.thresholdDb = -18.f;
+            band.ratio = 4.f;
+            band.attackMs = 5.f;
+            band.releaseMs = 50.f;
+        }
+
+        beginTest("Reference model reproduces the stored vectors");
+        expectLessOrEqual(TestHelpers::maximumErrorDb(ReferenceModels::multibandSum(ReferenceModels::multibandBands(input, 400, 2000, { -18, 4, 5, 50, 0 },
+                                                                                                                      vectorSampleRate)),
+                                                      expected),
+                          AccuracyBudgets::doubleFiltersDb);
+
+        beginTest("Biquad engine, double blocks");
+        {
+            MultibandCore core;
+            core.setSettings(settings);
+            core.prepare(vectorSampleRate, 64, 1, true);
+
+            const auto errorDb = TestHelpers::maximumErrorDb(TestHelpers::processCore<double>(core, input, oddBlockSize), expected);
+            logMessage("  error " + dbString(errorDb));
+            expectLessOrEqual(errorDb, AccuracyBudgets::doubleCompressorDb);
+        }
+
+        beginTest("Biquad engine, float blocks");
+        {
+            MultibandCore core;
+            core.setSettings(settings);
+            core.prepare(vectorSampleRate, 64, 1);
+
+            const auto errorDb = TestHelpers::maximumErrorDb(TestHelpers::processCore<float>(core, input, oddBlockSize), expected);
+            logMessage("  error " + dbString(errorDb));
+            expectLessOrEqual(errorDb, AccuracyBudgets::floatBlocksDb);
+        }
+
+        beginTest("Float blocks against double blocks, full-scale noise");
+        {
+            // The float path's rounding noise on its own, with nothing else differing
+            const auto noise = TestHelpers::noise(static_cast<size_t>(vectorSampleRate), 1.0);
+
+            auto run = [&](auto sampleType)
+            {
+                using SampleType = decltype(sampleType);
+
+                MultibandCore core;
+                core.setSettings(settings);
+                core.prepare(vectorSampleRate, 64, 1, std::is_same<SampleType, double>::value);
+
+                const auto output = TestHelpers::processCore<SampleType>(core, noise, oddBlockSize);
+                return std::vector<double>(output.begin(), output.end());
+            };
+
+            const auto errorDb = TestHelpers::maximumErrorDb(run(float()), run(double()));
+            logMessage("  error " + dbString(errorDb));
+            expectLessOrEqual(errorDb, AccuracyBudgets::floatNoiseFloorDb);
+        }
+
+        beginTest("Float blocks, crossover below 1/1000 of the sample rate");
+        {
+            // The low band at a 20 Hz crossover, compressed, against the same sections in double
+            constexpr double sampleRate = 48000.0;
+            const auto noise = TestHelpers::noise(static_cast<size_t>(sampleRate), 0.9);
+
+            auto lowBand = [&](auto sampleType)
+            {
+                using SampleType = decltype(sampleType);
+                const juce::dsp::ProcessSpec spec { sampleRate, static_cast<juce::uint32>(oddBlockSize), 1 };
+
+                LinkwitzRFilter lowPass(sampleRate), allPass(sampleRate);
+                lowPass.setType(FilterType::lowpass);
+                allPass.setType(FilterType::allpass);
+                lowPass.prepare(spec);
+                allPass.prepare(spec);
+                lowPass.setCrossoverFrequency(20.0);
+                allPass.setCrossoverFrequency(2000.0);
+
+                BasicCompressor compressor;
+                compressor.prepare(spec);
+                compressor.setAttackTime(5.f);
+                compressor.setReleaseTime(50.f);
+                compressor.setThresholdLevel(-30.f);
+                compressor.setCompressionRatio(4.f);
+                compressor.reset();
+
+                return TestHelpers::processInBlocks<SampleType>(noise, oddBlockSize, [&](auto& context)
+                {
+                    lowPass.process(context);
+                    allPass.process(context);
+                    compressor.process(context);
+                });
+            };
+
+            const auto doubleOutput = lowBand(double());
+            const auto errorDb = TestHelpers::maximumErrorDb(lowBand(float()), std::vector<double>(doubleOutput.begin(), doubleOutput.end()));
+            logMessage("  error " + dbString(errorDb));
+            expectLessOrEqual(errorDb, AccuracyBudgets::lowCrossoverFloatDb);
+        }
+
+        beginTest("Filter state carried through a cutoff that moves float blocks to double");
+        {
+            // A section moved from 2 kHz to 20 Hz half way through, run as double blocks,
+            // as float blocks and a sample at a time with processFilter(), each against
+            // the double blocks. Whichever kernel runs next has to pick up the state.
+            constexpr double sampleRate = 48000.0;
+            const auto noise = TestHelpers::noise(static_cast<size_t>(sampleRate), 0.9);
+            const auto half = noise.size() / 2;
+
+            auto makeSection = [&](double cutOffFrequency)
+            {
+                ButterFilter section(sampleRate, FilterType::lowpass);
+                section.prepare({ sampleRate, static_cast<juce::uint32>(oddBlockSize), 1 });
+                section.setFilterParameters(cutOffFrequency, 0.707, FilterType::lowpass);
+                return section;
+            };
+
+            auto inBlocks = [&](auto sampleType)
+            {
+                using SampleType = decltype(sampleType);
+                auto section = makeSection(2000.0);
+                std::vector<double> halves[2] { { noise.begin(), noise.begin() + static_cast<std::ptrdiff_t>(half) },
+                                                { noise.begin() + static_cast<std::ptrdiff_t>(half), noise.end() } };
+
+                auto output = TestHelpers::processInBlocks<SampleType>(halves[0], oddBlockSize, [&](auto& context) { section.process(context); });
+                section.setFilterParameters(20.0, 0.707, FilterType::lowpass);
+                const auto second = TestHelpers::processInBlocks<SampleType>(halves[1], oddBlockSize, [&](auto& context) { section.process(context); });
+                output.insert(output.end(), second.begin(), second.end());
+                return std::vector<double>(output.begin(), output.end());
+            };
+
+            const auto expected = inBlocks(double());
+
+            auto section = makeSection(2000.0);
+            std::vector<double> oneAtATime;
+
+            for (size_t i = 0; i < noise.size(); ++i)
+            {
+                if (i == half)
+                    section.setFilterParameters(20.0, 0.707, FilterType::lowpass);
+
+                oneAtATime.push_back(section.processFilter(noise[i], 0));
+            }
+
+            expectLessOrEqual(TestHelpers::maximumErrorDb(oneAtATime, expected), AccuracyBudgets::doubleFiltersDb, "processFilter()");
+            expectLessOrEqual(TestHelpers::maximumErrorDb(inBlocks(float()), expected), AccuracyBudgets::floatBlocksDb, "float blocks");
+        }
+    }
+};
+
+static PrototypeFilterTests prototypeFilterTests;
+static PrototypeCompressorTests prototypeCompressorTests;
+static PrototypeChainTests prototypeChainTests;
@@ -0,0 +1,219 @@
+//
+//  FastModeTests.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "butterworthFilter.h"
+#include "BasicCompressor.h"
+#include "multibandCore.h"
+#include "fastMath.h"
+#include "AccuracyBudgets.h"
+#include "ReferenceModels.h"
+#include "TestHelpers.h"
+
+// The fast paths against the exact paths they stand in for
+
+namespace
+{
+constexpr double sampleRate = 48000.0;
+
+// The largest gain difference, in dB, between two outputs of the same input,
+// over the samples loud enough to measure it
+template <typename SampleType>
+double largestGainDifferenceDb(const std::vector<SampleType>& output, const std::vector<SampleType>& reference, const std::vector<double>& input)
+{
+    double difference = 0;
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        if (std::abs(input[i]) > 1e-3)
+            difference = juce::jmax(difference, std::abs(20 * std::log10(static_cast<double>(output[i]) / static_cast<double>(reference[i]))));
+    }
+
+    return difference;
+}
+}
+
+class TimeParallelTests : public juce::UnitTest
+{
+public:
+    TimeParallelTests() : juce::UnitTest("timeParallelBiquads", "one_MBComp") {}
+
+    void runTest() override
+    {
+        const auto input = TestHelpers::noise(static_cast<size_t>(sampleRate), 0.9);
+
+        for (auto lowMidFrequency : { 120.f, 400.f })
+        {
+            beginTest("Core with a " + juce::String(lowMidFrequency) + " Hz crossover against sample-by-sample sections");
+
+            auto run = [&](bool timeParallel)
+            {
+                MultibandCore::Settings settings;
+                settings.lowMidFrequency = lowMidFrequency;
+                settings.timeParallelBiquads = timeParallel;
+
+                for (auto& band : settings.bands)
+                {
+                    band.thresholdDb = -24.f;
+                    band.ratio = 4.f;
+                    band.attackMs = 5.f;
+                    band.releaseMs = 50.f;
+                }
+
+                MultibandCore core;
+                core.setSettings(settings);
+                core.prepare(sampleRate, 64, 1);
+
+                const auto output = TestHelpers::processCore<float>(core, input, 256);
+                return std::vector<double>(output.begin(), output.end());
+            };
+
+            const auto errorDb = TestHelpers::maximumErrorDb(run(true), run(false));
+            logMessage("  error " + juce::String(errorDb, 1) + " dB");
+            expectLessOrEqual(errorDb, AccuracyBudgets::timeParallelDb);
+        }
+    }
+};
+
+class ControlRateDetectorTests : public juce::UnitTest
+{
+public:
+    ControlRateDetectorTests() : juce::UnitTest("Control-rate detector", "one_MBComp") {}
+
+    void runTest() override
+    {
+        // A 400 Hz low band with a slow swell, so the compressor attacks and releases
+        auto input = TestHelpers::noise(static_cast<size_t>(2 * sampleRate), 1.0);
+        input = ReferenceModels::linkwitzRiley(input, 400.0, ReferenceModels::FilterType::lowpass, sampleRate);
+
+        for (size_t i = 0; i < input.size(); ++i)
+            input[i] *= 2.0 * (1.0 + 0.9 * std::sin(juce::MathConstants<double>::twoPi * 3.0 * double(i) / sampleRate));
+
+        const auto everySample = compress(input, 1);
+
+        for (size_t i = 0; i < AccuracyBudgets::controlRateDecimations.size(); ++i)
+        {
+            const auto decimation = AccuracyBudgets::controlRateDecimations[i];
+            beginTest("Every " + juce::String(decimation) + " samples against every sample");
+
+            const auto differenceDb = largestGainDifferenceDb(compress(input, decimation), everySample, input);
+            logMessage("  largest gain difference " + juce::String(differenceDb, 2) + " dB");
+            expectLessOrEqual(differenceDb, AccuracyBudgets::controlRateGainDb[i]);
+        }
+    }
+
+private:
+    static std::vector<float> compress(const std::vector<double>& input, int decimation)
+    {
+        BasicCompressor compressor;
+        compressor.prepare({ sampleRate, 64, 1 });
+        compressor.setAttackTime(5.f);
+        compressor.setReleaseTime(50.f);
+        compressor.setThresholdLevel(-30.f);
+        compressor.setCompressionRatio(4.f);
+        compressor.setDetectorDecimation(decimation);
+        compressor.reset();
+
+        return TestHelpers::processInBlocks<float>(input, 64, [&](auto& context)
+        {
+            compressor.process(context);
+        });
+    }
+};
+
+class SettledBlockTests : public juce::UnitTest
+{
+public:
+    SettledBlockTests() : juce::UnitTest("Settled blocks below threshold", "one_MBComp") {}
+
+    void runTest() override
+    {
+        // Mostly quiet material, with a loud burst every half second to wake the envelope
+        auto input = TestHelpers::noise(static_cast<size_t>(4 * sampleRate), 0.01);
+        for (size_t i = 0; i < input.size(); ++i)
+        {
+            if (i % 24000 < 2400)
+                input[i] *= 80.0;
+        }
+
+        const ReferenceModels::CompressorSettings settings { -20, 4, 5, 50, 0 };
+
+        beginTest("Compress, double blocks, against basicComp.m");
+        {
+            BasicCompressor compressor;
+            compressor.prepare({ sampleRate, 256, 1 });
+            compressor.setAttackTime(static_cast<float>(settings.tauAttack));
+            compressor.setReleaseTime(static_cast<float>(settings.tauRelease));
+            compressor.setThresholdLevel(static_cast<float>(settings.threshold));
+            compressor.setCompressionRatio(static_cast<float>(settings.ratio));
+            compressor.reset();
+
+            const auto output = TestHelpers::processInBlocks<double>(input, 256, [&](auto& context)
+            {
+                compressor.process(context);
+            });
+
+            const auto reference = ReferenceModels::basicComp(input, settings, sampleRate);
+            const auto differenceDb = largestGainDifferenceDb(output, reference, input);
+            logMessage("  largest gain difference " + juce::String(differenceDb, 7) + " dB");
+            expectLessOrEqual(differenceDb, AccuracyBudgets::settledBlockGainDb);
+        }
+    }
+};
+
+class FastMathTests : public juce::UnitTest
+{
+public:
+    FastMathTests() : juce::UnitTest("FastMath", "one_MBComp") {}
+
+    void runTest() override
+    {
+        check<FastMath::Accuracy::exact>("exact", AccuracyBudgets::fastMathDb[0]);
+        check<FastMath::Accuracy::hundredthDb>("hundredthDb", AccuracyBudgets::fastMathDb[1]);
+        check<FastMath::Accuracy::tenthDb>("tenthDb", AccuracyBudgets::fastMathDb[2]);
+    }
+
+private:
+    static constexpr int numPoints = 1 << 20;
+    static constexpr float floorDb = -200.f; // below the sweep, so nothing is floored
+
+    template <FastMath::Accuracy accuracy>
+    void check(const juce::String& tier, double budgetDb)
+    {
+        beginTest("The " + tier + " tier against log10 and pow");
+
+        // Gains and levels swept evenly in dB, so every octave gets the same density
+        double toDecibelsDb = 0, toGainDb = 0, roundTripDb = 0;
+
+        for (int i = 0; i <= numPoints; ++i)
+        {
+            const auto position = static_cast<double>(i) / numPoints;
+            const auto gain = static_cast<float>(std::pow(10.0, -6.0 + position * std::log10(16.0 * 1e6)));
+            const auto decibels = static_cast<float>(-120.0 + position * 144.0);
+
+            const auto fastDecibels = FastMath::gainToDecibels<accuracy>(gain, floorDb);
+            toDecibelsDb = juce::jmax(toDecibelsDb, std::abs(fastDecibels - 20.0 * std::log10(static_cast<double>(gain))));
+
+            const auto fastGain = FastMath::decibelsToGain<accuracy>(decibels);
+            toGainDb = juce::jmax(toGainDb, std::abs(20.0 * std::log10(fastGain / std::pow(10.0, decibels / 20.0))));
+
+            const auto roundTrip = FastMath::decibelsToGain<accuracy>(fastDecibels);
+            roundTripDb = juce::jmax(roundTripDb, std::abs(20.0 * std::log10(static_cast<double>(roundTrip) / gain)));
+        }
+
+        logMessage("  gain to dB " + juce::String(toDecibelsDb, 7) + " dB, dB to gain " + juce::String(toGainDb, 7)
+                   + " dB, round trip " + juce::String(roundTripDb, 7) + " dB");
+        expectLessOrEqual(toDecibelsDb, budgetDb);
+        expectLessOrEqual(toGainDb, budgetDb);
+        expectLessOrEqual(roundTripDb, budgetDb);
+    }
+};
+
+static TimeParallelTests timeParallelTests;
+static ControlRateDetectorTests controlRateDetectorTests;
+static SettledBlockTests settledBlockTests;
+static FastMathTests fastMathTests;
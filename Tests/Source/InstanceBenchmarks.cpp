@@ -0,0 +1,138 @@
+//
+//  InstanceBenchmarks.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "Benchmarks.h"
+
+// What a host pays per plugin instance when it opens a session
+
+namespace
+{
+constexpr int numChannels = 2;
+constexpr int numInstances = 32; // a large session
+
+// Constructing numInstances processors, in ns per instance: the parameter layout on
+// its own, as the descriptor table builds it, then the whole constructor, which also
+// builds the APVTS and resolves the parameters by position
+class InstantiateBenchmark : public Benchmarks::Benchmark
+{
+public:
+    InstantiateBenchmark() : Benchmarks::Benchmark("instantiate") {}
+
+    void prepare(const Benchmarks::Config&) override {}
+
+    void runTrial(const Benchmarks::Config&, Benchmarks::Trial& trial) override
+    {
+        std::vector<One_MBCompAudioProcessor::APVTS::ParameterLayout> layouts;
+        layouts.reserve(numInstances);
+
+        trial.record("parameter layout", Benchmarks::nanosecondsPerUnit(numInstances, [&]
+        {
+            for (int instance = 0; instance < numInstances; ++instance)
+                layouts.push_back(One_MBCompAudioProcessor::createParameterLayout());
+        }), "ns/instance");
+
+        layouts.clear();
+        instances.reserve(numInstances);
+
+        trial.record("construct", Benchmarks::nanosecondsPerUnit(numInstances, [&]
+        {
+            for (int instance = 0; instance < numInstances; ++instance)
+                instances.push_back(std::make_unique<One_MBCompAudioProcessor>());
+        }), "ns/instance");
+
+        // Destruction is outside the timings
+        instances.clear();
+    }
+
+private:
+    std::vector<std::unique_ptr<One_MBCompAudioProcessor>> instances;
+};
+
+// A session of numInstances processors loaded from saved state, in ns per instance:
+// the state restored into processors that already exist, from the binary blob and
+// from the ValueTree blob sessions saved before it, then the whole load as a host
+// does it, constructing each processor, restoring its state and preparing it.
+// The saved state moves every parameter off its default, except the crossover mode,
+// which stays on Biquad so preparing doesn't build the Linear Phase kernels.
+class SessionLoadBenchmark : public Benchmarks::Benchmark
+{
+public:
+    SessionLoadBenchmark() : Benchmarks::Benchmark("sessionLoad") {}
+
+    void prepare(const Benchmarks::Config&) override
+    {
+        using namespace PluginParameters;
+
+        One_MBCompAudioProcessor source;
+        const auto modeID = GetParameters().at(Crossover_Mode);
+
+        for (auto* parameter : source.getParameters())
+        {
+            auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter);
+
+            if (ranged != nullptr && ranged->paramID != modeID)
+                ranged->setValueNotifyingHost(ranged->getDefaultValue() < 0.5f ? 0.7f : 0.3f);
+        }
+
+        source.getStateInformation(binaryState);
+
+        juce::MemoryOutputStream stream(valueTreeState, false);
+        source.apvts.copyState().writeToStream(stream);
+    }
+
+    void runTrial(const Benchmarks::Config& config, Benchmarks::Trial& trial) override
+    {
+        for (int instance = 0; instance < numInstances; ++instance)
+            instances.push_back(std::make_unique<One_MBCompAudioProcessor>());
+
+        trial.record("restore, binary state", restoreAll(binaryState), "ns/instance");
+        trial.record("restore, ValueTree state", restoreAll(valueTreeState), "ns/instance");
+        instances.clear();
+
+        trial.record("construct, restore and prepare", Benchmarks::nanosecondsPerUnit(numInstances, [&]
+        {
+            for (int instance = 0; instance < numInstances; ++instance)
+            {
+                auto processor = std::make_unique<One_MBCompAudioProcessor>();
+                processor->setStateInformation(binaryState.getData(), static_cast<int>(binaryState.getSize()));
+                processor->setPlayConfigDetails(numChannels, numChannels, config.sampleRate, config.blockSize);
+                processor->prepareToPlay(config.sampleRate, config.blockSize);
+                instances.push_back(std::move(processor));
+            }
+        }), "ns/instance");
+
+        // Destruction is outside the timings
+        instances.clear();
+    }
+
+    void release() override
+    {
+        instances.clear();
+        binaryState.reset();
+        valueTreeState.reset();
+    }
+
+private:
+    juce::MemoryBlock binaryState, valueTreeState;
+    std::vector<std::unique_ptr<One_MBCompAudioProcessor>> instances;
+
+    double restoreAll(const juce::MemoryBlock& state)
+    {
+        return Benchmarks::nanosecondsPerUnit(numInstances, [&]
+        {
+            for (auto& processor : instances)
+                processor->setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+        });
+    }
+};
+
+InstantiateBenchmark instantiateBenchmark;
+SessionLoadBenchmark sessionLoadBenchmark;
+}
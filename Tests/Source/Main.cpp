@@ -0,0 +1,35 @@
+//
+//  Main.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "Benchmarks.h"
+
+// Runs every test in the one_MBComp category and exits with 1 if any failed.
+// With --benchmark or --compare it runs or compares benchmarks instead, see Benchmarks.h.
+int main(int argc, char* argv[])
+{
+    juce::StringArray arguments;
+    for (int i = 1; i < argc; ++i)
+        arguments.add(argv[i]);
+
+    if (arguments.contains("--benchmark"))
+        return Benchmarks::run(arguments);
+
+    if (arguments.contains("--compare"))
+        return Benchmarks::compare(arguments);
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTestsInCategory("one_MBComp");
+
+    int numFailures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        numFailures += runner.getResult(i)->failures;
+
+    return numFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+//
+//  MemoryTests.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "multibandCore.h"
+#include "linearPhaseCrossover.h"
+#include "TestHelpers.h"
+
+// What each instance of the core holds on the heap, measured rather than estimated,
+// and what it shares with every other instance in the process
+
+namespace
+{
+constexpr double sampleRate = 48000.0;
+constexpr int maximumBlockSize = 512;
+constexpr int numChannels = 2;
+
+// Room for the allocator's own bookkeeping in a comparison of two heap levels
+constexpr size_t heapSlackBytes = 16 * 1024;
+
+MultibandCore::Settings makeSettings(MultibandCore::CrossoverMode mode)
+{
+    MultibandCore::Settings settings;
+    settings.crossoverMode = mode;
+    return settings;
+}
+
+// How far the heap has grown since it held before bytes, or 0 if it shrank
+size_t heapGrowthSince(size_t before)
+{
+    const auto now = TestHelpers::heapBytesInUse();
+    return now > before ? now - before : 0;
+}
+
+// How far the heap grew while function ran
+template <typename Function>
+size_t heapGrowth(Function&& function)
+{
+    const auto before = TestHelpers::heapBytesInUse();
+    function();
+    return heapGrowthSince(before);
+}
+
+juce::String kilobytes(size_t bytes)
+{
+    return juce::String(static_cast<double>(bytes) / 1024.0, 1) + " KB";
+}
+}
+
+class InstanceMemoryTests : public juce::UnitTest
+{
+public:
+    InstanceMemoryTests() : juce::UnitTest("Per-instance memory", "one_MBComp") {}
+
+    void runTest() override
+    {
+        beginTest("Stereo cores at " + juce::String(sampleRate / 1000.0) + " kHz, " + juce::String(maximumBlockSize) + "-sample blocks");
+
+        if (TestHelpers::heapBytesInUse() == 0)
+        {
+            logMessage("  this platform doesn't report its heap; nothing measured");
+            return;
+        }
+
+        // Both cores exist for the whole test, so the shared resources and the kernel
+        // designer are made by the first and kept until the end
+        std::array<std::unique_ptr<MultibandCore>, 2> cores;
+
+        auto prepareCore = [](std::unique_ptr<MultibandCore>& core)
+        {
+            core = std::make_unique<MultibandCore>();
+            core->setSettings(makeSettings(MultibandCore::CrossoverMode::biquad));
+            core->prepare(sampleRate, maximumBlockSize, numChannels);
+        };
+
+        auto selectLinearPhase = [&](MultibandCore& core, bool linearPhase)
+        {
+            core.setSettings(makeSettings(linearPhase ? MultibandCore::CrossoverMode::linearPhase : MultibandCore::CrossoverMode::biquad));
+            expect(TestHelpers::waitForLinearPhase(core, linearPhase), "the designer never got to the request");
+        };
+
+        // Selects Linear Phase on both cores, then Biquad again, and returns how much of
+        // the heap stayed. The designer frees the engines after it has marked them not
+        // ready, so this gives it a moment to finish.
+        auto linearPhaseRound = [&](size_t& perInstance)
+        {
+            const auto before = TestHelpers::heapBytesInUse();
+            heapGrowth([&] { selectLinearPhase(*cores[0], true); });
+            perInstance = heapGrowth([&] { selectLinearPhase(*cores[1], true); });
+
+            for (auto& core : cores)
+                selectLinearPhase(*core, false);
+
+            auto kept = heapGrowthSince(before);
+
+            for (int attempt = 0; attempt < 200 && kept > heapSlackBytes; ++attempt)
+            {
+                juce::Thread::sleep(5);
+                kept = heapGrowthSince(before);
+            }
+
+            return kept;
+        };
+
+        // The first instance in the process also makes the shared resources and starts
+        // the kernel designer thread, unless an earlier test left them running
+        const auto firstBiquad = heapGrowth([&] { prepareCore(cores[0]); });
+        const auto furtherBiquad = heapGrowth([&] { prepareCore(cores[1]); });
+
+        // The first Linear Phase engine in the process also builds the shared FFT plans
+        // and the designer's scratch buffers, which stay for later engines. After that,
+        // an engine gives back everything it took.
+        size_t linearPhase = 0;
+        const auto keptByFirstRound = linearPhaseRound(linearPhase);
+        const auto keptBySecondRound = linearPhaseRound(linearPhase);
+
+        // What every Linear Phase instance held on its own before the plans were shared:
+        // one FFT of two partitions and one of the kernel length
+        const auto kernelLength = LinearPhaseCrossover::getKernelLength(sampleRate);
+        const auto partitionSize = juce::jlimit(LinearPhaseCrossover::minimumPartitionSize, kernelLength, juce::nextPowerOfTwo(maximumBlockSize));
+        std::unique_ptr<juce::dsp::FFT> partitionFFT, kernelFFT;
+
+        const auto fftPlans = heapGrowth([&]
+        {
+            partitionFFT = std::make_unique<juce::dsp::FFT>(juce::roundToInt(std::log2(2 * partitionSize)));
+            kernelFFT = std::make_unique<juce::dsp::FFT>(juce::roundToInt(std::log2(kernelLength)));
+        });
+
+        logMessage("  Biquad or TPT instance: " + kilobytes(furtherBiquad) + "; the first in the process: " + kilobytes(firstBiquad));
+        logMessage("  Linear Phase adds " + kilobytes(linearPhase) + " per instance while selected");
+        logMessage("  kept once per process after the first Linear Phase engine: " + kilobytes(keptByFirstRound)
+                   + "; after later ones: " + kilobytes(keptBySecondRound));
+        logMessage("  FFT plans each Linear Phase instance held before they were shared: " + kilobytes(fftPlans));
+
+        expectLessOrEqual(furtherBiquad, linearPhase / 4, "a Biquad instance holds part of the Linear Phase engine");
+        expectLessOrEqual(keptBySecondRound, heapSlackBytes, "leaving Linear Phase didn't give the instances' engines back");
+
+        for (auto& core : cores)
+            core->release();
+    }
+};
+
+static InstanceMemoryTests instanceMemoryTests;
@@ -0,0 +1,240 @@
+//
+//  PluginBenchmarks.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "Benchmarks.h"
+#include "TestHelpers.h"
+
+// The plugin's processBlock chain, whole and stage by stage
+
+namespace
+{
+constexpr int numChannels = 2;
+
+// processBlock as a host calls it, then each of its stages on its own with the same
+// settings: the analyser FIFOs, the input gain, the band split, the compressors and
+// the core, which is the band split, the compressors and the band sum together.
+// The stages don't add up to the total exactly; the rest is parameter handling,
+// the bypass path and the metering.
+class ProcessBlockBenchmark : public Benchmarks::Benchmark
+{
+public:
+    ProcessBlockBenchmark() : Benchmarks::Benchmark("processBlock") {}
+
+    void prepare(const Benchmarks::Config& config) override
+    {
+        using namespace PluginParameters;
+
+        processor = std::make_unique<One_MBCompAudioProcessor>();
+        processor->setPlayConfigDetails(numChannels, numChannels, config.sampleRate, config.blockSize);
+
+        // Low enough that every band compresses full-scale noise
+        for (auto name : { Threshold_LB, Threshold_MB, Threshold_HB })
+        {
+            auto* parameter = processor->apvts.getParameter(GetParameters().at(name));
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(-30.f));
+        }
+
+        processor->prepareToPlay(config.sampleRate, config.blockSize);
+
+        // One second of stereo noise, and a copy for each stage to work on
+        numSamples = static_cast<int>(config.sampleRate);
+        input.setSize(numChannels, numSamples);
+        const auto noise = TestHelpers::convert<float>(TestHelpers::noise(static_cast<size_t>(numSamples), 0.9));
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            input.copyFrom(channel, 0, noise.data(), numSamples);
+
+        working.makeCopyOf(input);
+
+        const juce::dsp::ProcessSpec spec { config.sampleRate, static_cast<juce::uint32>(config.blockSize), numChannels };
+        gain.prepare(spec);
+        gain.setGainDecibels(3.f);
+
+        leftFifo.prepare(config.blockSize);
+        rightFifo.prepare(config.blockSize);
+
+        // The biquad crossover's sections: LP1, AP2, HP1, LP2, HP2
+        for (auto& section : sections)
+        {
+            section = std::make_unique<LinkwitzRFilter>(config.sampleRate);
+            section->prepare(spec);
+        }
+
+        sections[0]->setType(FilterType::lowpass);
+        sections[1]->setType(FilterType::allpass);
+        sections[2]->setType(FilterType::highpass);
+        sections[3]->setType(FilterType::lowpass);
+        sections[4]->setType(FilterType::highpass);
+
+        for (auto* section : { sections[0].get(), sections[2].get() })
+            section->setCrossoverFrequency(400.0);
+
+        for (auto* section : { sections[1].get(), sections[3].get(), sections[4].get() })
+            section->setCrossoverFrequency(2000.0);
+
+        bands.setSize(numChannels * 3, config.blockSize);
+
+        for (auto& compressor : compressors)
+        {
+            compressor = std::make_unique<BasicCompressor>();
+            compressor->prepare(spec);
+            compressor->setAttackTime(5.f);
+            compressor->setReleaseTime(50.f);
+            compressor->setThresholdLevel(-30.f);
+            compressor->setCompressionRatio(4.f);
+            compressor->reset();
+        }
+
+        core.setSettings(makeCoreSettings());
+        core.prepare(config.sampleRate, config.blockSize, numChannels);
+    }
+
+    void runTrial(const Benchmarks::Config& config, Benchmarks::Trial& trial) override
+    {
+        juce::MidiBuffer midi;
+
+        record(trial, config, "processBlock total", [&](juce::AudioBuffer<float>& block)
+        {
+            processor->processBlock(block, midi);
+        });
+
+        record(trial, config, "analyserFifo", [&](juce::AudioBuffer<float>& block)
+        {
+            leftFifo.update(block);
+            rightFifo.update(block);
+        });
+
+        record(trial, config, "inputGain", [&](juce::AudioBuffer<float>& block)
+        {
+            auto audioBlock = juce::dsp::AudioBlock<float>(block);
+            gain.process(juce::dsp::ProcessContextReplacing<float>(audioBlock));
+        });
+
+        record(trial, config, "crossover", [&](juce::AudioBuffer<float>& block)
+        {
+            split(block);
+        });
+
+        // The compressors on the bands of the block, split outside the timing
+        double compressorNanoseconds = 0;
+        working.makeCopyOf(input, true);
+
+        for (int start = 0; start < numSamples; start += config.blockSize)
+        {
+            const auto length = juce::jmin(config.blockSize, numSamples - start);
+            juce::AudioBuffer<float> block(working.getArrayOfWritePointers(), numChannels, start, length);
+            split(block);
+
+            compressorNanoseconds += length * Benchmarks::nanosecondsPerUnit(length, [&]
+            {
+                for (size_t band = 0; band < compressors.size(); ++band)
+                {
+                    auto bandBlock = juce::dsp::AudioBlock<float>(bands).getSubsetChannelBlock(band * numChannels, numChannels)
+                                                                        .getSubBlock(0, static_cast<size_t>(length));
+                    juce::dsp::ProcessContextReplacing<float> context(bandBlock);
+                    compressors[band]->process(context);
+                }
+            });
+        }
+
+        trial.record("compressors", compressorNanoseconds / numSamples);
+
+        record(trial, config, "core", [&](juce::AudioBuffer<float>& block)
+        {
+            core.process(block.getArrayOfWritePointers(), numChannels, block.getNumSamples());
+        });
+    }
+
+    void release() override
+    {
+        processor->releaseResources();
+        processor.reset();
+        core.release();
+    }
+
+private:
+    std::unique_ptr<One_MBCompAudioProcessor> processor;
+    juce::AudioBuffer<float> input, working, bands;
+    int numSamples = 0;
+
+    juce::dsp::Gain<float> gain;
+
+    SingleChannelSampleFifo<juce::AudioBuffer<float>> leftFifo { Channel::Left }, rightFifo { Channel::Right };
+
+    std::array<std::unique_ptr<LinkwitzRFilter>, 5> sections;
+    std::array<std::unique_ptr<BasicCompressor>, 3> compressors;
+    MultibandCore core;
+
+    static MultibandCore::Settings makeCoreSettings()
+    {
+        MultibandCore::Settings settings;
+
+        for (auto& band : settings.bands)
+        {
+            band.thresholdDb = -30.f;
+            band.ratio = 4.f;
+            band.attackMs = 5.f;
+            band.releaseMs = 50.f;
+        }
+
+        return settings;
+    }
+
+    // Splits the block into the three bands as the core does: low = LP1 then AP2,
+    // mid = HP1 then LP2, high = the mid band's HP1 output then HP2
+    void split(const juce::AudioBuffer<float>& block)
+    {
+        const auto numBlockSamples = block.getNumSamples();
+        auto allBands = juce::dsp::AudioBlock<float>(bands);
+
+        auto bandBlock = [&](int band)
+        {
+            return allBands.getSubsetChannelBlock(static_cast<size_t>(band * numChannels), numChannels)
+                           .getSubBlock(0, static_cast<size_t>(numBlockSamples));
+        };
+
+        auto process = [&](int band, LinkwitzRFilter& section)
+        {
+            auto sectionBlock = bandBlock(band);
+            section.process(juce::dsp::ProcessContextReplacing<float>(sectionBlock));
+        };
+
+        for (int band = 0; band < 2; ++band)
+            for (int channel = 0; channel < numChannels; ++channel)
+                bands.copyFrom(band * numChannels + channel, 0, block, channel, 0, numBlockSamples);
+
+        process(0, *sections[0]);
+        process(0, *sections[1]);
+        process(1, *sections[2]);
+        bandBlock(2).copyFrom(bandBlock(1));
+        process(1, *sections[3]);
+        process(2, *sections[4]);
+    }
+
+    // Times processBlockwise over a fresh copy of the input, a block at a time
+    template <typename Function>
+    void record(Benchmarks::Trial& trial, const Benchmarks::Config& config, const juce::String& stage, Function&& processBlockwise)
+    {
+        working.makeCopyOf(input, true);
+
+        trial.record(stage, Benchmarks::nanosecondsPerUnit(numSamples, [&]
+        {
+            for (int start = 0; start < numSamples; start += config.blockSize)
+            {
+                juce::AudioBuffer<float> block(working.getArrayOfWritePointers(), numChannels, start,
+                                               juce::jmin(config.blockSize, numSamples - start));
+                processBlockwise(block);
+            }
+        }));
+    }
+};
+
+ProcessBlockBenchmark processBlockBenchmark;
+}
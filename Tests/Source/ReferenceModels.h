@@ -0,0 +1,180 @@
+//
+//  ReferenceModels.h
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef ReferenceModels_h
+#define ReferenceModels_h
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+#include <vector>
+
+// =====================ReferenceModels========================
+
+// Scalar, double precision mirrors of the MATLAB prototypes in prototypes/, written
+// line for line so they can be read side by side with the scripts. They are what
+// the plugin's kernels are checked against wherever no stored vector covers the
+// case, and generate_reference_vectors.py is a port of the same scripts.
+namespace ReferenceModels
+{
+// setFilterParameters.m
+struct Coefficients
+{
+    double A0 = 0, A1 = 0, A2 = 0, B1 = 0, B2 = 0;
+};
+
+enum class FilterType
+{
+    lowpass,
+    highpass,
+    allpass
+};
+
+inline Coefficients setFilterParameters(double cutOffFrequency, double qualityFactor, FilterType filterType, double sampleRate)
+{
+    const double w0 = 2 * juce::MathConstants<double>::pi * cutOffFrequency / sampleRate;
+    const double alpha = std::sin(w0) / (2 * qualityFactor);
+    const double a0 = 1 + alpha;
+    Coefficients c;
+
+    if (filterType == FilterType::lowpass)
+    {
+        c.A0 = (1 - std::cos(w0)) / 2 / a0;
+        c.A1 = (1 - std::cos(w0)) / a0;
+        c.A2 = c.A0;
+        c.B1 = -2 * std::cos(w0) / a0;
+        c.B2 = (1 - alpha) / a0;
+    }
+    else if (filterType == FilterType::highpass)
+    {
+        c.A0 = (1 + std::cos(w0)) / 2 / a0;
+        c.A1 = -(1 + std::cos(w0)) / a0;
+        c.A2 = c.A0;
+        c.B1 = -2 * std::cos(w0) / a0;
+        c.B2 = (1 - alpha) / a0;
+    }
+    else
+    {
+        c.A0 = (1 - alpha) / a0;
+        c.A1 = -2 * std::cos(w0) / a0;
+        c.A2 = (1 + alpha) / a0;
+        c.B1 = c.A1;
+        c.B2 = c.A0;
+    }
+
+    return c;
+}
+
+// processFilter.m for one channel
+struct Filter
+{
+    Coefficients coefficients;
+    double previousSample1 = 0, previousSample2 = 0;
+
+    double processFilter(double inputSample)
+    {
+        const auto& c = coefficients;
+        double outputSample = c.A0 * inputSample + c.A1 * previousSample1 + c.A2 * previousSample2 - c.B1 * previousSample1 - c.B2 * previousSample2;
+
+        previousSample2 = previousSample1;
+        previousSample1 = outputSample;
+        return outputSample;
+    }
+};
+
+// A whole signal through processFilter.m numPasses times per sample, sharing the
+// state as LinkwitzRFilter does; linkWorth*.m make one pass
+inline std::vector<double> filterSignal(const std::vector<double>& x, const Coefficients& coefficients, int numPasses)
+{
+    Filter filter { coefficients };
+    std::vector<double> y(x.size());
+
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        double sample = x[i];
+        for (int pass = 0; pass < numPasses; ++pass)
+            sample = filter.processFilter(sample);
+
+        y[i] = sample;
+    }
+
+    return y;
+}
+
+// A Linkwitz-Riley section as the plugin configures it: Q 0.707, two passes
+inline std::vector<double> linkwitzRiley(const std::vector<double>& x, double crossoverFrequency, FilterType filterType, double sampleRate)
+{
+    return filterSignal(x, setFilterParameters(crossoverFrequency, 0.707, filterType, sampleRate), 2);
+}
+
+// basicComp.m, with the makeUpGain_ and time constants in its units
+struct CompressorSettings
+{
+    double threshold = -10, ratio = 20, tauAttack = 2000, tauRelease = 6000, makeUpGain = 0;
+};
+
+// The control gain c basicComp.m applies to each sample of x
+inline std::vector<double> basicCompGain(const std::vector<double>& x, const CompressorSettings& s, double samplerate)
+{
+    const double alphaAttack = std::exp(-1 / (s.tauAttack * samplerate / 1000));
+    const double alphaRelease = std::exp(-1 / (s.tauRelease * samplerate / 1000));
+    double yL_prev = 0;
+    std::vector<double> c(x.size());
+
+    for (size_t i = 0; i < x.size(); ++i)
+    {
+        const double x_g = std::abs(x[i]) < 0.000001 ? -120 : 20 * std::log10(std::abs(x[i]));
+        const double y_g = x_g >= s.threshold ? s.threshold + (x_g - s.threshold) / s.ratio : x_g;
+        const double x_l = x_g - y_g;
+
+        const double y_l = x_l > yL_prev ? alphaAttack * yL_prev + (1 - alphaAttack) * x_l
+                                         : alphaRelease * yL_prev + (1 - alphaRelease) * x_l;
+
+        c[i] = std::pow(10.0, (s.makeUpGain - y_l) / 20);
+        yL_prev = y_l;
+    }
+
+    return c;
+}
+
+inline std::vector<double> basicComp(const std::vector<double>& x, const CompressorSettings& s, double samplerate)
+{
+    auto y = basicCompGain(x, s, samplerate);
+    for (size_t i = 0; i < y.size(); ++i)
+        y[i] *= x[i];
+
+    return y;
+}
+
+// The plugin's biquad engine on the prototypes: low = LP(fc1) AP(fc2),
+// mid = HP(fc1) LP(fc2), high = HP(fc1) HP(fc2), then basicComp.m on each band
+inline std::array<std::vector<double>, 3> multibandBands(const std::vector<double>& x, double lowMidFrequency, double midHighFrequency,
+                                                         const CompressorSettings& s, double sampleRate, bool compress = true)
+{
+    auto low = linkwitzRiley(linkwitzRiley(x, lowMidFrequency, FilterType::lowpass, sampleRate),
+                             midHighFrequency, FilterType::allpass, sampleRate);
+    auto rest = linkwitzRiley(x, lowMidFrequency, FilterType::highpass, sampleRate);
+    auto mid = linkwitzRiley(rest, midHighFrequency, FilterType::lowpass, sampleRate);
+    auto high = linkwitzRiley(rest, midHighFrequency, FilterType::highpass, sampleRate);
+
+    if (! compress)
+        return { low, mid, high };
+
+    return { basicComp(low, s, sampleRate), basicComp(mid, s, sampleRate), basicComp(high, s, sampleRate) };
+}
+
+inline std::vector<double> multibandSum(const std::array<std::vector<double>, 3>& bands)
+{
+    std::vector<double> sum(bands[0].size());
+    for (size_t i = 0; i < sum.size(); ++i)
+        sum[i] = bands[0][i] + bands[1][i] + bands[2][i];
+
+    return sum;
+}
+}
+
+#endif /* ReferenceModels_h */
@@ -0,0 +1,253 @@
+//
+//  StateTests.cpp
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "TestHelpers.h"
+
+// The processor's saved state: what it restores, and what it refuses to
+
+namespace
+{
+constexpr double sampleRate = 48000.0;
+constexpr int blockSize = 512;
+constexpr int numChannels = 2;
+
+// Saved values go through the parameters' ranges and back, which can move them by
+// a rounding step
+constexpr float normalisedTolerance = 1.0e-5f;
+
+// Every parameter's normalised value, in the processor's order
+std::vector<float> getValues(One_MBCompAudioProcessor& processor)
+{
+    std::vector<float> values;
+
+    for (auto* parameter : processor.getParameters())
+        values.push_back(parameter->getValue());
+
+    return values;
+}
+
+bool valuesMatch(const std::vector<float>& a, const std::vector<float>& b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](float x, float y)
+    {
+        return std::abs(x - y) <= normalisedTolerance;
+    });
+}
+
+// Moves every parameter off its default, so a restore that misses one shows
+void moveOffDefaults(One_MBCompAudioProcessor& processor)
+{
+    for (auto* parameter : processor.getParameters())
+    {
+        auto* ranged = static_cast<juce::RangedAudioParameter*>(parameter);
+        ranged->setValueNotifyingHost(ranged->getDefaultValue() < 0.5f ? 0.7f : 0.3f);
+    }
+}
+
+void restore(One_MBCompAudioProcessor& processor, const juce::MemoryBlock& state)
+{
+    processor.setStateInformation(state.getData(), static_cast<int>(state.getSize()));
+}
+
+juce::RangedAudioParameter& getParameter(One_MBCompAudioProcessor& processor, PluginParameters::ParamNames name)
+{
+    return *processor.apvts.getParameter(PluginParameters::GetParameters().at(name));
+}
+
+void setPlainValue(One_MBCompAudioProcessor& processor, PluginParameters::ParamNames name, float value)
+{
+    auto& parameter = getParameter(processor, name);
+    parameter.setValueNotifyingHost(parameter.convertTo0to1(value));
+}
+
+float getPlainValue(One_MBCompAudioProcessor& processor, PluginParameters::ParamNames name)
+{
+    auto& parameter = getParameter(processor, name);
+    return parameter.convertFrom0to1(parameter.getValue());
+}
+
+// One second of stereo noise through the processor as a host plays it, block by
+// block; the left channel of the output
+std::vector<float> render(One_MBCompAudioProcessor& processor)
+{
+    processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    const auto noise = TestHelpers::noise(static_cast<size_t>(sampleRate), 0.9);
+    juce::AudioBuffer<float> block(numChannels, blockSize);
+    juce::MidiBuffer midi;
+    std::vector<float> output;
+
+    for (size_t start = 0; start + blockSize <= noise.size(); start += blockSize)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            for (int i = 0; i < blockSize; ++i)
+                block.setSample(channel, i, static_cast<float>(noise[start + static_cast<size_t>(i)]));
+        }
+
+        processor.processBlock(block, midi);
+        output.insert(output.end(), block.getReadPointer(0), block.getReadPointer(0) + blockSize);
+    }
+
+    processor.releaseResources();
+    return output;
+}
+
+float maximumDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+    auto difference = 0.f;
+
+    for (size_t i = 0; i < std::min(a.size(), b.size()); ++i)
+        difference = std::max(difference, std::abs(a[i] - b[i]));
+
+    return difference;
+}
+}
+
+class StateTests : public juce::UnitTest
+{
+public:
+    StateTests() : juce::UnitTest("Plugin state", "one_MBComp") {}
+
+    void runTest() override
+    {
+        One_MBCompAudioProcessor source;
+        moveOffDefaults(source);
+
+        juce::MemoryBlock state;
+        source.getStateInformation(state);
+
+        beginTest("Binary state restores every parameter");
+        {
+            One_MBCompAudioProcessor restored;
+            restore(restored, state);
+            expect(valuesMatch(getValues(restored), getValues(source)));
+        }
+
+        beginTest("ValueTree state from before the binary format restores every parameter");
+        {
+            juce::MemoryBlock valueTreeState;
+            juce::MemoryOutputStream stream(valueTreeState, false);
+            source.apvts.copyState().writeToStream(stream);
+            stream.flush();
+
+            One_MBCompAudioProcessor restored;
+            restore(restored, valueTreeState);
+            expect(valuesMatch(getValues(restored), getValues(source)));
+        }
+
+        beginTest("A blob from a newer version leaves the parameters alone");
+        {
+            // The version follows the four bytes of the magic, little-endian
+            auto newer = state;
+            auto* bytes = static_cast<juce::uint8*>(newer.getData());
+            const auto version = juce::ByteOrder::littleEndianShort(bytes + 4) + 1;
+            bytes[4] = static_cast<juce::uint8>(version & 0xff);
+            bytes[5] = static_cast<juce::uint8>(version >> 8);
+
+            One_MBCompAudioProcessor restored;
+            const auto before = getValues(restored);
+            restore(restored, newer);
+            expect(getValues(restored) == before);
+        }
+
+        beginTest("A truncated blob leaves the parameters alone");
+        {
+            // Cut part way through the parameter entries, after the header says how many there are
+            juce::MemoryBlock truncated(state.getData(), state.getSize() / 2);
+
+            One_MBCompAudioProcessor restored;
+            const auto before = getValues(restored);
+            restore(restored, truncated);
+            expect(getValues(restored) == before);
+        }
+
+        using namespace PluginParameters;
+
+        // Snapshot A compresses every band hard and B not at all; the morph runs half
+        // way from A to B while the live thresholds stay at B's
+        One_MBCompAudioProcessor morphed;
+
+        for (auto name : { Threshold_LB, Threshold_MB, Threshold_HB })
+            setPlainValue(morphed, name, -40.f);
+
+        morphed.storeSnapshot(0);
+
+        for (auto name : { Threshold_LB, Threshold_MB, Threshold_HB })
+            setPlainValue(morphed, name, 0.f);
+
+        morphed.storeSnapshot(1);
+        setPlainValue(morphed, Morph_Source, 0.f);
+        setPlainValue(morphed, Morph_Target, 1.f);
+        setPlainValue(morphed, Morph_Amount, 0.5f);
+        setPlainValue(morphed, Morph_Enabled, 1.f);
+
+        juce::MemoryBlock morphState;
+        morphed.getStateInformation(morphState);
+
+        beginTest("A morph between snapshots survives a save and restore");
+        {
+            One_MBCompAudioProcessor restored;
+            restore(restored, morphState);
+
+            expect(restored.hasSnapshot(0) && restored.hasSnapshot(1), "the stored snapshots weren't restored");
+            expect(! restored.hasSnapshot(2) && ! restored.hasSnapshot(3), "empty snapshot slots were restored as stored");
+
+            const auto expected = render(morphed);
+            const auto withRestoredMorph = render(restored);
+            expectLessOrEqual(maximumDifference(withRestoredMorph, expected), 1.0e-5f, "the restored morph sounds different");
+
+            // Without the morph the live thresholds hardly compress, so the snapshots made the difference
+            setPlainValue(restored, Morph_Enabled, 0.f);
+            expectGreaterThan(maximumDifference(render(restored), expected), 0.01f, "the morph made no difference");
+        }
+
+        beginTest("Recalling a snapshot sets the parameters but not the morph controls");
+        {
+            One_MBCompAudioProcessor restored;
+            restore(restored, morphState);
+            setPlainValue(restored, Morph_Amount, 0.25f);
+
+            restored.recallSnapshot(0);
+            expectEquals(getPlainValue(restored, Threshold_MB), -40.f);
+            expectWithinAbsoluteError(getPlainValue(restored, Morph_Amount), 0.25f, 1.0e-4f);
+            expectEquals(getPlainValue(restored, Morph_Enabled), 1.f);
+
+            restored.recallSnapshot(2); // empty, so nothing changes
+            expectEquals(getPlainValue(restored, Threshold_MB), -40.f);
+        }
+
+        beginTest("Version 1 state restores the parameters and empties the snapshot slots");
+        {
+            // Version 1 is version 2 without the snapshot section, so a state saved
+            // with every slot empty, less its slot mask
+            One_MBCompAudioProcessor unstored;
+            moveOffDefaults(unstored);
+
+            juce::MemoryBlock versionOne;
+            unstored.getStateInformation(versionOne);
+            versionOne.setSize(versionOne.getSize() - 2);
+            static_cast<juce::uint8*>(versionOne.getData())[4] = 1;
+            static_cast<juce::uint8*>(versionOne.getData())[5] = 0;
+
+            One_MBCompAudioProcessor restored;
+            restore(restored, morphState);
+            restore(restored, versionOne);
+
+            expect(valuesMatch(getValues(restored), getValues(unstored)));
+
+            for (int slot = 0; slot < ParameterSnapshots::numSlots; ++slot)
+                expect(! restored.hasSnapshot(slot), "snapshot slot " + juce::String(slot) + " outlived the restore");
+        }
+    }
+};
+
+static StateTests stateTests;
@@ -0,0 +1,225 @@
+//
+//  TestHelpers.h
+//  one_MBComp Tests
+//
+//
+//  Copyright © 2023 Oberon Day-West. All rights reserved.
+//
+
+#ifndef TestHelpers_h
+#define TestHelpers_h
+#include <JuceHeader.h>
+#include <cmath>
+#include <complex>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "multibandCore.h"
+
+#if defined (__GLIBC__)
+ #include <malloc.h>
+#elif JUCE_MAC
+ #include <malloc/malloc.h>
+#endif
+
+// =====================TestHelpers========================
+
+namespace TestHelpers
+{
+// One of the stored vector files in Tests/ReferenceVectors, compiled in as binary
+// data. Lines starting with # describe the case; "# columns:" names the columns.
+class ReferenceVectors
+{
+public:
+    // resourceName is the BinaryData name, e.g. "basicComp_txt"
+    explicit ReferenceVectors(const char* resourceName)
+    {
+        int size = 0;
+        const char* data = BinaryData::getNamedResource(resourceName, size);
+        jassert(data != nullptr);
+
+        std::istringstream text(std::string(data != nullptr ? data : "", static_cast<size_t>(size)));
+        std::vector<std::string> names;
+        std::string line;
+
+        while (std::getline(text, line))
+        {
+            if (line.rfind("# columns:", 0) == 0)
+            {
+                std::istringstream header(line.substr(10));
+                for (std::string name; header >> name;)
+                    names.push_back(name);
+            }
+            else if (! line.empty() && line[0] != '#')
+            {
+                std::istringstream row(line);
+                for (const auto& name : names)
+                {
+                    double value = 0;
+                    row >> value;
+                    columns[name].push_back(value);
+                }
+            }
+        }
+    }
+
+    const std::vector<double>& operator[](const std::string& name) const
+    {
+        jassert(columns.count(name) == 1);
+        return columns.at(name);
+    }
+
+private:
+    std::map<std::string, std::vector<double>> columns;
+};
+
+template <typename SampleType>
+std::vector<SampleType> convert(const std::vector<double>& samples)
+{
+    return std::vector<SampleType>(samples.begin(), samples.end());
+}
+
+inline double peakOf(const std::vector<double>& samples, size_t start = 0)
+{
+    double peak = 0;
+    for (size_t i = start; i < samples.size(); ++i)
+        peak = juce::jmax(peak, std::abs(samples[i]));
+
+    return peak;
+}
+
+// Largest absolute difference between actual and expected, from start on
+template <typename SampleType>
+double maximumError(const std::vector<SampleType>& actual, const std::vector<double>& expected, size_t start = 0)
+{
+    double error = 0;
+    for (size_t i = start; i < expected.size(); ++i)
+        error = juce::jmax(error, std::abs(static_cast<double>(actual[i]) - expected[i]));
+
+    return error;
+}
+
+// The same, in dB relative to the expected signal's peak; -400 for an exact match
+template <typename SampleType>
+double maximumErrorDb(const std::vector<SampleType>& actual, const std::vector<double>& expected, size_t start = 0)
+{
+    const auto error = maximumError(actual, expected, start);
+    return error > 0 ? 20 * std::log10(error / peakOf(expected, start)) : -400.0;
+}
+
+// Magnitude of an impulse response at one frequency, in dB
+inline double magnitudeDb(const std::vector<double>& impulseResponse, double frequency, double sampleRate)
+{
+    std::complex<double> sum;
+    const auto step = std::polar(1.0, -juce::MathConstants<double>::twoPi * frequency / sampleRate);
+    auto rotation = std::complex<double>(1.0);
+
+    for (auto sample : impulseResponse)
+    {
+        sum += sample * rotation;
+        rotation *= step;
+    }
+
+    return 20 * std::log10(std::abs(sum));
+}
+
+// Log-spaced frequencies from 20 Hz to just under Nyquist
+inline std::vector<double> logFrequencies(double sampleRate, int numPoints = 200)
+{
+    std::vector<double> frequencies;
+    const auto top = 0.45 * sampleRate;
+
+    for (int i = 0; i < numPoints; ++i)
+        frequencies.push_back(20.0 * std::pow(top / 20.0, i / double(numPoints - 1)));
+
+    return frequencies;
+}
+
+// Runs a mono signal through process(context) in blocks of blockSize samples
+template <typename SampleType, typename Processor>
+std::vector<SampleType> processInBlocks(const std::vector<double>& input, size_t blockSize, Processor&& process)
+{
+    auto samples = convert<SampleType>(input);
+
+    for (size_t start = 0; start < samples.size(); start += blockSize)
+    {
+        auto* channel = samples.data() + start;
+        auto block = juce::dsp::AudioBlock<SampleType>(&channel, 1, juce::jmin(blockSize, samples.size() - start));
+        auto context = juce::dsp::ProcessContextReplacing<SampleType>(block);
+        process(context);
+    }
+
+    return samples;
+}
+
+// Runs a mono signal through a prepared core in blocks of blockSize samples
+template <typename SampleType>
+std::vector<SampleType> processCore(MultibandCore& core, const std::vector<double>& input, size_t blockSize)
+{
+    auto samples = convert<SampleType>(input);
+
+    for (size_t start = 0; start < samples.size(); start += blockSize)
+    {
+        auto* channel = samples.data() + start;
+        core.process(&channel, 1, static_cast<int>(juce::jmin(blockSize, samples.size() - start)));
+    }
+
+    return samples;
+}
+
+// Feeds a core silence, as a host would, until its Linear Phase engine is or isn't
+// ready. False if the designer thread didn't get there within about five seconds.
+inline bool waitForLinearPhase(MultibandCore& core, bool ready)
+{
+    std::vector<float> silence(512, 0.f);
+    auto* channel = silence.data();
+
+    for (int attempt = 0; attempt < 1000; ++attempt)
+    {
+        core.process(&channel, 1, static_cast<int>(silence.size()));
+
+        if (core.isLinearPhaseReady() == ready)
+            return true;
+
+        juce::Thread::sleep(5);
+    }
+
+    return false;
+}
+
+// Bytes of heap in use by the whole process, counting both malloc and new, or 0
+// where the platform can't say. Thread stacks are mapped separately and not included.
+inline size_t heapBytesInUse()
+{
+   #if defined (__GLIBC__)
+    #if __GLIBC_PREREQ (2, 33)
+     const auto info = mallinfo2();
+     return info.uordblks + info.hblkhd;
+    #else
+     const auto info = mallinfo();
+     return static_cast<size_t>(static_cast<unsigned int>(info.uordblks)) + static_cast<size_t>(static_cast<unsigned int>(info.hblkhd));
+    #endif
+   #elif JUCE_MAC
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(nullptr, &statistics);
+    return statistics.size_in_use;
+   #else
+    return 0;
+   #endif
+}
+
+// Deterministic white noise at the given peak
+inline std::vector<double> noise(size_t numSamples, double peak, juce::int64 seed = 21501990)
+{
+    juce::Random random(seed);
+    std::vector<double> samples(numSamples);
+
+    for (auto& sample : samples)
+        sample = peak * (2.0 * random.nextDouble() - 1.0);
+
+    return samples;
+}
+}
+
+#endif /* TestHelpers_h */